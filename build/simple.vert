@@ -2,9 +2,14 @@
 
 uniform mat4 mat4Loc;
 
+// Quantized positions are stored relative to the mesh's bounding box, for the float vertex
+// layouts these are just 0 and 1
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
 in vec3 position;
 
 void main()
 {
-    gl_Position = mat4Loc * vec4(position,1.0f);
+    gl_Position = mat4Loc * vec4(positionOffset + position*positionScale,1.0f);
 }
@@ -0,0 +1,1351 @@
+#include <algorithm>
+#include <math.h>
+
+#include "glm/gtc/bitfield.hpp"
+
+#include "bvh.h"
+#include "threadpool.h"
+
+using namespace std;
+
+static const int binCount = 16;
+
+// What the surface area heuristic counts visiting a node as, relative to testing one triangle
+static const float traversalCost = 1.0f;
+
+// Subtrees below this many triangles aren't worth a task of their own
+static const int minTaskTriangles = 4096;
+
+// The linear build makes leaves of at most this many triangles, since it can't tell whether
+// splitting them further pays off
+static const int linearLeafTriangles = 4;
+
+// The linear build gives each axis 10 bits of the Morton codes (30 in all) up to this many
+// triangles, and 21 bits (63 in all) above it, so that big meshes don't end up with lots of
+// triangles on the same code. Shorter codes take half as many passes to sort, and a 1024^3 grid
+// still has room for a few million triangles on a surface
+static const int shortMortonCodeTriangles = 1 << 22;
+
+struct SubtreeTask
+{
+    int node;
+    int begin;
+    int end;
+    int depth;
+};
+
+struct BVHBuildData
+{
+    const glm::vec3* triangleMin;
+    const glm::vec3* triangleMax;
+
+    // The triangles, which get partitioned in place so that every node's are a consecutive range
+    int* triangleIds;
+
+    // Only for the linear build, each triangle's Morton code, in the same (sorted) order
+    const uint64_t* mortonCodes;
+
+    // Subtrees with fewer triangles than this aren't built, but added to deferred to be built
+    // later (0 builds everything)
+    int deferBelow;
+    vector<SubtreeTask>* deferred;
+};
+
+static float surfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+    glm::vec3 extent = boundsMax - boundsMin;
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+// NOTE: Centroids are kept doubled (min + max) since only where they are relative to each other
+//       matters. The checks keep NaN positions from turning into an out of range bin
+static int centroidBin(const BVHBuildData& data, int triangle, int axis, float centroidMin, float scale)
+{
+    float centroid = data.triangleMin[triangle][axis] + data.triangleMax[triangle][axis];
+    float bin = (centroid - centroidMin) * scale;
+    if(!(bin > 0.0f))
+    {
+        return 0;
+    }
+    return (bin < binCount) ? (int)bin : binCount - 1;
+}
+
+// Builds the subtree of the triangles from begin to end, with its root at nodes[nodeIndex], and
+// returns how many levels deep it goes (counting from the top of the whole tree)
+static int buildNode(BVHBuildData& data, vector<BVHNode>& nodes, int nodeIndex, int begin, int end, int depth)
+{
+    int count = end - begin;
+    if(count < data.deferBelow)
+    {
+        SubtreeTask task = { nodeIndex, begin, end, depth };
+        data.deferred->push_back(task);
+        return depth + 1;
+    }
+
+    glm::vec3 boundsMin = data.triangleMin[data.triangleIds[begin]];
+    glm::vec3 boundsMax = data.triangleMax[data.triangleIds[begin]];
+    glm::vec3 centroidMin = boundsMin + boundsMax;
+    glm::vec3 centroidMax = centroidMin;
+    for(int i=begin+1; i<end; i++)
+    {
+        int triangle = data.triangleIds[i];
+        boundsMin = glm::min(boundsMin, data.triangleMin[triangle]);
+        boundsMax = glm::max(boundsMax, data.triangleMax[triangle]);
+        glm::vec3 centroid = data.triangleMin[triangle] + data.triangleMax[triangle];
+        centroidMin = glm::min(centroidMin, centroid);
+        centroidMax = glm::max(centroidMax, centroid);
+    }
+    for(int axis=0; axis<3; axis++)
+    {
+        nodes[nodeIndex].boundsMin[axis] = boundsMin[axis];
+        nodes[nodeIndex].boundsMax[axis] = boundsMax[axis];
+    }
+    nodes[nodeIndex].first = begin;
+    nodes[nodeIndex].triangleCount = count;
+    if((count == 1) || (depth == BVH_MAX_DEPTH - 1))
+    {
+        return depth + 1;
+    }
+
+    // Sort the centroids into bins along all three axes at once, then try splitting between every
+    // two bins of each axis by sweeping over them from both ends
+    int bestAxis = -1;
+    int bestBin = 0;
+    float bestCost = 0.0f;
+    glm::vec3 centroidExtent = centroidMax - centroidMin;
+    glm::vec3 binScale;
+    for(int axis=0; axis<3; axis++)
+    {
+        binScale[axis] = binCount / centroidExtent[axis];
+        if(!(centroidExtent[axis] > 0.0f) || !(binScale[axis] < 1e30f))
+        {
+            binScale[axis] = 0.0f;
+        }
+    }
+    int binTriangles[3][binCount] = {};
+    glm::vec3 binMin[3][binCount];
+    glm::vec3 binMax[3][binCount];
+    for(int i=begin; i<end; i++)
+    {
+        int triangle = data.triangleIds[i];
+        const glm::vec3& triangleMin = data.triangleMin[triangle];
+        const glm::vec3& triangleMax = data.triangleMax[triangle];
+        for(int axis=0; axis<3; axis++)
+        {
+            int bin = centroidBin(data, triangle, axis, centroidMin[axis], binScale[axis]);
+            if(binTriangles[axis][bin] == 0)
+            {
+                binMin[axis][bin] = triangleMin;
+                binMax[axis][bin] = triangleMax;
+            }
+            else
+            {
+                binMin[axis][bin] = glm::min(binMin[axis][bin], triangleMin);
+                binMax[axis][bin] = glm::max(binMax[axis][bin], triangleMax);
+            }
+            binTriangles[axis][bin]++;
+        }
+    }
+    for(int axis=0; axis<3; axis++)
+    {
+        if(binScale[axis] == 0.0f)
+        {
+            continue;
+        }
+
+        // rightCost[bin] is the cost of the bins from bin on, as one child
+        float rightCost[binCount];
+        int rightTriangles = 0;
+        glm::vec3 rightMin(0.0f), rightMax(0.0f);
+        for(int bin=binCount-1; bin>0; bin--)
+        {
+            if(binTriangles[axis][bin] > 0)
+            {
+                rightMin = (rightTriangles > 0) ? glm::min(rightMin, binMin[axis][bin]) : binMin[axis][bin];
+                rightMax = (rightTriangles > 0) ? glm::max(rightMax, binMax[axis][bin]) : binMax[axis][bin];
+                rightTriangles += binTriangles[axis][bin];
+            }
+            rightCost[bin] = (rightTriangles > 0) ? surfaceArea(rightMin, rightMax) * rightTriangles : -1.0f;
+        }
+        int leftTriangles = 0;
+        glm::vec3 leftMin(0.0f), leftMax(0.0f);
+        for(int bin=1; bin<binCount; bin++)
+        {
+            if(binTriangles[axis][bin - 1] > 0)
+            {
+                leftMin = (leftTriangles > 0) ? glm::min(leftMin, binMin[axis][bin - 1]) : binMin[axis][bin - 1];
+                leftMax = (leftTriangles > 0) ? glm::max(leftMax, binMax[axis][bin - 1]) : binMax[axis][bin - 1];
+                leftTriangles += binTriangles[axis][bin - 1];
+            }
+            if((leftTriangles == 0) || (rightCost[bin] < 0.0f))
+            {
+                continue;
+            }
+            float cost = surfaceArea(leftMin, leftMax) * leftTriangles + rightCost[bin];
+            if((bestAxis < 0) || (cost < bestCost))
+            {
+                bestAxis = axis;
+                bestBin = bin;
+                bestCost = cost;
+            }
+        }
+    }
+
+    // NOTE: The costs above are all scaled by this node's surface area, which saves dividing them
+    //       by it. A node that's small enough stays a leaf if testing all of its triangles is
+    //       cheaper than visiting two children
+    float area = surfaceArea(boundsMin, boundsMax);
+    bool splitPaysOff = (bestAxis >= 0) && (bestCost + traversalCost * area < count * area);
+    if((count <= BVH_MAX_LEAF_TRIANGLES) && !splitPaysOff)
+    {
+        return depth + 1;
+    }
+
+    // If all of the centroids are in the same spot, any split is as good as any other
+    int* middle = data.triangleIds + begin + count / 2;
+    if(bestAxis >= 0)
+    {
+        float axisMin = centroidMin[bestAxis];
+        float axisScale = binScale[bestAxis];
+        middle = partition(data.triangleIds + begin, data.triangleIds + end, [&](int triangle)
+        {
+            return centroidBin(data, triangle, bestAxis, axisMin, axisScale) < bestBin;
+        });
+    }
+
+    int firstChild = nodes.size();
+    nodes.resize(nodes.size() + 2);
+    nodes[nodeIndex].first = firstChild;
+    nodes[nodeIndex].triangleCount = 0;
+    int split = middle - data.triangleIds;
+    int leftDepth = buildNode(data, nodes, firstChild, begin, split, depth + 1);
+    int rightDepth = buildNode(data, nodes, firstChild + 1, split, end, depth + 1);
+    return max(leftDepth, rightDepth);
+}
+
+// The range of triangles with the same bits above the highest bit that the first and last
+// triangles' codes differ in gets split where that bit changes, which is where the octree of the
+// Morton curve would split it. Triangles on the same code just get split in half
+static int mortonSplit(const uint64_t* codes, int begin, int end)
+{
+    uint64_t differentBits = codes[begin] ^ codes[end - 1];
+    if(differentBits == 0)
+    {
+        return (begin + end) / 2;
+    }
+    uint64_t highestBit = 1;
+    while((differentBits >> 1) >= highestBit)
+    {
+        highestBit <<= 1;
+    }
+    return partition_point(codes + begin, codes + end, [&](uint64_t code)
+    {
+        return (code & highestBit) == 0;
+    }) - codes;
+}
+
+// Sets the node's box to the one around its two children
+static void fitNode(vector<BVHNode>& nodes, int nodeIndex)
+{
+    BVHNode& node = nodes[nodeIndex];
+    const BVHNode& left = nodes[node.first];
+    const BVHNode& right = nodes[node.first + 1];
+    for(int axis=0; axis<3; axis++)
+    {
+        node.boundsMin[axis] = min(left.boundsMin[axis], right.boundsMin[axis]);
+        node.boundsMax[axis] = max(left.boundsMax[axis], right.boundsMax[axis]);
+    }
+}
+
+// buildNode for the linear build, where the triangles from begin to end are already sorted by
+// their Morton codes, so each node is only a split of its range. The boxes get filled in on the
+// way back up, except above deferred subtrees, which are left for later
+static int buildLinearNode(BVHBuildData& data, vector<BVHNode>& nodes, int nodeIndex, int begin, int end, int depth)
+{
+    int count = end - begin;
+    if(count < data.deferBelow)
+    {
+        SubtreeTask task = { nodeIndex, begin, end, depth };
+        data.deferred->push_back(task);
+        return depth + 1;
+    }
+
+    if((count <= linearLeafTriangles) || (depth == BVH_MAX_DEPTH - 1))
+    {
+        glm::vec3 boundsMin = data.triangleMin[data.triangleIds[begin]];
+        glm::vec3 boundsMax = data.triangleMax[data.triangleIds[begin]];
+        for(int i=begin+1; i<end; i++)
+        {
+            boundsMin = glm::min(boundsMin, data.triangleMin[data.triangleIds[i]]);
+            boundsMax = glm::max(boundsMax, data.triangleMax[data.triangleIds[i]]);
+        }
+        for(int axis=0; axis<3; axis++)
+        {
+            nodes[nodeIndex].boundsMin[axis] = boundsMin[axis];
+            nodes[nodeIndex].boundsMax[axis] = boundsMax[axis];
+        }
+        nodes[nodeIndex].first = begin;
+        nodes[nodeIndex].triangleCount = count;
+        return depth + 1;
+    }
+
+    int split = mortonSplit(data.mortonCodes, begin, end);
+    int firstChild = nodes.size();
+    nodes.resize(nodes.size() + 2);
+    nodes[nodeIndex].first = firstChild;
+    nodes[nodeIndex].triangleCount = 0;
+    int leftDepth = buildLinearNode(data, nodes, firstChild, begin, split, depth + 1);
+    int rightDepth = buildLinearNode(data, nodes, firstChild + 1, split, end, depth + 1);
+    fitNode(nodes, nodeIndex);
+    return max(leftDepth, rightDepth);
+}
+
+// Splits the triangles into chunks, enough of them for every thread to get a few
+static int triangleChunkSize(const ThreadPool& pool, int triangleCount)
+{
+    return max(minTaskTriangles, triangleCount / (4 * pool.threadCount()));
+}
+
+// The bounding box of every triangle
+static void computeTriangleBounds(ThreadPool& pool, const unsigned int* indices, int triangleCount,
+                                  const float* positions, vector<glm::vec3>& triangleMin,
+                                  vector<glm::vec3>& triangleMax)
+{
+    int chunkSize = triangleChunkSize(pool, triangleCount);
+    int chunkCount = (triangleCount + chunkSize - 1) / chunkSize;
+    triangleMin.resize(triangleCount);
+    triangleMax.resize(triangleCount);
+    pool.parallelFor(chunkCount, [&](int chunk)
+    {
+        int chunkEnd = min(triangleCount, (chunk + 1) * chunkSize);
+        for(int triangle=chunk*chunkSize; triangle<chunkEnd; triangle++)
+        {
+            const float* p0 = &positions[3*indices[3*triangle]];
+            const float* p1 = &positions[3*indices[3*triangle + 1]];
+            const float* p2 = &positions[3*indices[3*triangle + 2]];
+            glm::vec3 v0(p0[0], p0[1], p0[2]);
+            glm::vec3 v1(p1[0], p1[1], p1[2]);
+            glm::vec3 v2(p2[0], p2[1], p2[2]);
+            triangleMin[triangle] = glm::min(v0, glm::min(v1, v2));
+            triangleMax[triangle] = glm::max(v0, glm::max(v1, v2));
+        }
+    });
+}
+
+// Builds the subtrees that the top of the tree deferred with buildSubtree, each into its own
+// array, and appends those to nodes once they're all done. The biggest ones go first, so that no
+// thread is left with a big one at the end. Returns how deep the deepest one goes
+static int buildSubtrees(ThreadPool& pool, vector<SubtreeTask>& subtrees, vector<BVHNode>& nodes,
+                         const function<int(const SubtreeTask&, vector<BVHNode>&)>& buildSubtree)
+{
+    sort(subtrees.begin(), subtrees.end(), [](const SubtreeTask& a, const SubtreeTask& b)
+    {
+        return (a.end - a.begin) > (b.end - b.begin);
+    });
+
+    vector<vector<BVHNode> > subtreeNodes(subtrees.size());
+    vector<int> subtreeDepths(subtrees.size());
+    pool.parallelFor(subtrees.size(), [&](int subtree)
+    {
+        subtreeNodes[subtree].resize(1);
+        subtreeDepths[subtree] = buildSubtree(subtrees[subtree], subtreeNodes[subtree]);
+    });
+
+    // A subtree's root goes where the top of the tree left room for it, and the rest of its nodes
+    // go at the end, so their child indices move along by where that is (less the root)
+    int depth = 0;
+    for(size_t subtree=0; subtree<subtrees.size(); subtree++)
+    {
+        vector<BVHNode>& subtreeArray = subtreeNodes[subtree];
+        int offset = (int)nodes.size() - 1;
+        for(size_t node=0; node<subtreeArray.size(); node++)
+        {
+            if(subtreeArray[node].triangleCount == 0)
+            {
+                subtreeArray[node].first += offset;
+            }
+        }
+        nodes[subtrees[subtree].node] = subtreeArray[0];
+        nodes.insert(nodes.end(), subtreeArray.begin() + 1, subtreeArray.end());
+        depth = max(depth, subtreeDepths[subtree]);
+        vector<BVHNode>().swap(subtreeArray);
+    }
+    return depth;
+}
+
+void BVH::build(const unsigned int* indices, int indexCount, const float* positions, int threadCount)
+{
+    clear();
+    int triangleCount = indexCount / 3;
+    if(triangleCount == 0)
+    {
+        return;
+    }
+
+    ThreadPool pool(threadCount);
+    vector<glm::vec3> triangleMin;
+    vector<glm::vec3> triangleMax;
+    computeTriangleBounds(pool, indices, triangleCount, positions, triangleMin, triangleMax);
+    triangleIds.resize(triangleCount);
+    for(int triangle=0; triangle<triangleCount; triangle++)
+    {
+        triangleIds[triangle] = triangle;
+    }
+
+    // NOTE: The top of the tree only gets split until there are enough subtrees to keep every
+    //       thread busy, and those are then built in parallel (see buildSubtrees)
+    vector<SubtreeTask> subtrees;
+    BVHBuildData data = { &triangleMin[0], &triangleMax[0], &triangleIds[0], NULL, 0, &subtrees };
+    if(pool.threadCount() > 1)
+    {
+        data.deferBelow = max(minTaskTriangles, triangleCount / (8 * pool.threadCount()));
+    }
+    nodes.resize(1);
+    treeDepth = buildNode(data, nodes, 0, 0, triangleCount, 0);
+    int subtreeDepth = buildSubtrees(pool, subtrees, nodes, [&](const SubtreeTask& task, vector<BVHNode>& subtreeNodes)
+    {
+        BVHBuildData subtreeData = data;
+        subtreeData.deferBelow = 0;
+        return buildNode(subtreeData, subtreeNodes, 0, task.begin, task.end, task.depth);
+    });
+    treeDepth = max(treeDepth, subtreeDepth);
+
+    copyTriangles(pool, indices, positions);
+    collapseNode(0);
+}
+
+void BVH::buildLinear(const unsigned int* indices, int indexCount, const float* positions, int threadCount)
+{
+    clear();
+    int triangleCount = indexCount / 3;
+    if(triangleCount == 0)
+    {
+        return;
+    }
+
+    ThreadPool pool(threadCount);
+    int chunkSize = triangleChunkSize(pool, triangleCount);
+    int chunkCount = (triangleCount + chunkSize - 1) / chunkSize;
+    vector<glm::vec3> triangleMin;
+    vector<glm::vec3> triangleMax;
+    computeTriangleBounds(pool, indices, triangleCount, positions, triangleMin, triangleMax);
+
+    // The Morton codes place the (doubled) centroids on a grid over the box around them
+    vector<glm::vec3> chunkMin(chunkCount);
+    vector<glm::vec3> chunkMax(chunkCount);
+    pool.parallelFor(chunkCount, [&](int chunk)
+    {
+        int chunkEnd = min(triangleCount, (chunk + 1) * chunkSize);
+        chunkMin[chunk] = triangleMin[chunk * chunkSize] + triangleMax[chunk * chunkSize];
+        chunkMax[chunk] = chunkMin[chunk];
+        for(int triangle=chunk*chunkSize+1; triangle<chunkEnd; triangle++)
+        {
+            glm::vec3 centroid = triangleMin[triangle] + triangleMax[triangle];
+            chunkMin[chunk] = glm::min(chunkMin[chunk], centroid);
+            chunkMax[chunk] = glm::max(chunkMax[chunk], centroid);
+        }
+    });
+    glm::vec3 centroidMin = chunkMin[0];
+    glm::vec3 centroidMax = chunkMax[0];
+    for(int chunk=1; chunk<chunkCount; chunk++)
+    {
+        centroidMin = glm::min(centroidMin, chunkMin[chunk]);
+        centroidMax = glm::max(centroidMax, chunkMax[chunk]);
+    }
+    int axisBits = (triangleCount <= shortMortonCodeTriangles) ? 10 : 21;
+    float maxCell = (float)((1 << axisBits) - 1);
+    glm::vec3 cellScale;
+    for(int axis=0; axis<3; axis++)
+    {
+        float extent = centroidMax[axis] - centroidMin[axis];
+        cellScale[axis] = (extent > 0.0f) ? maxCell / extent : 0.0f;
+        if(!(cellScale[axis] < 1e30f))
+        {
+            cellScale[axis] = 0.0f;
+        }
+    }
+    vector<uint64_t> mortonCodes(triangleCount);
+    triangleIds.resize(triangleCount);
+    pool.parallelFor(chunkCount, [&](int chunk)
+    {
+        int chunkEnd = min(triangleCount, (chunk + 1) * chunkSize);
+        for(int triangle=chunk*chunkSize; triangle<chunkEnd; triangle++)
+        {
+            // NOTE: Written so that NaN positions end up in cell 0
+            glm::vec3 cell = (triangleMin[triangle] + triangleMax[triangle] - centroidMin) * cellScale;
+            glm::uint32 cells[3];
+            for(int axis=0; axis<3; axis++)
+            {
+                cells[axis] = (cell[axis] > 0.0f) ? (glm::uint32)min(cell[axis], maxCell) : 0;
+            }
+            mortonCodes[triangle] = glm::bitfieldInterleave(cells[0], cells[1], cells[2]);
+            triangleIds[triangle] = triangle;
+        }
+    });
+    // NOTE: The ids are never negative, so sorting them as unsigned is fine
+    mortonSorter.sort(pool, &mortonCodes[0], (uint32_t*)&triangleIds[0], triangleCount, 3 * axisBits);
+
+    vector<SubtreeTask> subtrees;
+    BVHBuildData data = { &triangleMin[0], &triangleMax[0], &triangleIds[0], &mortonCodes[0], 0, &subtrees };
+    if(pool.threadCount() > 1)
+    {
+        data.deferBelow = max(minTaskTriangles, triangleCount / (8 * pool.threadCount()));
+    }
+    nodes.resize(1);
+    treeDepth = buildLinearNode(data, nodes, 0, 0, triangleCount, 0);
+    int topNodeCount = nodes.size();
+    int subtreeDepth = buildSubtrees(pool, subtrees, nodes, [&](const SubtreeTask& task, vector<BVHNode>& subtreeNodes)
+    {
+        BVHBuildData subtreeData = data;
+        subtreeData.deferBelow = 0;
+        return buildLinearNode(subtreeData, subtreeNodes, 0, task.begin, task.end, task.depth);
+    });
+    treeDepth = max(treeDepth, subtreeDepth);
+
+    // The nodes above the subtrees only get their boxes now. Children always come after their
+    // parent, so going backwards gets to them first
+    if(!subtrees.empty())
+    {
+        for(int node=topNodeCount-1; node>=0; node--)
+        {
+            if(nodes[node].triangleCount == 0)
+            {
+                fitNode(nodes, node);
+            }
+        }
+    }
+
+    copyTriangles(pool, indices, positions);
+    collapseNode(0);
+}
+
+bool BVH::restore(const BVHNode* treeNodes, int nodeCount, const int* ids, const unsigned int* indices,
+                  int indexCount, const float* positions, int threadCount)
+{
+    clear();
+    int triangleCount = indexCount / 3;
+    if((nodeCount == 0) || (triangleCount == 0))
+    {
+        return (nodeCount == 0) && (triangleCount == 0);
+    }
+
+    // NOTE: Every node has to be reached from the root exactly once, with its children further
+    //       on in the array (as both builds lay them out) and no deeper than the traversal stacks
+    //       go. Since parents come first, a node nothing has reached by the time we get to it
+    //       never will be
+    vector<int> nodeDepths(nodeCount, -1);
+    nodeDepths[0] = 0;
+    int deepest = 0;
+    for(int node=0; node<nodeCount; node++)
+    {
+        const BVHNode& treeNode = treeNodes[node];
+        if(nodeDepths[node] < 0)
+        {
+            return false;
+        }
+        if(treeNode.triangleCount > 0)
+        {
+            if((treeNode.first < 0) || (treeNode.first > triangleCount - treeNode.triangleCount))
+            {
+                return false;
+            }
+            continue;
+        }
+        int childDepth = nodeDepths[node] + 1;
+        if((treeNode.triangleCount < 0) || (treeNode.first <= node) || (treeNode.first >= nodeCount - 1) ||
+           (nodeDepths[treeNode.first] >= 0) || (nodeDepths[treeNode.first + 1] >= 0) ||
+           (childDepth >= BVH_MAX_DEPTH))
+        {
+            return false;
+        }
+        nodeDepths[treeNode.first] = childDepth;
+        nodeDepths[treeNode.first + 1] = childDepth;
+        deepest = max(deepest, childDepth);
+    }
+    for(int i=0; i<triangleCount; i++)
+    {
+        if((ids[i] < 0) || (ids[i] >= triangleCount))
+        {
+            return false;
+        }
+    }
+
+    nodes.assign(treeNodes, treeNodes + nodeCount);
+    triangleIds.assign(ids, ids + triangleCount);
+    treeDepth = deepest + 1;
+    ThreadPool pool(threadCount);
+    copyTriangles(pool, indices, positions);
+    collapseNode(0);
+    return true;
+}
+
+void BVH::copyTriangles(ThreadPool& pool, const unsigned int* indices, const float* positions)
+{
+    int triangleCount = triangleIds.size();
+    int chunkSize = triangleChunkSize(pool, triangleCount);
+    int chunkCount = (triangleCount + chunkSize - 1) / chunkSize;
+    triangles.resize(triangleCount);
+    pool.parallelFor(chunkCount, [&](int chunk)
+    {
+        int chunkEnd = min(triangleCount, (chunk + 1) * chunkSize);
+        for(int i=chunk*chunkSize; i<chunkEnd; i++)
+        {
+            int triangle = triangleIds[i];
+            const float* p0 = &positions[3*indices[3*triangle]];
+            const float* p1 = &positions[3*indices[3*triangle + 1]];
+            const float* p2 = &positions[3*indices[3*triangle + 2]];
+            triangles[i].corner = glm::vec3(p0[0], p0[1], p0[2]);
+            triangles[i].edge1 = glm::vec3(p1[0], p1[1], p1[2]) - triangles[i].corner;
+            triangles[i].edge2 = glm::vec3(p2[0], p2[1], p2[2]) - triangles[i].corner;
+        }
+    });
+}
+
+int BVH::collapseNode(int node)
+{
+    // NOTE: Starting from the node's two children, the child with the biggest box keeps getting
+    //       replaced by its own two children until there are 4 of them (or only leaves), since
+    //       the biggest boxes are the ones rays visit most. A leaf at the root ends up as the
+    //       only child of the wide root
+    int children[4] = { node, 0, 0, 0 };
+    int childCount = 1;
+    if(nodes[node].triangleCount == 0)
+    {
+        children[0] = nodes[node].first;
+        children[1] = nodes[node].first + 1;
+        childCount = 2;
+    }
+    while(childCount < 4)
+    {
+        int largest = -1;
+        float largestArea = 0.0f;
+        for(int child=0; child<childCount; child++)
+        {
+            const BVHNode& childNode = nodes[children[child]];
+            float area = surfaceArea(glm::vec3(childNode.boundsMin[0], childNode.boundsMin[1], childNode.boundsMin[2]),
+                                     glm::vec3(childNode.boundsMax[0], childNode.boundsMax[1], childNode.boundsMax[2]));
+            if((childNode.triangleCount == 0) && ((largest < 0) || (area > largestArea)))
+            {
+                largest = child;
+                largestArea = area;
+            }
+        }
+        if(largest < 0)
+        {
+            break;
+        }
+        int opened = children[largest];
+        children[largest] = nodes[opened].first;
+        children[childCount++] = nodes[opened].first + 1;
+    }
+
+    int wideNode = wideNodes.size();
+    wideNodes.push_back(BVH4Node());
+    for(int slot=0; slot<4; slot++)
+    {
+        const BVHNode& child = nodes[children[slot]];
+        bool used = (slot < childCount);
+        wideNodes[wideNode].boundsMinX[slot] = used ? child.boundsMin[0] : 0.0f;
+        wideNodes[wideNode].boundsMinY[slot] = used ? child.boundsMin[1] : 0.0f;
+        wideNodes[wideNode].boundsMinZ[slot] = used ? child.boundsMin[2] : 0.0f;
+        wideNodes[wideNode].boundsMaxX[slot] = used ? child.boundsMax[0] : 0.0f;
+        wideNodes[wideNode].boundsMaxY[slot] = used ? child.boundsMax[1] : 0.0f;
+        wideNodes[wideNode].boundsMaxZ[slot] = used ? child.boundsMax[2] : 0.0f;
+        wideNodes[wideNode].first[slot] = used ? child.first : 0;
+        wideNodes[wideNode].triangleCount[slot] = used ? child.triangleCount : -1;
+    }
+    for(int slot=0; slot<childCount; slot++)
+    {
+        if(nodes[children[slot]].triangleCount == 0)
+        {
+            int wideChild = collapseNode(children[slot]);
+            wideNodes[wideNode].first[slot] = wideChild;
+        }
+    }
+    return wideNode;
+}
+
+void BVH::clear()
+{
+    vector<BVHNode>().swap(nodes);
+    vector<BVH4Node>().swap(wideNodes);
+    vector<Triangle>().swap(triangles);
+    vector<int>().swap(triangleIds);
+    treeDepth = 0;
+}
+
+bool BVH::empty() const
+{
+    return nodes.empty();
+}
+
+int BVH::nodeCount() const
+{
+    return nodes.size();
+}
+
+int BVH::depth() const
+{
+    return treeDepth;
+}
+
+const vector<BVHNode>& BVH::nodeArray() const
+{
+    return nodes;
+}
+
+const vector<BVH4Node>& BVH::wideNodeArray() const
+{
+    return wideNodes;
+}
+
+const vector<int>& BVH::triangleIdArray() const
+{
+    return triangleIds;
+}
+
+bool intersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& corner,
+                       const glm::vec3& edge1, const glm::vec3& edge2, float& distance, float& u, float& v)
+{
+    // NOTE: The comparisons are written so that NaNs (from a ray parallel to the triangle, or a
+    //       triangle with no area) fail them
+    glm::vec3 p = glm::cross(direction, edge2);
+    float inverseDeterminant = 1.0f / glm::dot(edge1, p);
+    glm::vec3 s = origin - corner;
+    u = glm::dot(s, p) * inverseDeterminant;
+    if(!((u >= 0.0f) && (u <= 1.0f)))
+    {
+        return false;
+    }
+    glm::vec3 q = glm::cross(s, edge1);
+    v = glm::dot(direction, q) * inverseDeterminant;
+    if(!((v >= 0.0f) && (u + v <= 1.0f)))
+    {
+        return false;
+    }
+    distance = glm::dot(edge2, q) * inverseDeterminant;
+    return true;
+}
+
+// The reciprocal of the direction for the slab tests, with zeroes nudged off zero so that a ray
+// starting right on a slab doesn't give 0 * infinity
+static glm::vec3 inverseRayDirection(const glm::vec3& direction)
+{
+    glm::vec3 inverse;
+    for(int axis=0; axis<3; axis++)
+    {
+        float component = (fabsf(direction[axis]) > 1e-20f) ? direction[axis] : copysignf(1e-20f, direction[axis]);
+        inverse[axis] = 1.0f / component;
+    }
+    return inverse;
+}
+
+// NOTE: Rounding in the slab distances could make a ray that just grazes a box (and a triangle
+//       lying on its side) miss it, or seem to get there a little after the triangle, so boxes
+//       get a little slack at the far end, as PBRT does. The triangle test rounds too, more so
+//       for rays nearly along the triangle's plane, hence a good few ulps rather than PBRT's 3
+static const float boxDistanceSlack = 1.000002f;
+
+// Whether the ray gets into the node's box before maxDistance, and how far along it does
+static bool intersectNode(const BVHNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection,
+                          float maxDistance, float& entryDistance)
+{
+    float x0 = (node.boundsMin[0] - origin.x) * inverseDirection.x;
+    float x1 = (node.boundsMax[0] - origin.x) * inverseDirection.x;
+    float y0 = (node.boundsMin[1] - origin.y) * inverseDirection.y;
+    float y1 = (node.boundsMax[1] - origin.y) * inverseDirection.y;
+    float z0 = (node.boundsMin[2] - origin.z) * inverseDirection.z;
+    float z1 = (node.boundsMax[2] - origin.z) * inverseDirection.z;
+    float entry = max(max(min(x0, x1), min(y0, y1)), max(min(z0, z1), 0.0f));
+    float exit = min(min(max(x0, x1), max(y0, y1)), min(max(z0, z1), maxDistance));
+    entryDistance = entry;
+    return entry <= exit * boxDistanceSlack;
+}
+
+bool BVH::closestHit(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const
+{
+    float entry;
+    glm::vec3 inverseDirection = inverseRayDirection(direction);
+    if(nodes.empty() || !intersectNode(nodes[0], origin, inverseDirection, maxDistance, entry))
+    {
+        return false;
+    }
+
+    // NOTE: Of two children the ray hits, the nearer one is visited first and the other goes on
+    //       the stack with how far away it is, so it can be skipped if something closer turns up
+    //       in the meantime. The stack only ever holds one node per level
+    int stack[BVH_MAX_DEPTH];
+    float stackDistances[BVH_MAX_DEPTH];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    float closest = maxDistance;
+    int closestTriangle = -1;
+    float closestU = 0.0f, closestV = 0.0f;
+    while(true)
+    {
+        const BVHNode& node = nodes[nodeIndex];
+        if(node.triangleCount > 0)
+        {
+            for(int i=node.first; i<node.first + node.triangleCount; i++)
+            {
+                const Triangle& triangle = triangles[i];
+                float distance, u, v;
+                if(intersectTriangle(origin, direction, triangle.corner, triangle.edge1, triangle.edge2,
+                                     distance, u, v) && (distance >= 0.0f) && (distance < closest))
+                {
+                    closest = distance;
+                    closestTriangle = i;
+                    closestU = u;
+                    closestV = v;
+                }
+            }
+        }
+        else
+        {
+            float leftEntry, rightEntry;
+            bool hitLeft = intersectNode(nodes[node.first], origin, inverseDirection, closest, leftEntry);
+            bool hitRight = intersectNode(nodes[node.first + 1], origin, inverseDirection, closest, rightEntry);
+            if(hitLeft && hitRight)
+            {
+                bool leftFirst = (leftEntry <= rightEntry);
+                stack[stackSize] = leftFirst ? node.first + 1 : node.first;
+                stackDistances[stackSize] = leftFirst ? rightEntry : leftEntry;
+                stackSize++;
+                nodeIndex = leftFirst ? node.first : node.first + 1;
+                continue;
+            }
+            if(hitLeft || hitRight)
+            {
+                nodeIndex = hitLeft ? node.first : node.first + 1;
+                continue;
+            }
+        }
+
+        while((stackSize > 0) && (stackDistances[stackSize - 1] > closest * boxDistanceSlack))
+        {
+            stackSize--;
+        }
+        if(stackSize == 0)
+        {
+            break;
+        }
+        nodeIndex = stack[--stackSize];
+    }
+
+    if(closestTriangle < 0)
+    {
+        return false;
+    }
+    hit.triangle = triangleIds[closestTriangle];
+    hit.distance = closest;
+    hit.u = closestU;
+    hit.v = closestV;
+    return true;
+}
+
+bool BVH::anyHit(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+{
+    float entry;
+    glm::vec3 inverseDirection = inverseRayDirection(direction);
+    if(nodes.empty() || !intersectNode(nodes[0], origin, inverseDirection, maxDistance, entry))
+    {
+        return false;
+    }
+
+    int stack[BVH_MAX_DEPTH];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    while(true)
+    {
+        const BVHNode& node = nodes[nodeIndex];
+        if(node.triangleCount > 0)
+        {
+            for(int i=node.first; i<node.first + node.triangleCount; i++)
+            {
+                const Triangle& triangle = triangles[i];
+                float distance, u, v;
+                if(intersectTriangle(origin, direction, triangle.corner, triangle.edge1, triangle.edge2,
+                                     distance, u, v) && (distance >= 0.0f) && (distance < maxDistance))
+                {
+                    return true;
+                }
+            }
+        }
+        else
+        {
+            float leftEntry, rightEntry;
+            bool hitLeft = intersectNode(nodes[node.first], origin, inverseDirection, maxDistance, leftEntry);
+            bool hitRight = intersectNode(nodes[node.first + 1], origin, inverseDirection, maxDistance, rightEntry);
+            if(hitLeft && hitRight)
+            {
+                stack[stackSize++] = node.first + 1;
+            }
+            if(hitLeft || hitRight)
+            {
+                nodeIndex = hitLeft ? node.first : node.first + 1;
+                continue;
+            }
+        }
+
+        if(stackSize == 0)
+        {
+            break;
+        }
+        nodeIndex = stack[--stackSize];
+    }
+    return false;
+}
+
+// Tests the ray against the 4 boxes of a wide node at once, returning which slots it gets into
+// before maxDistance as a bit mask, and how far along it does in entryDistances
+static int intersectWideNode(const BVH4Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection,
+                             float maxDistance, float* entryDistances)
+{
+#if GLM_ARCH & GLM_ARCH_SSE2
+    __m128 originX = _mm_set1_ps(origin.x);
+    __m128 originY = _mm_set1_ps(origin.y);
+    __m128 originZ = _mm_set1_ps(origin.z);
+    __m128 inverseX = _mm_set1_ps(inverseDirection.x);
+    __m128 inverseY = _mm_set1_ps(inverseDirection.y);
+    __m128 inverseZ = _mm_set1_ps(inverseDirection.z);
+    __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMinX), originX), inverseX);
+    __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMaxX), originX), inverseX);
+    __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMinY), originY), inverseY);
+    __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMaxY), originY), inverseY);
+    __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMinZ), originZ), inverseZ);
+    __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.boundsMaxZ), originZ), inverseZ);
+    __m128 entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+                              _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+    __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+                             _mm_min_ps(_mm_max_ps(z0, z1), _mm_set1_ps(maxDistance)));
+    _mm_storeu_ps(entryDistances, entry);
+    __m128 hit = _mm_cmple_ps(entry, _mm_mul_ps(exit, _mm_set1_ps(boxDistanceSlack)));
+    __m128i used = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)node.triangleCount), _mm_set1_epi32(-1));
+    return _mm_movemask_ps(_mm_and_ps(hit, _mm_castsi128_ps(used)));
+#else
+    int hitMask = 0;
+    for(int slot=0; slot<4; slot++)
+    {
+        BVHNode child = { { node.boundsMinX[slot], node.boundsMinY[slot], node.boundsMinZ[slot] }, 0,
+                          { node.boundsMaxX[slot], node.boundsMaxY[slot], node.boundsMaxZ[slot] }, 0 };
+        if((node.triangleCount[slot] >= 0) &&
+           intersectNode(child, origin, inverseDirection, maxDistance, entryDistances[slot]))
+        {
+            hitMask |= 1 << slot;
+        }
+    }
+    return hitMask;
+#endif
+}
+
+// NOTE: A wide node pushes every child the ray hits, the farthest first so that the nearest comes
+//       off the stack next, which is at most 3 more entries per level
+static const int wideStackSize = 3 * BVH_MAX_DEPTH + 1;
+
+bool BVH::closestHitWide(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const
+{
+    if(wideNodes.empty())
+    {
+        return false;
+    }
+    glm::vec3 inverseDirection = inverseRayDirection(direction);
+
+    // Each entry is either a wide node (with a triangle count of 0) or a leaf's triangles
+    int stackFirst[wideStackSize];
+    int stackTriangleCounts[wideStackSize];
+    float stackDistances[wideStackSize];
+    stackFirst[0] = 0;
+    stackTriangleCounts[0] = 0;
+    stackDistances[0] = 0.0f;
+    int stackSize = 1;
+    float closest = maxDistance;
+    int closestTriangle = -1;
+    float closestU = 0.0f, closestV = 0.0f;
+    while(stackSize > 0)
+    {
+        stackSize--;
+        if(stackDistances[stackSize] > closest * boxDistanceSlack)
+        {
+            continue;
+        }
+        int first = stackFirst[stackSize];
+        int triangleCount = stackTriangleCounts[stackSize];
+        if(triangleCount > 0)
+        {
+            for(int i=first; i<first + triangleCount; i++)
+            {
+                const Triangle& triangle = triangles[i];
+                float distance, u, v;
+                if(intersectTriangle(origin, direction, triangle.corner, triangle.edge1, triangle.edge2,
+                                     distance, u, v) && (distance >= 0.0f) && (distance < closest))
+                {
+                    closest = distance;
+                    closestTriangle = i;
+                    closestU = u;
+                    closestV = v;
+                }
+            }
+            continue;
+        }
+
+        const BVH4Node& node = wideNodes[first];
+        float entryDistances[4];
+        int hitMask = intersectWideNode(node, origin, inverseDirection, closest, entryDistances);
+        int order[4];
+        int hitCount = 0;
+        for(int slot=0; slot<4; slot++)
+        {
+            if(hitMask & (1 << slot))
+            {
+                int position = hitCount++;
+                while((position > 0) && (entryDistances[order[position - 1]] < entryDistances[slot]))
+                {
+                    order[position] = order[position - 1];
+                    position--;
+                }
+                order[position] = slot;
+            }
+        }
+        for(int i=0; i<hitCount; i++)
+        {
+            stackFirst[stackSize] = node.first[order[i]];
+            stackTriangleCounts[stackSize] = node.triangleCount[order[i]];
+            stackDistances[stackSize] = entryDistances[order[i]];
+            stackSize++;
+        }
+    }
+
+    if(closestTriangle < 0)
+    {
+        return false;
+    }
+    hit.triangle = triangleIds[closestTriangle];
+    hit.distance = closest;
+    hit.u = closestU;
+    hit.v = closestV;
+    return true;
+}
+
+bool BVH::anyHitWide(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+{
+    if(wideNodes.empty())
+    {
+        return false;
+    }
+    glm::vec3 inverseDirection = inverseRayDirection(direction);
+
+    int stackFirst[wideStackSize];
+    int stackTriangleCounts[wideStackSize];
+    stackFirst[0] = 0;
+    stackTriangleCounts[0] = 0;
+    int stackSize = 1;
+    while(stackSize > 0)
+    {
+        stackSize--;
+        int first = stackFirst[stackSize];
+        int triangleCount = stackTriangleCounts[stackSize];
+        if(triangleCount > 0)
+        {
+            for(int i=first; i<first + triangleCount; i++)
+            {
+                const Triangle& triangle = triangles[i];
+                float distance, u, v;
+                if(intersectTriangle(origin, direction, triangle.corner, triangle.edge1, triangle.edge2,
+                                     distance, u, v) && (distance >= 0.0f) && (distance < maxDistance))
+                {
+                    return true;
+                }
+            }
+            continue;
+        }
+
+        const BVH4Node& node = wideNodes[first];
+        float entryDistances[4];
+        int hitMask = intersectWideNode(node, origin, inverseDirection, maxDistance, entryDistances);
+        for(int slot=0; slot<4; slot++)
+        {
+            if(hitMask & (1 << slot))
+            {
+                stackFirst[stackSize] = node.first[slot];
+                stackTriangleCounts[stackSize] = node.triangleCount[slot];
+                stackSize++;
+            }
+        }
+    }
+    return false;
+}
+
+#if GLM_ARCH & GLM_ARCH_SSE2
+// A packet of rays with each coordinate in its own register, lane i being ray i
+struct PacketRays
+{
+    __m128 originX, originY, originZ;
+    __m128 directionX, directionY, directionZ;
+    __m128 inverseX, inverseY, inverseZ;
+};
+
+static PacketRays loadPacketRays(const RayPacket& packet)
+{
+    float inverse[3][4];
+    for(int lane=0; lane<4; lane++)
+    {
+        glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+        glm::vec3 inverseDirection = inverseRayDirection(direction);
+        inverse[0][lane] = inverseDirection.x;
+        inverse[1][lane] = inverseDirection.y;
+        inverse[2][lane] = inverseDirection.z;
+    }
+    PacketRays rays;
+    rays.originX = _mm_loadu_ps(packet.originX);
+    rays.originY = _mm_loadu_ps(packet.originY);
+    rays.originZ = _mm_loadu_ps(packet.originZ);
+    rays.directionX = _mm_loadu_ps(packet.directionX);
+    rays.directionY = _mm_loadu_ps(packet.directionY);
+    rays.directionZ = _mm_loadu_ps(packet.directionZ);
+    rays.inverseX = _mm_loadu_ps(inverse[0]);
+    rays.inverseY = _mm_loadu_ps(inverse[1]);
+    rays.inverseZ = _mm_loadu_ps(inverse[2]);
+    return rays;
+}
+
+static __m128 selectLanes(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Which lanes get into the node's box before their maxDistance, as a mask
+static __m128 intersectNodePacket(const BVHNode& node, const PacketRays& rays, __m128 maxDistance)
+{
+    __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[0]), rays.originX), rays.inverseX);
+    __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[0]), rays.originX), rays.inverseX);
+    __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[1]), rays.originY), rays.inverseY);
+    __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[1]), rays.originY), rays.inverseY);
+    __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin[2]), rays.originZ), rays.inverseZ);
+    __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax[2]), rays.originZ), rays.inverseZ);
+    __m128 entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)),
+                              _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+    __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)),
+                             _mm_min_ps(_mm_max_ps(z0, z1), maxDistance));
+    return _mm_cmple_ps(entry, _mm_mul_ps(exit, _mm_set1_ps(boxDistanceSlack)));
+}
+
+// intersectTriangle for the 4 rays of a packet, written out with intrinsics (glm's dot and cross
+// in the same order), returning which lanes go through the triangle as a mask
+static __m128 intersectTrianglePacket(const PacketRays& rays, const glm::vec3& corner, const glm::vec3& edge1,
+                                      const glm::vec3& edge2, __m128& distance, __m128& u, __m128& v)
+{
+    __m128 edge1X = _mm_set1_ps(edge1.x);
+    __m128 edge1Y = _mm_set1_ps(edge1.y);
+    __m128 edge1Z = _mm_set1_ps(edge1.z);
+    __m128 edge2X = _mm_set1_ps(edge2.x);
+    __m128 edge2Y = _mm_set1_ps(edge2.y);
+    __m128 edge2Z = _mm_set1_ps(edge2.z);
+    __m128 pX = _mm_sub_ps(_mm_mul_ps(rays.directionY, edge2Z), _mm_mul_ps(edge2Y, rays.directionZ));
+    __m128 pY = _mm_sub_ps(_mm_mul_ps(rays.directionZ, edge2X), _mm_mul_ps(edge2Z, rays.directionX));
+    __m128 pZ = _mm_sub_ps(_mm_mul_ps(rays.directionX, edge2Y), _mm_mul_ps(edge2X, rays.directionY));
+    __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, pX), _mm_mul_ps(edge1Y, pY)), _mm_mul_ps(edge1Z, pZ));
+    __m128 inverseDeterminant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+    __m128 sX = _mm_sub_ps(rays.originX, _mm_set1_ps(corner.x));
+    __m128 sY = _mm_sub_ps(rays.originY, _mm_set1_ps(corner.y));
+    __m128 sZ = _mm_sub_ps(rays.originZ, _mm_set1_ps(corner.z));
+    u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sX, pX), _mm_mul_ps(sY, pY)), _mm_mul_ps(sZ, pZ)),
+                   inverseDeterminant);
+    __m128 qX = _mm_sub_ps(_mm_mul_ps(sY, edge1Z), _mm_mul_ps(edge1Y, sZ));
+    __m128 qY = _mm_sub_ps(_mm_mul_ps(sZ, edge1X), _mm_mul_ps(edge1Z, sX));
+    __m128 qZ = _mm_sub_ps(_mm_mul_ps(sX, edge1Y), _mm_mul_ps(edge1X, sY));
+    v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rays.directionX, qX), _mm_mul_ps(rays.directionY, qY)),
+                              _mm_mul_ps(rays.directionZ, qZ)),
+                   inverseDeterminant);
+    distance = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2X, qX), _mm_mul_ps(edge2Y, qY)), _mm_mul_ps(edge2Z, qZ)),
+                          inverseDeterminant);
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    return _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmple_ps(u, one)),
+                      _mm_and_ps(_mm_cmpge_ps(v, zero), _mm_cmple_ps(_mm_add_ps(u, v), one)));
+}
+#endif
+
+int BVH::closestHitPacket(const RayPacket& packet, RayHit* hits) const
+{
+#if GLM_ARCH & GLM_ARCH_SSE2
+    __m128 zero = _mm_setzero_ps();
+    __m128 closest = _mm_loadu_ps(packet.maxDistance);
+    __m128 active = _mm_cmpgt_ps(closest, zero);
+    if(nodes.empty() || (_mm_movemask_ps(active) == 0))
+    {
+        return 0;
+    }
+    PacketRays rays = loadPacketRays(packet);
+    __m128 found = zero;
+    __m128 closestU = zero;
+    __m128 closestV = zero;
+    __m128 closestTriangle = zero;
+
+    // NOTE: Nodes are tested when they come off the stack, against each lane's closest hit so
+    //       far. Of two children, the packet goes into the one nearer to the first lane that
+    //       hit their parent first, going by which way that ray points along the axis their
+    //       centers are furthest apart on
+    int stack[BVH_MAX_DEPTH];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    while(true)
+    {
+        const BVHNode& node = nodes[nodeIndex];
+        __m128 hitNode = _mm_and_ps(intersectNodePacket(node, rays, closest), active);
+        int nodeMask = _mm_movemask_ps(hitNode);
+        if((nodeMask != 0) && (node.triangleCount > 0))
+        {
+            for(int i=node.first; i<node.first + node.triangleCount; i++)
+            {
+                const Triangle& triangle = triangles[i];
+                __m128 distance, u, v;
+                __m128 hit = intersectTrianglePacket(rays, triangle.corner, triangle.edge1, triangle.edge2,
+                                                     distance, u, v);
+                hit = _mm_and_ps(_mm_and_ps(hit, hitNode),
+                                 _mm_and_ps(_mm_cmpge_ps(distance, zero), _mm_cmplt_ps(distance, closest)));
+                if(_mm_movemask_ps(hit) != 0)
+                {
+                    closest = selectLanes(hit, distance, closest);
+                    closestU = selectLanes(hit, u, closestU);
+                    closestV = selectLanes(hit, v, closestV);
+                    closestTriangle = selectLanes(hit, _mm_castsi128_ps(_mm_set1_epi32(i)), closestTriangle);
+                    found = _mm_or_ps(found, hit);
+                }
+            }
+        }
+        else if(nodeMask != 0)
+        {
+            const BVHNode& left = nodes[node.first];
+            const BVHNode& right = nodes[node.first + 1];
+            int axis = 0;
+            float separation = -1.0f;
+            for(int i=0; i<3; i++)
+            {
+                float axisSeparation = fabsf((left.boundsMin[i] + left.boundsMax[i]) - (right.boundsMin[i] + right.boundsMax[i]));
+                if(axisSeparation > separation)
+                {
+                    axis = i;
+                    separation = axisSeparation;
+                }
+            }
+            int lane = 0;
+            while(!(nodeMask & (1 << lane)))
+            {
+                lane++;
+            }
+            const float* directions[] = { packet.directionX, packet.directionY, packet.directionZ };
+            bool leftIsLower = (left.boundsMin[axis] + left.boundsMax[axis]) <= (right.boundsMin[axis] + right.boundsMax[axis]);
+            bool leftFirst = (leftIsLower == (directions[axis][lane] >= 0.0f));
+            stack[stackSize++] = leftFirst ? node.first + 1 : node.first;
+            nodeIndex = leftFirst ? node.first : node.first + 1;
+            continue;
+        }
+
+        if(stackSize == 0)
+        {
+            break;
+        }
+        nodeIndex = stack[--stackSize];
+    }
+
+    int foundMask = _mm_movemask_ps(found);
+    float distances[4], us[4], vs[4];
+    int closestTriangles[4];
+    _mm_storeu_ps(distances, closest);
+    _mm_storeu_ps(us, closestU);
+    _mm_storeu_ps(vs, closestV);
+    _mm_storeu_si128((__m128i*)closestTriangles, _mm_castps_si128(closestTriangle));
+    for(int lane=0; lane<4; lane++)
+    {
+        if(foundMask & (1 << lane))
+        {
+            hits[lane].triangle = triangleIds[closestTriangles[lane]];
+            hits[lane].distance = distances[lane];
+            hits[lane].u = us[lane];
+            hits[lane].v = vs[lane];
+        }
+    }
+    return foundMask;
+#else
+    int foundMask = 0;
+    for(int lane=0; lane<4; lane++)
+    {
+        glm::vec3 origin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+        glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+        if(closestHit(origin, direction, packet.maxDistance[lane], hits[lane]))
+        {
+            foundMask |= 1 << lane;
+        }
+    }
+    return foundMask;
+#endif
+}
+
+int BVH::anyHitPacket(const RayPacket& packet) const
+{
+#if GLM_ARCH & GLM_ARCH_SSE2
+    __m128 zero = _mm_setzero_ps();
+    __m128 maxDistance = _mm_loadu_ps(packet.maxDistance);
+    __m128 active = _mm_cmpgt_ps(maxDistance, zero);
+    if(nodes.empty() || (_mm_movemask_ps(active) == 0))
+    {
+        return 0;
+    }
+    PacketRays rays = loadPacketRays(packet);
+    __m128 found = zero;
+
+    // Lanes drop out as soon as they hit something, and the packet stops once they all have
+    int stack[BVH_MAX_DEPTH];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    while(true)
+    {
+        const BVHNode& node = nodes[nodeIndex];
+        __m128 hitNode = _mm_and_ps(intersectNodePacket(node, rays, maxDistance), active);
+        if((_mm_movemask_ps(hitNode) != 0) && (node.triangleCount > 0))
+        {
+            for(int i=node.first; i<node.first + node.triangleCount; i++)
+            {
+                const Triangle& triangle = triangles[i];
+                __m128 distance, u, v;
+                __m128 hit = intersectTrianglePacket(rays, triangle.corner, triangle.edge1, triangle.edge2,
+                                                     distance, u, v);
+                hit = _mm_and_ps(_mm_and_ps(hit, hitNode),
+                                 _mm_and_ps(_mm_cmpge_ps(distance, zero), _mm_cmplt_ps(distance, maxDistance)));
+                found = _mm_or_ps(found, hit);
+                active = _mm_andnot_ps(hit, active);
+                hitNode = _mm_andnot_ps(hit, hitNode);
+            }
+            if(_mm_movemask_ps(active) == 0)
+            {
+                break;
+            }
+        }
+        else if(_mm_movemask_ps(hitNode) != 0)
+        {
+            stack[stackSize++] = node.first + 1;
+            nodeIndex = node.first;
+            continue;
+        }
+
+        if(stackSize == 0)
+        {
+            break;
+        }
+        nodeIndex = stack[--stackSize];
+    }
+    return _mm_movemask_ps(found);
+#else
+    int foundMask = 0;
+    for(int lane=0; lane<4; lane++)
+    {
+        glm::vec3 origin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+        glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+        if(anyHit(origin, direction, packet.maxDistance[lane]))
+        {
+            foundMask |= 1 << lane;
+        }
+    }
+    return foundMask;
+#endif
+}
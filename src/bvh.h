@@ -0,0 +1,159 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "glm/glm.hpp"
+#include "radixsort.h"
+
+class ThreadPool;
+
+// Leaves get split until they have at most this many triangles, unless splitting them doesn't pay
+// off first. The tree never gets deeper than BVH_MAX_DEPTH, which is also how big the traversal
+// stack is
+#define BVH_MAX_LEAF_TRIANGLES 8
+#define BVH_MAX_DEPTH 64
+
+// One node of the tree, 32 bytes so that two fit in a cache line. The nodes are one flat array
+// with the root first. An interior node's two children are next to each other, at first and
+// first + 1, and a leaf (triangleCount > 0) has the triangleCount triangles from first on in the
+// tree's triangle order
+struct BVHNode
+{
+    float boundsMin[3];
+    int first;
+    float boundsMax[3];
+    int triangleCount;
+};
+
+// A node of the 4 wide version of the tree, which has the same leaves but only about every other
+// level of interior nodes, so that a ray can be tested against 4 boxes at once. The boxes are
+// stored by axis so that they load straight into SIMD registers. 128 bytes, two cache lines
+struct BVH4Node
+{
+    float boundsMinX[4];
+    float boundsMaxX[4];
+    float boundsMinY[4];
+    float boundsMaxY[4];
+    float boundsMinZ[4];
+    float boundsMaxZ[4];
+    int first[4];         // The child's index in the wide nodes, or its first triangle for a leaf
+    int triangleCount[4]; // 0 for a child node, -1 for an empty slot
+};
+
+// Up to 4 rays to cast together (see BVH::closestHitPacket), lane i being ray i. Lanes with a
+// maxDistance of 0 (or less) are left out
+struct RayPacket
+{
+    float originX[4];
+    float originY[4];
+    float originZ[4];
+    float directionX[4];
+    float directionY[4];
+    float directionZ[4];
+    float maxDistance[4];
+};
+
+struct RayHit
+{
+    int triangle;   // Which triangle of the index buffer was hit (its indices start at 3 * triangle)
+    float distance; // How far along the ray, in lengths of its direction
+    float u, v;     // Where on the triangle, the hit point is v0 + u * (v1 - v0) + v * (v2 - v0)
+};
+
+// A bounding volume hierarchy over the triangles of a mesh, for casting rays at it (eg. picking
+// the triangle under the mouse). Rays hit triangles from either side, and only count at distances
+// from 0 to just short of maxDistance.
+//
+// NOTE: Nodes are split where the surface area heuristic says it's cheapest, trying 16 evenly
+//       spaced planes on each axis (the binned SAH from Wald's "On fast Construction of SAH-based
+//       Bounding Volume Hierarchies"). The top of the tree is built first, and the subtrees below
+//       it are then built in parallel and appended to the node array.
+//
+//       Besides one ray at a time, rays can also go through the 4 wide version of the tree (one ray
+//       against 4 boxes at once) or through the binary tree as packets of 4 (4 rays against one
+//       box or triangle at once), both with SSE2 when GLM_ARCH has it. The wide version pays off
+//       for rays going every which way, packets for coherent ones, like neighbouring pixels.
+//       They all get exactly the same hit distances, since the triangle tests are the same
+//       operations in the same order.
+class BVH
+{
+public:
+    // Builds the tree (and its 4 wide version) over indexCount indices (a triangle list) into
+    // positions (3 floats per vertex), replacing any built before. The tree keeps its own copy of
+    // the triangles, so it doesn't need the mesh afterwards. threadCount 0 means one thread per
+    // hardware thread
+    void build(const unsigned int* indices, int indexCount, const float* positions, int threadCount=0);
+
+    // Builds the tree from the order of the triangles' centroids along a Morton curve instead (a
+    // linear BVH, as in Lauterbach et al.'s "Fast BVH Construction on GPUs"). That's several times
+    // faster than build, but the tree is slower to trace, so it's for meshes that change every
+    // frame rather than ones that get built once
+    void buildLinear(const unsigned int* indices, int indexCount, const float* positions, int threadCount=0);
+
+    // Puts back a tree built before (eg. one from the mesh cache) from its nodes and triangle
+    // order (see nodeArray and triangleIdArray), over the same mesh it was built for. That only
+    // copies the triangles and builds the 4 wide version, which is much quicker than building the
+    // tree. Returns false, leaving the tree empty, if they don't make a valid tree over the mesh
+    bool restore(const BVHNode* treeNodes, int nodeCount, const int* ids, const unsigned int* indices,
+                 int indexCount, const float* positions, int threadCount=0);
+    void clear();
+
+    bool empty() const;
+    int nodeCount() const;
+    int depth() const;
+    const std::vector<BVHNode>& nodeArray() const;
+    const std::vector<BVH4Node>& wideNodeArray() const;
+    const std::vector<int>& triangleIdArray() const;
+
+    // The nearest triangle along the ray, if there is one
+    bool closestHit(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+
+    // Whether the ray hits anything at all, which can stop at the first triangle it finds (eg. for
+    // shadow rays)
+    bool anyHit(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
+
+    // The same queries through the 4 wide tree
+    bool closestHitWide(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RayHit& hit) const;
+    bool anyHitWide(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
+
+    // The same queries for a packet of rays. They return which lanes hit something as a bit mask
+    // (bit i for lane i), and closestHitPacket also fills in hits[i] for those lanes
+    int closestHitPacket(const RayPacket& packet, RayHit* hits) const;
+    int anyHitPacket(const RayPacket& packet) const;
+
+private:
+    // A triangle as the intersection test wants it, its first corner and the two edges from it
+    struct Triangle
+    {
+        glm::vec3 corner;
+        glm::vec3 edge1;
+        glm::vec3 edge2;
+    };
+
+    // Fills in triangles from the mesh, in the order of triangleIds
+    void copyTriangles(ThreadPool& pool, const unsigned int* indices, const float* positions);
+
+    // Builds the wide node for the subtree under nodes[node], and those below it, returning its index
+    int collapseNode(int node);
+
+    std::vector<BVHNode> nodes;
+    std::vector<BVH4Node> wideNodes;
+
+    // The triangles in the order the leaves refer to them, and which triangle of the index buffer
+    // each one is
+    std::vector<Triangle> triangles;
+    std::vector<int> triangleIds;
+    int treeDepth = 0;
+
+    // Kept between builds (clear leaves it alone), so that rebuilding every frame with
+    // buildLinear doesn't allocate its sort buffers every time
+    RadixSorter mortonSorter;
+};
+
+// The Moller-Trumbore ray/triangle test the tree uses, hitting either side. This doesn't check
+// distance at all, only that the ray's line goes through the triangle. Brute force checks should
+// use this so that they get exactly the same answers as the tree
+bool intersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& corner,
+                       const glm::vec3& edge1, const glm::vec3& edge2, float& distance, float& u, float& v);
+
+#endif
@@ -2,26 +2,45 @@
 #include <fstream>
 #include <string>
 #include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
 #include <math.h>
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+#include <chrono>
 
 using namespace std;
 float radians;
 #include "geometry.h"
+#include "mappedfile.h"
+#include "objscanner.h"
+#include "threadpool.h"
+#include "triangulate.h"
+#include "tangents.h"
+#include "meshoptimize.h"
+#include "simplify.h"
 #include "SDL.h"
 //#include "glm/glm.hpp"
 
 // NOTE: The WaveFront OBJ format spec, states that meshes are allowed to be defined by faces
-//       consisting of 3 or more vertices. For the purposes of this loader (and since this is the
-//       most common case) we only support triangle faces (defined by exactly 3 vertices) and as a
-//       result, the loader will ignore any data after the third vertex for each face
+//       consisting of 3 or more vertices. Since our rendering only deals with triangles, faces with
+//       more than 3 vertices are triangulated as they are parsed (see triangulateOBJFace)
 //
 //       Similarly, the spec allows for vertex positions and texture coordinates to both have a
-//       w-coordinate. The loader will ignore these and assumes that all vertex specifications contain
-//       exactly 3 values, and that all texture coordinate specifications contain exactly 2 values
+//       w-coordinate, and some exporters write a vertex color after the position. The loader
+//       accepts but ignores these, and only keeps the first 3 values of a vertex and the first 2 of
+//       a texture coordinate.
+//
+//       Negative indices in faces count back from the most recent record of their kind (see
+//       objResolveIndex), and a line ending in a '\' continues on the next line. Continued lines
+//       are rare, so the mapped loaders only check the end of each line for one and take a slower
+//       path that parses a joined up copy of the statement when they find one.
 
 
-// NOTE: There is currently no support for mtl material references or anything like that,
-//       just load whatever texture you want to use manually
+// NOTE: Materials come from the mtllib/usemtl statements. Faces are sorted by material as they are
+//       loaded so that each material is one contiguous range of indices (see MaterialRange).
+//       Object names, groups and smoothing groups (o, g and s) are accepted but have no effect on
+//       the loaded data, since materials are all the renderer cares about.
 
 enum OBJDataType
 {
@@ -33,18 +52,304 @@ enum OBJDataType
     COMMENT
 };
 
-void GeometryData::loadFromOBJFile(string filename)
+static unsigned int hashVertexKey(const VertexKey& key)
+{
+    unsigned int hash = (unsigned int)key.vertexIndex * 73856093u;
+    hash ^= (unsigned int)key.texCoordIndex * 19349663u;
+    hash ^= (unsigned int)key.normalIndex * 83492791u;
+
+    // NOTE: The vertex lookup table only uses the low bits, so mix the high bits down into them
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    return hash;
+}
+
+// The number of each kind of record in (part of) an OBJ file, used to size the arrays up front
+struct OBJRecordCounts
+{
+    size_t vertexCount = 0;
+    size_t texCoordCount = 0;
+    size_t normalCount = 0;
+    size_t triangleCount = 0;
+};
+
+// A quick pass over the lines in [p, end) that classifies them the same way parseOBJRange does,
+// without parsing any numbers. Faces are counted by their corners, since a face with n corners
+// becomes n - 2 triangles
+static void countOBJRecords(const char* p, const char* end, OBJRecordCounts& counts)
+{
+    while(p < end)
+    {
+        const char* lineEnd = objFindStatementEnd(p, end);
+        p = objSkipSpaces(p, lineEnd);
+        if((p + 1) < lineEnd)
+        {
+            if(p[0] == 'f')
+            {
+                size_t cornerCount = 0;
+                bool inCorner = false;
+                for(const char* c=p+1; c<lineEnd; c++)
+                {
+                    // NOTE: The '\' and '\n' of a continuation separate corners too
+                    bool isSpace = objIsSpace(*c) || (*c == '\\') || (*c == '\n');
+                    cornerCount += (!isSpace && !inCorner) ? 1 : 0;
+                    inCorner = !isSpace;
+                }
+                if(cornerCount >= 3)
+                {
+                    counts.triangleCount += cornerCount - 2;
+                }
+            }
+            else if(p[0] == 'v')
+            {
+                if((p[1] == ' ') || (p[1] == '\t'))
+                {
+                    counts.vertexCount++;
+                }
+                else if(p[1] == 't')
+                {
+                    counts.texCoordCount++;
+                }
+                else if(p[1] == 'n')
+                {
+                    counts.normalCount++;
+                }
+            }
+        }
+        p = lineEnd + 1;
+    }
+}
+
+// A polygon face whose triangulation has to wait until the positions it refers to are known
+struct DeferredOBJFace
+{
+    size_t faceOffset;
+    size_t firstCorner;
+    int cornerCount;
+};
+
+// The deferred faces from one chunk of a parallel load. Their corners all go in one array, rather
+// than an array per face, to save an allocation for every polygon
+struct DeferredOBJFaces
 {
+    vector<DeferredOBJFace> faces;
+    vector<VertexKey> corners;
+};
+
+// Appends the triangles for a parsed face to the faces array. positions holds the positions parsed
+// so far, starting from the one with index firstPosition. When deferredFaces is given and a polygon
+// refers to positions that aren't in there (ie. ones in another chunk of a parallel load), we make
+// room for its triangles but leave the triangulation until later
+static void addOBJFace(const vector<VertexKey>& corners, const vector<float>& positions,
+                       size_t firstPosition, vector<FaceData>& faces, DeferredOBJFaces* deferredFaces)
+{
+    int cornerCount = corners.size();
+    if(cornerCount < 3)
+    {
+        cout << "OBJ parse error: Faces need at least 3 vertices, ignoring" << endl;
+        return;
+    }
+
+    size_t faceOffset = faces.size();
+    faces.resize(faceOffset + cornerCount - 2);
+    if(deferredFaces && (cornerCount > 3))
+    {
+        for(int i=0; i<cornerCount; i++)
+        {
+            if((corners[i].vertexIndex < 0) || ((size_t)corners[i].vertexIndex < firstPosition) ||
+               (3*((size_t)corners[i].vertexIndex - firstPosition) + 2 >= positions.size()))
+            {
+                DeferredOBJFace deferred;
+                deferred.faceOffset = faceOffset;
+                deferred.firstCorner = deferredFaces->corners.size();
+                deferred.cornerCount = cornerCount;
+                deferredFaces->faces.push_back(deferred);
+                deferredFaces->corners.insert(deferredFaces->corners.end(), corners.begin(), corners.end());
+                return;
+            }
+        }
+    }
+    triangulateOBJFace(&corners[0], cornerCount, positions.data(), firstPosition,
+                       positions.size()/3, &faces[faceOffset]);
+}
+
+void GeometryData::loadFromOBJFile(string filename, OBJLoadMode mode, int threadCount)
+{
+    // Loading replaces whatever data we had before
+    clear();
+
+    MeshCacheKey cacheKey;
+    string cacheFilename = meshCacheFilename(filename);
+    bool cacheable = useMeshCache && getMeshCacheKey(filename, cacheKey);
+    if(cacheable && loadFromMeshCache(cacheFilename, cacheKey))
+    {
+        loadMaterialLibraries(filename);
+        cout << "Successfully loaded an OBJ with " << vertexCount() << " vertices and "
+             << indexCount()/3 << " triangles from " << cacheFilename << endl;
+        return;
+    }
+
     GeometryData tempGeom;
 
-    ifstream inStream;
-    inStream.open(filename, ifstream::in);
-    if(inStream.fail())
+    bool parsed;
+    if(mode == OBJ_LOAD_STREAM)
+    {
+        parsed = parseOBJStream(filename, tempGeom);
+    }
+    else
+    {
+        parsed = parseOBJMapped(filename, tempGeom, (mode == OBJ_LOAD_PARALLEL), threadCount);
+    }
+    if(!parsed)
     {
-        cout << "Unable to open obj file: " << filename << endl;
         return;
     }
 
+    buildFromOBJData(tempGeom);
+    loadMaterialLibraries(filename);
+
+    if(cacheable)
+    {
+        writeMeshCache(cacheFilename, cacheKey);
+    }
+}
+
+void GeometryData::setUseMeshCache(bool useCache)
+{
+    useMeshCache = useCache;
+}
+
+void GeometryData::clear()
+{
+    vertices.clear();
+    textureCoords.clear();
+    normals.clear();
+    tangents.clear();
+    indices.clear();
+    interleavedVertices.clear();
+    quantizedVertices.clear();
+    positionOffset = glm::vec3(0.0f);
+    positionScale = glm::vec3(1.0f);
+    faces.clear();
+    materials.clear();
+    ranges.clear();
+    materialLibraries.clear();
+    materialRuns.clear();
+    lods.clear();
+    clusters.clear();
+    clusterBounds.clear();
+    triangleBVH.clear();
+
+    meshCache.reset();
+    for(int stream=0; stream<MESH_STREAM_COUNT; stream++)
+    {
+        cachedStreams[stream] = NULL;
+    }
+    cachedVertexCount = 0;
+    cachedIndexCount = 0;
+}
+
+// Sits between the stream loader and the file, joining up lines that end in a '\' the same way
+// objJoinContinuedLines does, so that the stream loader never has to deal with continuations
+class OBJContinuationBuffer : public streambuf
+{
+public:
+    explicit OBJContinuationBuffer(streambuf* source)
+        : source(source), buffer(64*1024), heldCount(0)
+    {
+        setg(&buffer[0], &buffer[0], &buffer[0]);
+    }
+
+protected:
+    virtual int_type underflow()
+    {
+        while(gptr() == egptr())
+        {
+            // NOTE: The last character we handed out is kept at the front so it can be put back
+            char* data = &buffer[0];
+            size_t putbackCount = 0;
+            if(egptr() > eback())
+            {
+                data[0] = egptr()[-1];
+                putbackCount = 1;
+            }
+            memcpy(data + putbackCount, held, heldCount);
+            size_t length = putbackCount + heldCount;
+            heldCount = 0;
+
+            streamsize readCount = source->sgetn(data + length, buffer.size() - length);
+            length += readCount;
+            if(length == putbackCount)
+            {
+                return traits_type::eof();
+            }
+
+            // A '\' at the end of what we read might be followed by a line break in the next read,
+            // so it waits until then (unless this is the end of the file)
+            if(readCount > 0)
+            {
+                if((length - putbackCount >= 1) && (data[length-1] == '\\'))
+                {
+                    heldCount = 1;
+                }
+                else if((length - putbackCount >= 2) && (data[length-2] == '\\') && (data[length-1] == '\r'))
+                {
+                    heldCount = 2;
+                }
+                length -= heldCount;
+                memcpy(held, data + length, heldCount);
+            }
+
+            char* dataStart = data + putbackCount;
+            char* dataEnd = data + length;
+            char* out = dataEnd;
+            if(memchr(dataStart, '\\', dataEnd - dataStart))
+            {
+                out = dataStart;
+                for(const char* in=dataStart; in<dataEnd; in++)
+                {
+                    if((*in == '\\') && ((in + 1) < dataEnd) && (in[1] == '\n'))
+                    {
+                        in++;
+                        *out++ = ' ';
+                    }
+                    else if((*in == '\\') && ((in + 2) < dataEnd) && (in[1] == '\r') && (in[2] == '\n'))
+                    {
+                        in += 2;
+                        *out++ = ' ';
+                    }
+                    else
+                    {
+                        *out++ = *in;
+                    }
+                }
+            }
+            setg(data, dataStart, out);
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    streambuf* source;
+    vector<char> buffer;
+    char held[2];
+    size_t heldCount;
+};
+
+bool GeometryData::parseOBJStream(const string& filename, GeometryData& tempGeom)
+{
+    ifstream file;
+    file.open(filename, ifstream::in);
+    if(file.fail())
+    {
+        cout << "Unable to open obj file: " << filename << endl;
+        return false;
+    }
+    OBJContinuationBuffer joinedLines(file.rdbuf());
+    istream inStream(&joinedLines);
+
+    vector<VertexKey> faceCorners;
     OBJDataType currentDataType = NONE;
     while(!inStream.eof())
     {
@@ -69,8 +374,21 @@ void GeometryData::loadFromOBJFile(string filename)
             }
             else if(typeChar1 != 'v')
             {
-                cout << "OBJ parse error: Expected 'v', 'f' or '#' at the start of the line" << endl;
-                cout << "Found: " << typeChar1 << typeChar2 << endl;
+                // Any other statement is read as a whole line, and the newline has already gone
+                // if the statement was a single character
+                string line(1, typeChar1);
+                if(typeChar2 != '\n')
+                {
+                    string rest;
+                    getline(inStream, rest);
+                    line += typeChar2;
+                    line += rest;
+                }
+                if(!parseOBJStatement(line.data(), line.data() + line.size(), tempGeom))
+                {
+                    cout << "OBJ parse error: Expected 'v', 'f' or '#' at the start of the line" << endl;
+                    cout << "Found: " << typeChar1 << typeChar2 << endl;
+                }
             }
             else
             {
@@ -136,14 +454,28 @@ void GeometryData::loadFromOBJFile(string filename)
 
         case FACE:
         {
-            // NOTE: Here is where we assume that exactly 3 vertices are used to specify a face
+            // NOTE: Missing texture coord/normal indices carry over from the previous vertex
             int vertIndex = 0;
             int texCoordIndex = 0;
             int normalIndex = 0;
 
-            FaceData face = {};
-            for(int index=0; index<3; index++)
+            faceCorners.clear();
+            bool validPositions = true;
+            while(true)
             {
+                // operator>> would happily skip over the newline into the next line, so we need to
+                // check for the end of the face ourselves
+                int nextChar = inStream.peek();
+                while((nextChar == ' ') || (nextChar == '\t') || (nextChar == '\r'))
+                {
+                    inStream.get();
+                    nextChar = inStream.peek();
+                }
+                if((nextChar != '-') && (nextChar != '+') && !isdigit(nextChar))
+                {
+                    break;
+                }
+
                 inStream >> vertIndex;
                 char postVertexCheckChar = inStream.get();
                 if(postVertexCheckChar == '/')
@@ -165,13 +497,27 @@ void GeometryData::loadFromOBJFile(string filename)
                         inStream.unget(); // This is just to prevent us from consuming a newline
                     }
                 }
+                else
+                {
+                    inStream.unget();
+                }
 
-                // NOTE: We subtract 1 here because the OBJ format uses 1-based indices
-                face.vertexIndex[index] = vertIndex - 1;
-                face.texCoordIndex[index] = texCoordIndex - 1;
-                face.normalIndex[index] = normalIndex - 1;
+                // NOTE: The OBJ format uses 1-based indices, or negative ones relative to the end
+                VertexKey corner;
+                corner.vertexIndex = objResolveIndex(vertIndex, tempGeom.vertices.size()/3);
+                corner.texCoordIndex = objResolveIndex(texCoordIndex, tempGeom.textureCoords.size()/2);
+                corner.normalIndex = objResolveIndex(normalIndex, tempGeom.normals.size()/3);
+                faceCorners.push_back(corner);
+                validPositions = validPositions && (corner.vertexIndex >= 0);
+            }
+            if(!validPositions)
+            {
+                cout << "OBJ parse error: Face refers to a vertex that doesn't exist, ignoring" << endl;
+            }
+            else
+            {
+                addOBJFace(faceCorners, tempGeom.vertices, 0, tempGeom.faces, NULL);
             }
-            tempGeom.faces.push_back(face);
             currentDataType = COMMENT;
         } break;
 
@@ -189,132 +535,1066 @@ void GeometryData::loadFromOBJFile(string filename)
         }
     }
 
+    return true;
+}
 
-    // NOTE: Since our rendering pipeline supports only 1 set of indices for our data, we need to
-    //       do some post-processing here in order to lay out all the unique v/vt/vn triples
-    // TODO: We're currently just assuming all the triples are distinct, but its probably worth doing
-    //       at least a little bit of checking on that front
-    // TODO: We're deciding whether or not to add texture coords and normals on a per-face basis,
-    //       which doesn't really make sense because if there are any then there should be for all
-    //       vertices, but this way that might not be the case
-    for(int faceIndex=0; faceIndex<tempGeom.faces.size(); faceIndex++)
-    {
-        FaceData face = tempGeom.faces[faceIndex];
-        bool hasTextureCoords = (face.texCoordIndex[0] >= 0);
-        bool hasNormals = (face.normalIndex[0] >= 0);
-        for(int vertIndex=0; vertIndex<3; vertIndex++)
-        {
-            for(int i=0; i<3; i++)
+// NOTE: This mirrors the stream loader above record for record, but works on the raw bytes of a
+//       memory-mapped file. Unlike the stream loader, a line that we don't recognise is skipped as a
+//       whole rather than being re-read two characters at a time.
+bool GeometryData::parseOBJMapped(const string& filename, GeometryData& tempGeom,
+                                  bool parallel, int threadCount)
+{
+    MappedFile file;
+    if(!file.open(filename))
+    {
+        cout << "Unable to open obj file: " << filename << endl;
+        return false;
+    }
+
+    const char* fileStart = file.data();
+    const char* fileEnd = fileStart + file.size();
+    if(!parallel)
+    {
+        // NOTE: Counting the records first costs a lot less than parsing them, and means that each
+        //       array is allocated once at its final size instead of being regrown as it fills up
+        OBJRecordCounts counts;
+        countOBJRecords(fileStart, fileEnd, counts);
+        parseOBJRange(fileStart, fileEnd, tempGeom, NULL, counts, OBJRecordCounts());
+        return true;
+    }
+
+    // NOTE: We split the file into a few chunks per thread (so that a chunk that happens to be
+    //       all faces doesn't hold everyone else up), with each chunk boundary moved forward to the
+    //       start of the next statement so that no record is split between two chunks
+    ThreadPool pool(threadCount);
+    const size_t minChunkSize = 64*1024;
+    size_t chunkCount = 4*pool.threadCount();
+    if((file.size() / chunkCount) < minChunkSize)
+    {
+        chunkCount = (file.size() / minChunkSize) + 1;
+    }
+
+    vector<const char*> chunkStarts;
+    chunkStarts.push_back(fileStart);
+    for(size_t chunkIndex=1; chunkIndex<chunkCount; chunkIndex++)
+    {
+        const char* boundary = fileStart + (chunkIndex * file.size()) / chunkCount;
+        if(boundary < chunkStarts.back())
+        {
+            continue;
+        }
+        boundary = objFindLineEnd(boundary, fileEnd);
+        while((boundary < fileEnd) && objLineContinues(chunkStarts.back(), boundary))
+        {
+            boundary = objFindLineEnd(boundary + 1, fileEnd);
+        }
+        if(boundary == fileEnd)
+        {
+            break;
+        }
+        chunkStarts.push_back(boundary + 1);
+    }
+    chunkStarts.push_back(fileEnd);
+    chunkCount = chunkStarts.size() - 1;
+
+    // Negative indices count back from the records before them, which for a chunk includes all the
+    // records in the chunks before it. So each chunk is counted first, and a prefix sum over the
+    // counts gives the base that the chunk resolves its negative indices against.
+    vector<OBJRecordCounts> chunkCounts(chunkCount);
+    pool.parallelFor(chunkCount, [&](int chunkIndex)
+    {
+        countOBJRecords(chunkStarts[chunkIndex], chunkStarts[chunkIndex+1], chunkCounts[chunkIndex]);
+    });
+    vector<OBJRecordCounts> chunkBases(chunkCount);
+    for(size_t chunkIndex=1; chunkIndex<chunkCount; chunkIndex++)
+    {
+        const OBJRecordCounts& previousBase = chunkBases[chunkIndex-1];
+        const OBJRecordCounts& previousCounts = chunkCounts[chunkIndex-1];
+        chunkBases[chunkIndex].vertexCount = previousBase.vertexCount + previousCounts.vertexCount;
+        chunkBases[chunkIndex].texCoordCount = previousBase.texCoordCount + previousCounts.texCoordCount;
+        chunkBases[chunkIndex].normalCount = previousBase.normalCount + previousCounts.normalCount;
+    }
+
+    vector<GeometryData> chunks(chunkCount);
+    vector<DeferredOBJFaces> deferredFaces(chunkCount);
+    pool.parallelFor(chunkCount, [&](int chunkIndex)
+    {
+        parseOBJRange(chunkStarts[chunkIndex], chunkStarts[chunkIndex+1], chunks[chunkIndex],
+                      &deferredFaces[chunkIndex], chunkCounts[chunkIndex], chunkBases[chunkIndex]);
+    });
+
+    // Chunks are merged back in file order, so a prefix sum over the chunk sizes gives us where
+    // each one goes in the merged arrays. Every face index has already been resolved to an index
+    // into the whole file, so they don't need any fixing up. Polygon faces always turn into
+    // (corners - 2) triangles however we end up triangulating them, so even deferred ones take up
+    // a known number of faces.
+    vector<size_t> vertexOffsets(chunkCount+1, 0);
+    vector<size_t> texCoordOffsets(chunkCount+1, 0);
+    vector<size_t> normalOffsets(chunkCount+1, 0);
+    vector<size_t> faceOffsets(chunkCount+1, 0);
+    for(size_t chunkIndex=0; chunkIndex<chunkCount; chunkIndex++)
+    {
+        const GeometryData& chunk = chunks[chunkIndex];
+        vertexOffsets[chunkIndex+1] = vertexOffsets[chunkIndex] + chunk.vertices.size();
+        texCoordOffsets[chunkIndex+1] = texCoordOffsets[chunkIndex] + chunk.textureCoords.size();
+        normalOffsets[chunkIndex+1] = normalOffsets[chunkIndex] + chunk.normals.size();
+        faceOffsets[chunkIndex+1] = faceOffsets[chunkIndex] + chunk.faces.size();
+    }
+
+    // Each chunk has its own list of materials, so those are merged by name (in file order, which
+    // keeps them in order of first use) and every chunk's material runs are remapped to match
+    for(size_t chunkIndex=0; chunkIndex<chunkCount; chunkIndex++)
+    {
+        const GeometryData& chunk = chunks[chunkIndex];
+        vector<int> materialRemap(chunk.materials.size());
+        for(size_t material=0; material<chunk.materials.size(); material++)
+        {
+            size_t merged = 0;
+            while((merged < tempGeom.materials.size()) &&
+                  (tempGeom.materials[merged].name != chunk.materials[material].name))
             {
-                vertices.push_back(tempGeom.vertices[(3*face.vertexIndex[vertIndex])+i]);
+                merged++;
             }
-
-            if(hasTextureCoords)
+            if(merged == tempGeom.materials.size())
             {
-                for(int i=0; i<2; i++)
-                {
-                    textureCoords.push_back(
-                            tempGeom.textureCoords[(2*face.texCoordIndex[vertIndex])+i]);
-                }
+                tempGeom.materials.push_back(chunk.materials[material]);
             }
-            if(hasNormals)
+            materialRemap[material] = merged;
+        }
+        for(size_t library=0; library<chunk.materialLibraries.size(); library++)
+        {
+            vector<string>& libraries = tempGeom.materialLibraries;
+            if(find(libraries.begin(), libraries.end(), chunk.materialLibraries[library]) == libraries.end())
             {
-                for(int i=0; i<3; i++)
-                {
-                    normals.push_back(tempGeom.normals[(3*face.normalIndex[vertIndex])+i]);
-                }
+                libraries.push_back(chunk.materialLibraries[library]);
             }
         }
-
-        // Compute the (bi)tangent for the face, and add it for each vertex
-        if(hasTextureCoords && hasNormals)
-        {
-            int vertexStartIndex = vertices.size() - 9;
-            int uvStartIndex = textureCoords.size() - 6;
-            float* vertices = &this->vertices[vertexStartIndex];
-            float* texCoords = &textureCoords[uvStartIndex];
-
-            float deltaX1 = vertices[3] - vertices[0];
-            float deltaY1 = vertices[4] - vertices[1];
-            float deltaZ1 = vertices[5] - vertices[2];
-            float deltaX2 = vertices[6] - vertices[0];
-            float deltaY2 = vertices[7] - vertices[1];
-            float deltaZ2 = vertices[8] - vertices[2];
-
-            float deltaU1 = texCoords[2] - texCoords[0];
-            float deltaV1 = texCoords[3] - texCoords[1];
-            float deltaU2 = texCoords[4] - texCoords[0];
-            float deltaV2 = texCoords[5] - texCoords[1];
-
-            float inverseDet = 1.0f / (deltaU1*deltaV2 - deltaU2*deltaV1);
-
-            float tangentX = inverseDet * (deltaV2*deltaX1 - deltaV1*deltaX2);
-            float tangentY = inverseDet * (deltaV2*deltaY1 - deltaV1*deltaY2);
-            float tangentZ = inverseDet * (deltaV2*deltaZ1 - deltaV1*deltaZ2);
-
-            float bitangentX = inverseDet * (deltaU1*deltaX2 - deltaU2*deltaX1);
-            float bitangentY = inverseDet * (deltaU1*deltaY2 - deltaU2*deltaY1);
-            float bitangentZ = inverseDet * (deltaU1*deltaZ2 - deltaU2*deltaZ1);
-
-            float tangentLength = sqrt(tangentX*tangentX +
-                                       tangentY*tangentY +
-                                       tangentZ*tangentZ);
-            float bitangentLength = sqrt(bitangentX*bitangentX +
-                                         bitangentY*bitangentY +
-                                         bitangentZ*bitangentZ);
-
-            tangentX /= tangentLength;
-            tangentY /= tangentLength;
-            tangentZ /= tangentLength;
-            bitangentX /= bitangentLength;
-            bitangentY /= bitangentLength;
-            bitangentZ /= bitangentLength;
-
-            // NOTE: Each vertex in the face gets the same (bi)tangent pair
-            for(int vertIndex=0; vertIndex<3; vertIndex++)
+        for(size_t run=0; run<chunk.materialRuns.size(); run++)
+        {
+            OBJMaterialRun mergedRun;
+            mergedRun.firstFace = faceOffsets[chunkIndex] + chunk.materialRuns[run].firstFace;
+            mergedRun.material = materialRemap[chunk.materialRuns[run].material];
+            if(!tempGeom.materialRuns.empty() && (tempGeom.materialRuns.back().firstFace == mergedRun.firstFace))
             {
-                tangents.push_back(tangentX);
-                tangents.push_back(tangentY);
-                tangents.push_back(tangentZ);
-
-                bitangents.push_back(bitangentX);
-                bitangents.push_back(bitangentY);
-                bitangents.push_back(bitangentZ);
+                tempGeom.materialRuns.back() = mergedRun;
+            }
+            else
+            {
+                tempGeom.materialRuns.push_back(mergedRun);
             }
         }
     }
 
-    cout << "Successfully loaded an OBJ with " << vertices.size()/3 << " vertices " << endl;
-}
+    tempGeom.vertices.resize(vertexOffsets[chunkCount]);
+    tempGeom.textureCoords.resize(texCoordOffsets[chunkCount]);
+    tempGeom.normals.resize(normalOffsets[chunkCount]);
+    tempGeom.faces.resize(faceOffsets[chunkCount]);
+    pool.parallelFor(chunkCount, [&](int chunkIndex)
+    {
+        GeometryData& chunk = chunks[chunkIndex];
+        copy(chunk.vertices.begin(), chunk.vertices.end(),
+             tempGeom.vertices.begin() + vertexOffsets[chunkIndex]);
+        copy(chunk.textureCoords.begin(), chunk.textureCoords.end(),
+             tempGeom.textureCoords.begin() + texCoordOffsets[chunkIndex]);
+        copy(chunk.normals.begin(), chunk.normals.end(),
+             tempGeom.normals.begin() + normalOffsets[chunkIndex]);
+        copy(chunk.faces.begin(), chunk.faces.end(),
+             tempGeom.faces.begin() + faceOffsets[chunkIndex]);
 
-int GeometryData::vertexCount()
-{
-    return vertices.size()/3;
-}
+        // Free each chunk as soon as it has been merged to keep the peak memory down
+        chunk = GeometryData();
+    });
 
-void* GeometryData::vertexData()
-{
-    return (void*)&vertices[0];
-}
+    // Now that every position is known we can triangulate any polygons that referred to positions
+    // from other chunks
+    pool.parallelFor(chunkCount, [&](int chunkIndex)
+    {
+        const DeferredOBJFaces& chunkFaces = deferredFaces[chunkIndex];
+        for(size_t i=0; i<chunkFaces.faces.size(); i++)
+        {
+            const DeferredOBJFace& deferred = chunkFaces.faces[i];
+            triangulateOBJFace(&chunkFaces.corners[deferred.firstCorner], deferred.cornerCount,
+                               tempGeom.vertices.data(), 0, tempGeom.vertices.size()/3,
+                               &tempGeom.faces[faceOffsets[chunkIndex] + deferred.faceOffset]);
+        }
+    });
 
-void* GeometryData::textureCoordData()
-{
-    return (void*)&textureCoords[0];
+    return true;
 }
 
-void* GeometryData::normalData()
+// counts are the records in [p, end), which we use to size the arrays, and base is the number of
+// records that come before p in the file, which negative indices need
+void GeometryData::parseOBJRange(const char* p, const char* end, GeometryData& tempGeom,
+                                 DeferredOBJFaces* deferredFaces, const OBJRecordCounts& counts,
+                                 const OBJRecordCounts& base)
 {
-    return (void*)&normals[0];
-}
+    tempGeom.vertices.reserve(tempGeom.vertices.size() + 3*counts.vertexCount);
+    tempGeom.textureCoords.reserve(tempGeom.textureCoords.size() + 2*counts.texCoordCount);
+    tempGeom.normals.reserve(tempGeom.normals.size() + 3*counts.normalCount);
+    tempGeom.faces.reserve(tempGeom.faces.size() + counts.triangleCount);
 
-void* GeometryData::tangentData()
-{
-    return (void*)&tangents[0];
+    vector<VertexKey> faceCorners;
+    string joinedLine;
+    while(p < end)
+    {
+        const char* lineEnd = objFindLineEnd(p, end);
+        const char* nextLine = lineEnd + 1;
+        if(objLineContinues(p, lineEnd))
+        {
+            // Slow path: parse a copy of the statement with its continuation lines joined up
+            const char* statementEnd = objFindStatementEnd(p, end);
+            objJoinContinuedLines(p, statementEnd, joinedLine);
+            nextLine = statementEnd + 1;
+            p = joinedLine.data();
+            lineEnd = p + joinedLine.size();
+        }
+
+        p = objSkipSpaces(p, lineEnd);
+        if(p == lineEnd)
+        {
+            p = nextLine;
+            continue;
+        }
+        const char* lineStart = p;
+
+        char typeChar1 = p[0];
+        char typeChar2 = '\n';
+        if((p + 1) < lineEnd)
+        {
+            typeChar2 = p[1];
+            p++;
+        }
+        p++;
+
+        if(typeChar1 == '#')
+        {
+            // Comments are skipped along with the rest of the line below
+        }
+        else if(typeChar1 == 'f')
+        {
+            if(!objScanFaceCorners(p, lineEnd, faceCorners,
+                                   base.vertexCount + tempGeom.vertices.size()/3,
+                                   base.texCoordCount + tempGeom.textureCoords.size()/2,
+                                   base.normalCount + tempGeom.normals.size()/3))
+            {
+                cout << "OBJ parse error: Face refers to a vertex that doesn't exist, ignoring" << endl;
+            }
+            else
+            {
+                addOBJFace(faceCorners, tempGeom.vertices, base.vertexCount, tempGeom.faces, deferredFaces);
+            }
+        }
+        else if(typeChar1 != 'v')
+        {
+            if(!parseOBJStatement(lineStart, lineEnd, tempGeom))
+            {
+                cout << "OBJ parse error: Expected 'v', 'f' or '#' at the start of the line" << endl;
+                cout << "Found: " << typeChar1 << typeChar2 << endl;
+            }
+        }
+        else if((typeChar2 == ' ') || (typeChar2 == '\t'))
+        {
+            float x = 0.0f;
+            float y = 0.0f;
+            float z = 0.0f;
+            objScanFloat(p, lineEnd, x);
+            objScanFloat(p, lineEnd, y);
+            objScanFloat(p, lineEnd, z);
+            tempGeom.vertices.push_back(x);
+            tempGeom.vertices.push_back(y);
+            tempGeom.vertices.push_back(z);
+        }
+        else if(typeChar2 == 't')
+        {
+            float u = 0.0f;
+            float v = 0.0f;
+            objScanFloat(p, lineEnd, u);
+            objScanFloat(p, lineEnd, v);
+            tempGeom.textureCoords.push_back(u);
+            tempGeom.textureCoords.push_back(v);
+        }
+        else if(typeChar2 == 'n')
+        {
+            float x = 0.0f;
+            float y = 0.0f;
+            float z = 0.0f;
+            objScanFloat(p, lineEnd, x);
+            objScanFloat(p, lineEnd, y);
+            objScanFloat(p, lineEnd, z);
+            tempGeom.normals.push_back(x);
+            tempGeom.normals.push_back(y);
+            tempGeom.normals.push_back(z);
+        }
+        else if(typeChar2 == 'p')
+        {
+            cout << "OBJ parse error: Free-form geometry is not supported, ignoring" << endl;
+        }
+        else
+        {
+            cout << "Unsupported data entry v" << (char)typeChar2 << ", ignoring" << endl;
+        }
+
+        // Anything left on the line (eg. w-coordinates or vertex colors) is ignored
+        p = nextLine;
+    }
 }
 
-void* GeometryData::bitangentData()
+// Handles the statements that aren't vertex data or faces: materials, and the object/group names
+// that we accept but ignore. p is the start of the line. Returns false for anything else
+bool GeometryData::parseOBJStatement(const char* p, const char* lineEnd, GeometryData& tempGeom)
 {
-    return (void*)&bitangents[0];
+    const char* keywordEnd = p;
+    while((keywordEnd < lineEnd) && !objIsSpace(*keywordEnd))
+    {
+        keywordEnd++;
+    }
+    string keyword(p, keywordEnd);
+    p = objSkipSpaces(keywordEnd, lineEnd);
+
+    // NOTE: Material names may contain spaces, so they run to the end of the line
+    while((lineEnd > p) && objIsSpace(lineEnd[-1]))
+    {
+        lineEnd--;
+    }
+
+    if(keyword == "usemtl")
+    {
+        useOBJMaterial(string(p, lineEnd), tempGeom);
+    }
+    else if(keyword == "mtllib")
+    {
+        while(p < lineEnd)
+        {
+            const char* nameEnd = p;
+            while((nameEnd < lineEnd) && !objIsSpace(*nameEnd))
+            {
+                nameEnd++;
+            }
+            string library(p, nameEnd);
+            vector<string>& libraries = tempGeom.materialLibraries;
+            if(find(libraries.begin(), libraries.end(), library) == libraries.end())
+            {
+                libraries.push_back(library);
+            }
+            p = objSkipSpaces(nameEnd, lineEnd);
+        }
+    }
+    else if((keyword != "o") && (keyword != "g") && (keyword != "s"))
+    {
+        return false;
+    }
+    return true;
+}
+
+// Starts a new run of faces using the named material
+void GeometryData::useOBJMaterial(const string& name, GeometryData& tempGeom)
+{
+    int materialIndex = 0;
+    int materialCount = tempGeom.materials.size();
+    while((materialIndex < materialCount) && (tempGeom.materials[materialIndex].name != name))
+    {
+        materialIndex++;
+    }
+    if(materialIndex == materialCount)
+    {
+        tempGeom.materials.push_back(Material());
+        tempGeom.materials.back().name = name;
+    }
+
+    // A usemtl that doesn't have any faces before the next one doesn't need a run of its own
+    OBJMaterialRun run;
+    run.firstFace = tempGeom.faces.size();
+    run.material = materialIndex;
+    if(!tempGeom.materialRuns.empty() && (tempGeom.materialRuns.back().firstFace == run.firstFace))
+    {
+        tempGeom.materialRuns.back() = run;
+    }
+    else
+    {
+        tempGeom.materialRuns.push_back(run);
+    }
+}
+
+// Reorders the faces so that each material's faces are contiguous, keeping the file order within
+// each material, and works out the range of indices that each material ends up with (every face
+// becomes exactly 3 indices). Faces that come before the first usemtl get a default material
+void GeometryData::sortOBJFacesByMaterial(GeometryData& tempGeom)
+{
+    const vector<OBJMaterialRun>& runs = tempGeom.materialRuns;
+    vector<FaceData>& faces = tempGeom.faces;
+    materials.swap(tempGeom.materials);
+    if(runs.empty())
+    {
+        return;
+    }
+    int defaultMaterial = -1;
+    if(runs[0].firstFace > 0)
+    {
+        defaultMaterial = materials.size();
+        materials.push_back(Material());
+    }
+
+    // NOTE: A counting sort over the runs: count each material's faces, prefix sum the counts to
+    //       get where each material starts, then copy every run into place
+    int materialCount = materials.size();
+    vector<size_t> materialStarts(materialCount + 1, 0);
+    size_t runCount = runs.size();
+    for(size_t run=0; run<=runCount; run++)
+    {
+        size_t runStart = (run == 0) ? 0 : runs[run-1].firstFace;
+        size_t runEnd = (run == runCount) ? faces.size() : runs[run].firstFace;
+        int material = (run == 0) ? defaultMaterial : runs[run-1].material;
+        if(runEnd > runStart)
+        {
+            materialStarts[material + 1] += runEnd - runStart;
+        }
+    }
+    for(int material=0; material<materialCount; material++)
+    {
+        materialStarts[material + 1] += materialStarts[material];
+    }
+
+    vector<size_t> materialNext(materialStarts.begin(), materialStarts.end() - 1);
+    vector<FaceData> sortedFaces(faces.size());
+    for(size_t run=0; run<=runCount; run++)
+    {
+        size_t runStart = (run == 0) ? 0 : runs[run-1].firstFace;
+        size_t runEnd = (run == runCount) ? faces.size() : runs[run].firstFace;
+        int material = (run == 0) ? defaultMaterial : runs[run-1].material;
+        if(runEnd > runStart)
+        {
+            copy(faces.begin() + runStart, faces.begin() + runEnd,
+                 sortedFaces.begin() + materialNext[material]);
+            materialNext[material] += runEnd - runStart;
+        }
+    }
+    faces.swap(sortedFaces);
+
+    for(int material=0; material<materialCount; material++)
+    {
+        if(materialStarts[material + 1] > materialStarts[material])
+        {
+            MaterialRange range;
+            range.material = material;
+            range.firstIndex = 3*materialStarts[material];
+            range.indexCount = 3*(materialStarts[material + 1] - materialStarts[material]);
+            ranges.push_back(range);
+        }
+    }
+}
+
+// The v/vt/vn triple for one corner of one face, with the attributes the mesh doesn't have left
+// out so that they don't split vertices
+static VertexKey faceCornerKey(const vector<FaceData>& faces, size_t corner,
+                               bool hasTextureCoords, bool hasNormals)
+{
+    const FaceData& face = faces[corner/3];
+    int faceCorner = corner%3;
+    VertexKey key;
+    key.vertexIndex = face.vertexIndex[faceCorner];
+    key.texCoordIndex = hasTextureCoords ? face.texCoordIndex[faceCorner] : -1;
+    key.normalIndex = hasNormals ? face.normalIndex[faceCorner] : -1;
+    return key;
+}
+
+void GeometryData::buildFromOBJData(GeometryData& tempGeom)
+{
+    // NOTE: Since our rendering pipeline supports only 1 set of indices for our data, we need to
+    //       do some post-processing here in order to lay out all the unique v/vt/vn triples. Every
+    //       face corner is looked up by its triple, so corners that share a triple also share a
+    //       vertex and all we add for them is another index
+    // NOTE: Whether or not we have texture coords and normals is decided by the first face, any
+    //       corners in later faces that are missing them just get zeroes
+    if(tempGeom.faces.empty())
+    {
+        cout << "OBJ file contains no faces" << endl;
+        return;
+    }
+    sortOBJFacesByMaterial(tempGeom);
+    materialLibraries.swap(tempGeom.materialLibraries);
+
+    const FaceData& firstFace = tempGeom.faces[0];
+    bool hasTextureCoords = (firstFace.texCoordIndex[0] >= 0);
+    bool hasNormals = (firstFace.normalIndex[0] >= 0);
+    bool hasTangents = hasTextureCoords && hasNormals;
+
+    // NOTE: This is done in two passes so that every output array can be allocated once at its
+    //       exact size. The first pass gives every face corner its vertex index, and the second
+    //       fills in the attributes of each unique vertex from the first corner that used it.
+    //
+    //       The lookup table is open addressing over a flat array, which (unlike a node-based map)
+    //       is a single allocation. Each slot holds the first corner that used a triple, and that
+    //       corner's entry in indices holds the vertex index for the triple.
+    const vector<FaceData>& faces = tempGeom.faces;
+    size_t cornerCount = 3*faces.size();
+    size_t tableSize = 16;
+    while(tableSize < 2*cornerCount)
+    {
+        tableSize *= 2;
+    }
+    const unsigned int emptySlot = 0xFFFFFFFFu;
+    vector<unsigned int> vertexLookup(tableSize, emptySlot);
+
+    indices.resize(cornerCount);
+    unsigned int* indexOut = &indices[0];
+    unsigned int uniqueVertexCount = 0;
+    for(size_t corner=0; corner<cornerCount; corner++)
+    {
+        VertexKey key = faceCornerKey(faces, corner, hasTextureCoords, hasNormals);
+        size_t slot = hashVertexKey(key) & (tableSize - 1);
+        while(true)
+        {
+            unsigned int firstCorner = vertexLookup[slot];
+            if(firstCorner == emptySlot)
+            {
+                vertexLookup[slot] = (unsigned int)corner;
+                indexOut[corner] = uniqueVertexCount++;
+                break;
+            }
+            if(faceCornerKey(faces, firstCorner, hasTextureCoords, hasNormals) == key)
+            {
+                indexOut[corner] = indexOut[firstCorner];
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+    }
+    vector<unsigned int>().swap(vertexLookup);
+
+    // Vertex indices were handed out in corner order, so the first corner to use each vertex is
+    // the first corner whose index is one past the highest we've seen so far
+    vertices.resize(3*uniqueVertexCount);
+    textureCoords.resize(hasTextureCoords ? 2*uniqueVertexCount : 0);
+    normals.resize(hasNormals ? 3*uniqueVertexCount : 0);
+    float* vertexOut = vertices.data();
+    float* texCoordOut = textureCoords.data();
+    float* normalOut = normals.data();
+    const float* tempVertices = tempGeom.vertices.data();
+    const float* tempTexCoords = tempGeom.textureCoords.data();
+    const float* tempNormals = tempGeom.normals.data();
+    size_t tempVertexCount = tempGeom.vertices.size()/3;
+    size_t tempTexCoordCount = tempGeom.textureCoords.size()/2;
+    size_t tempNormalCount = tempGeom.normals.size()/3;
+    unsigned int nextVertex = 0;
+    for(size_t corner=0; (corner<cornerCount) && (nextVertex<uniqueVertexCount); corner++)
+    {
+        if(indexOut[corner] != nextVertex)
+        {
+            continue;
+        }
+
+        // NOTE: The parsers already drop faces with positions that don't exist, and treat any
+        //       other index that doesn't exist as missing. Should a bad index get this far anyway,
+        //       it gets zeroes (like a missing one) rather than reading past the end of the
+        //       records (negative ones included, thanks to the size_t)
+        VertexKey key = faceCornerKey(faces, corner, hasTextureCoords, hasNormals);
+        if((size_t)key.vertexIndex < tempVertexCount)
+        {
+            memcpy(&vertexOut[3*nextVertex], &tempVertices[3*key.vertexIndex], 3*sizeof(float));
+        }
+        if(hasTextureCoords)
+        {
+            float* texCoord = &texCoordOut[2*nextVertex];
+            if((size_t)key.texCoordIndex < tempTexCoordCount)
+            {
+                memcpy(texCoord, &tempTexCoords[2*key.texCoordIndex], 2*sizeof(float));
+            }
+        }
+        if(hasNormals)
+        {
+            float* normal = &normalOut[3*nextVertex];
+            if((size_t)key.normalIndex < tempNormalCount)
+            {
+                memcpy(normal, &tempNormals[3*key.normalIndex], 3*sizeof(float));
+            }
+        }
+        nextVertex++;
+    }
+
+    if(hasTangents)
+    {
+        generateTangents();
+    }
+
+    cout << "Successfully loaded an OBJ with " << vertices.size()/3 << " vertices and "
+         << indices.size()/3 << " triangles" << endl;
+}
+
+int GeometryData::vertexCount()
+{
+    if(meshCache)
+    {
+        return cachedVertexCount;
+    }
+    return vertices.size()/3;
+}
+
+int GeometryData::indexCount()
+{
+    if(meshCache)
+    {
+        return cachedIndexCount;
+    }
+    return indices.size();
+}
+
+bool GeometryData::hasTextureCoords()
+{
+    return textureCoordData() != NULL;
+}
+
+bool GeometryData::hasNormals()
+{
+    return normalData() != NULL;
+}
+
+bool GeometryData::hasTangents()
+{
+    return tangentData() != NULL;
+}
+
+void* GeometryData::streamData(vector<float>& data, MeshStream stream)
+{
+    if(meshCache)
+    {
+        return (void*)cachedStreams[stream];
+    }
+    return data.empty() ? NULL : (void*)&data[0];
+}
+
+void* GeometryData::vertexData()
+{
+    return streamData(vertices, MESH_STREAM_POSITION);
+}
+
+void* GeometryData::indexData()
+{
+    if(meshCache)
+    {
+        return (void*)cachedStreams[MESH_STREAM_INDEX];
+    }
+    return indices.empty() ? NULL : (void*)&indices[0];
+}
+
+void* GeometryData::textureCoordData()
+{
+    return streamData(textureCoords, MESH_STREAM_TEXCOORD);
+}
+
+void* GeometryData::normalData()
+{
+    return streamData(normals, MESH_STREAM_NORMAL);
+}
+
+void* GeometryData::tangentData()
+{
+    return streamData(tangents, MESH_STREAM_TANGENT);
+}
+
+void GeometryData::generateTangents()
+{
+    if(!hasTextureCoords() || !hasNormals())
+    {
+        return;
+    }
+
+    // NOTE: The mapped cache is read-only, so we need our own copy of the data to add tangents to
+    if(meshCache)
+    {
+        detachMeshCache();
+    }
+
+    tangents.resize(4*vertexCount());
+    computeVertexTangents(&vertices[0], &textureCoords[0], &normals[0], vertexCount(),
+                          indices.data(), indexCount(), &tangents[0]);
+}
+
+void GeometryData::optimizeVertexCache()
+{
+    if(meshCache)
+    {
+        detachMeshCache();
+    }
+    clusters.clear();
+    clusterBounds.clear();
+    triangleBVH.clear();
+
+    if(ranges.empty())
+    {
+        ::optimizeVertexCache(indices.data(), indexCount(), vertexCount());
+        return;
+    }
+    for(size_t range=0; range<ranges.size(); range++)
+    {
+        ::optimizeVertexCache(&indices[ranges[range].firstIndex], ranges[range].indexCount, vertexCount());
+    }
+}
+
+void GeometryData::optimizeOverdraw(float threshold)
+{
+    if(meshCache)
+    {
+        detachMeshCache();
+    }
+    clusters.clear();
+    clusterBounds.clear();
+    triangleBVH.clear();
+
+    if(ranges.empty())
+    {
+        ::optimizeOverdraw(indices.data(), indexCount(), vertices.data(), vertexCount(), threshold);
+        return;
+    }
+    for(size_t range=0; range<ranges.size(); range++)
+    {
+        ::optimizeOverdraw(&indices[ranges[range].firstIndex], ranges[range].indexCount, vertices.data(),
+                           vertexCount(), threshold);
+    }
+}
+
+// Moves each vertex of stream (componentCount elements per vertex) to the position remap gives it
+template<typename T>
+static void remapVertexStream(vector<T>& stream, int componentCount, const vector<unsigned int>& remap)
+{
+    if(stream.empty())
+    {
+        return;
+    }
+    vector<T> remapped(stream.size());
+    for(size_t vertex=0; vertex<remap.size(); vertex++)
+    {
+        copy(stream.begin() + componentCount*vertex, stream.begin() + componentCount*(vertex + 1),
+             remapped.begin() + componentCount*remap[vertex]);
+    }
+    stream.swap(remapped);
+}
+
+void GeometryData::optimizeVertexFetch()
+{
+    if(meshCache)
+    {
+        detachMeshCache();
+    }
+
+    int count = vertexCount();
+    if(count == 0)
+    {
+        return;
+    }
+    vector<unsigned int> remap(count);
+    ::optimizeVertexFetch(indices.data(), indexCount(), count, &remap[0]);
+
+    remapVertexStream(vertices, 3, remap);
+    remapVertexStream(textureCoords, 2, remap);
+    remapVertexStream(normals, 3, remap);
+    remapVertexStream(tangents, 4, remap);
+    remapVertexStream(interleavedVertices, 1, remap);
+    remapVertexStream(quantizedVertices, 1, remap);
+    for(size_t level=0; level<lods.size(); level++)
+    {
+        vector<unsigned int>& lodIndices = lods[level].indices;
+        for(size_t i=0; i<lodIndices.size(); i++)
+        {
+            lodIndices[i] = remap[lodIndices[i]];
+        }
+    }
+}
+
+vector<float> defaultLODRatios()
+{
+    static const float ratios[] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+    return vector<float>(ratios, ratios + sizeof(ratios)/sizeof(ratios[0]));
+}
+
+void GeometryData::buildLODs(const vector<float>& ratios, int threadCount)
+{
+    lods.assign(ratios.size(), MeshLOD());
+    const unsigned int* indexArray = (const unsigned int*)indexData();
+    const float* positionData = (const float*)vertexData();
+    const float* texCoordData = (const float*)textureCoordData();
+    const float* normalsData = (const float*)normalData();
+    int count = vertexCount();
+
+    vector<MaterialRange> fullRanges = ranges;
+    if(fullRanges.empty())
+    {
+        MaterialRange whole = { 0, 0, indexCount() };
+        fullRanges.push_back(whole);
+    }
+
+    ThreadPool pool(threadCount);
+    pool.parallelFor(ratios.size(), [&](int level)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        MeshLOD& lod = lods[level];
+        lod.error = 0.0f;
+        lod.indices.resize(indexCount());
+        int lodIndexCount = 0;
+        for(size_t range=0; range<fullRanges.size(); range++)
+        {
+            const MaterialRange& fullRange = fullRanges[range];
+            int target = (int)(fullRange.indexCount / 3 * ratios[level]) * 3;
+            float error = 0.0f;
+            MaterialRange lodRange = { fullRange.material, lodIndexCount, 0 };
+            lodRange.indexCount = simplifyMesh(&lod.indices[lodIndexCount],
+                                               &indexArray[fullRange.firstIndex], fullRange.indexCount,
+                                               positionData, normalsData, texCoordData, count, target,
+                                               &error);
+            ::optimizeVertexCache(&lod.indices[lodIndexCount], lodRange.indexCount, count);
+            lod.error = max(lod.error, error);
+            lodIndexCount += lodRange.indexCount;
+            lod.ranges.push_back(lodRange);
+        }
+        lod.indices.resize(lodIndexCount);
+        lod.indices.shrink_to_fit();
+        if(ranges.empty())
+        {
+            lod.ranges.clear();
+        }
+        lod.buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    });
+}
+
+void GeometryData::buildMeshlets()
+{
+    clusters.clear();
+    const unsigned int* indexArray = (const unsigned int*)indexData();
+    if(ranges.empty())
+    {
+        ::buildMeshlets(indexArray, 0, indexCount(), vertexCount(), 0, clusters);
+    }
+    for(size_t range=0; range<ranges.size(); range++)
+    {
+        ::buildMeshlets(&indexArray[ranges[range].firstIndex], ranges[range].firstIndex,
+                        ranges[range].indexCount, vertexCount(), ranges[range].material, clusters);
+    }
+
+    const float* positionData = (const float*)vertexData();
+    clusterBounds.resize(clusters.size());
+    for(size_t cluster=0; cluster<clusters.size(); cluster++)
+    {
+        clusterBounds[cluster] = computeMeshletBounds(&indexArray[clusters[cluster].firstIndex],
+                                                      clusters[cluster].indexCount, positionData);
+    }
+}
+
+void GeometryData::buildBVH(int threadCount)
+{
+    triangleBVH.build((const unsigned int*)indexData(), indexCount(), (const float*)vertexData(), threadCount);
+}
+
+const BVH& GeometryData::bvh()
+{
+    return triangleBVH;
+}
+
+const vector<Meshlet>& GeometryData::meshlets()
+{
+    return clusters;
+}
+
+const vector<MeshletBounds>& GeometryData::meshletBounds()
+{
+    return clusterBounds;
+}
+
+int GeometryData::lodCount()
+{
+    return lods.size();
+}
+
+const MeshLOD& GeometryData::lod(int level)
+{
+    return lods[level];
+}
+
+void GeometryData::buildInterleavedVertices()
+{
+    int count = vertexCount();
+    const float* positionData = (const float*)vertexData();
+    const float* texCoordData = (const float*)textureCoordData();
+    const float* normalsData = (const float*)normalData();
+    const float* tangentsData = (const float*)tangentData();
+
+    interleavedVertices.assign(count, InterleavedVertex());
+    for(int vertIndex=0; vertIndex<count; vertIndex++)
+    {
+        InterleavedVertex& vertex = interleavedVertices[vertIndex];
+        memcpy(vertex.position, &positionData[3*vertIndex], 3*sizeof(float));
+        if(texCoordData)
+        {
+            memcpy(vertex.texCoord, &texCoordData[2*vertIndex], 2*sizeof(float));
+        }
+        if(normalsData)
+        {
+            memcpy(vertex.normal, &normalsData[3*vertIndex], 3*sizeof(float));
+        }
+        if(tangentsData)
+        {
+            memcpy(vertex.tangent, &tangentsData[4*vertIndex], 4*sizeof(float));
+        }
+    }
+}
+
+void* GeometryData::interleavedVertexData()
+{
+    return interleavedVertices.empty() ? NULL : (void*)&interleavedVertices[0];
+}
+
+void GeometryData::buildQuantizedVertices()
+{
+    // NOTE: A cache from the asset compiler already has them, offset and scale included
+    if(meshCache && cachedStreams[MESH_STREAM_QUANTIZED])
+    {
+        return;
+    }
+
+    int count = vertexCount();
+    const float* positionData = (const float*)vertexData();
+    const float* texCoordData = (const float*)textureCoordData();
+    const float* normalsData = (const float*)normalData();
+    const float* tangentsData = (const float*)tangentData();
+
+    quantizedVertices.assign(count, QuantizedVertex());
+    if(count == 0)
+    {
+        positionOffset = glm::vec3(0.0f);
+        positionScale = glm::vec3(1.0f);
+        return;
+    }
+
+    glm::vec3 minPosition(positionData[0], positionData[1], positionData[2]);
+    glm::vec3 maxPosition = minPosition;
+    for(int vertIndex=1; vertIndex<count; vertIndex++)
+    {
+        glm::vec3 position(positionData[3*vertIndex],
+                           positionData[3*vertIndex+1],
+                           positionData[3*vertIndex+2]);
+        minPosition = glm::min(minPosition, position);
+        maxPosition = glm::max(maxPosition, position);
+    }
+
+    // NOTE: A flat mesh has no extent along at least one axis, any non-zero scale works for that
+    //       axis since every vertex quantizes to 0 along it anyway
+    glm::vec3 extent = maxPosition - minPosition;
+    for(int axis=0; axis<3; axis++)
+    {
+        if(extent[axis] <= 0.0f)
+        {
+            extent[axis] = 1.0f;
+        }
+    }
+    positionOffset = minPosition;
+    positionScale = extent;
+
+    for(int vertIndex=0; vertIndex<count; vertIndex++)
+    {
+        QuantizedVertex& vertex = quantizedVertices[vertIndex];
+
+        glm::vec3 position(positionData[3*vertIndex],
+                           positionData[3*vertIndex+1],
+                           positionData[3*vertIndex+2]);
+        glm::uint64 packedPosition = glm::packUnorm4x16(glm::vec4((position - minPosition) / extent, 0.0f));
+        memcpy(vertex.position, &packedPosition, sizeof(vertex.position));
+
+        glm::vec3 normal(0.0f);
+        if(normalsData)
+        {
+            normal = glm::vec3(normalsData[3*vertIndex],
+                               normalsData[3*vertIndex+1],
+                               normalsData[3*vertIndex+2]);
+            // NOTE: The snorm packing clamps each component to [-1, 1], so anything that isn't
+            //       already unit length would come out pointing the wrong way
+            if(glm::dot(normal, normal) > 0.0f)
+            {
+                normal = glm::normalize(normal);
+            }
+            vertex.normal = glm::packSnorm3x10_1x2(glm::vec4(normal, 0.0f));
+        }
+        if(texCoordData)
+        {
+            vertex.texCoord = glm::packHalf2x16(glm::vec2(texCoordData[2*vertIndex],
+                                                          texCoordData[2*vertIndex+1]));
+        }
+        if(tangentsData)
+        {
+            vertex.tangent = glm::packSnorm3x10_1x2(glm::vec4(tangentsData[4*vertIndex],
+                                                              tangentsData[4*vertIndex+1],
+                                                              tangentsData[4*vertIndex+2],
+                                                              tangentsData[4*vertIndex+3]));
+        }
+    }
+}
+
+void* GeometryData::quantizedVertexData()
+{
+    if(meshCache && cachedStreams[MESH_STREAM_QUANTIZED])
+    {
+        return (void*)cachedStreams[MESH_STREAM_QUANTIZED];
+    }
+    return quantizedVertices.empty() ? NULL : (void*)&quantizedVertices[0];
+}
+
+glm::vec3 GeometryData::quantizedPositionOffset()
+{
+    return positionOffset;
+}
+
+glm::vec3 GeometryData::quantizedPositionScale()
+{
+    return positionScale;
+}
+
+int GeometryData::materialCount()
+{
+    return materials.size();
+}
+
+const Material& GeometryData::material(int materialIndex)
+{
+    return materials[materialIndex];
+}
+
+const vector<MaterialRange>& GeometryData::materialRanges()
+{
+    return ranges;
+}
+
+// Fills in our materials from the OBJ file's material libraries, which are relative to the OBJ
+void GeometryData::loadMaterialLibraries(const string& objFilename)
+{
+    if(materialLibraries.empty())
+    {
+        return;
+    }
+
+    size_t directoryEnd = objFilename.find_last_of("/\\");
+    string directory = (directoryEnd == string::npos) ? "" : objFilename.substr(0, directoryEnd + 1);
+    vector<Material> libraryMaterials;
+    for(size_t library=0; library<materialLibraries.size(); library++)
+    {
+        loadMTLFile(directory + materialLibraries[library], libraryMaterials);
+    }
+
+    for(size_t material=0; material<materials.size(); material++)
+    {
+        string name = materials[material].name;
+        if(name.empty())
+        {
+            continue;
+        }
+        size_t libraryMaterial = 0;
+        while((libraryMaterial < libraryMaterials.size()) && (libraryMaterials[libraryMaterial].name != name))
+        {
+            libraryMaterial++;
+        }
+        if(libraryMaterial == libraryMaterials.size())
+        {
+            cout << "Material " << name << " was not found in any material library" << endl;
+            continue;
+        }
+        materials[material] = libraryMaterials[libraryMaterial];
+    }
 }
 
 std::vector<float> GeometryData::getMouseLoc()  
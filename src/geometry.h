@@ -3,7 +3,16 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 #include "glm/glm.hpp"
+#include "meshcache.h"
+#include "material.h"
+#include "meshlets.h"
+#include "bvh.h"
+
+class MappedFile;
+struct DeferredOBJFaces;
+struct OBJRecordCounts;
 
 struct FaceData
 {
@@ -12,18 +21,160 @@ struct FaceData
     int normalIndex[3];
 };
 
+// The part of the index array that uses one material. Faces are sorted by material when they
+// are loaded, so each material needs only one draw
+struct MaterialRange
+{
+    int material;
+    int firstIndex;
+    int indexCount;
+};
+
+// Where a usemtl statement switched materials, only needed while parsing
+struct OBJMaterialRun
+{
+    size_t firstFace;
+    int material;
+};
+
+// One vertex of the interleaved vertex layout. The tangent's w holds the handedness of the tangent
+// frame (the bitangent is cross(normal, tangent) * w), which also pads the struct out to 48 bytes
+struct alignas(16) InterleavedVertex
+{
+    float position[3];
+    float normal[3];
+    float texCoord[2];
+    float tangent[4];
+};
+
+// One vertex of the quantized vertex layout, 20 bytes instead of the 48 of InterleavedVertex.
+// Positions are 16-bit unsigned normalized values across the mesh's bounding box (the 4th one is
+// padding, so that the normal stays 4 byte aligned), normals and tangents are signed normalized
+// 10:10:10:2 values (the tangent's 2-bit w holds the handedness) and texture coords are halfs
+struct QuantizedVertex
+{
+    unsigned short position[4];
+    unsigned int normal;
+    unsigned int tangent;
+    unsigned int texCoord;
+};
+
+// A simplified version of the mesh. It uses the same vertices as the full mesh (just fewer of
+// them), so it only has its own indices, and material ranges into those
+struct MeshLOD
+{
+    std::vector<unsigned int> indices;
+    std::vector<MaterialRange> ranges;
+    float error;         // How far it strays from the full mesh, relative to the mesh's size
+    double buildSeconds; // How long simplifying it took (0 for levels from the mesh cache)
+};
+
+// The levels of detail the viewer draws every mesh with, as fractions of its triangles. The asset
+// compiler builds the same ones into the mesh caches it writes
+std::vector<float> defaultLODRatios();
+
+// The stream loader is the original ifstream-based state machine, the mapped loader tokenizes a
+// memory-mapped copy of the file in place and is much faster on large files, and the parallel
+// loader splits the mapped file into chunks which are tokenized on a thread pool. All of them
+// produce exactly the same data
+enum OBJLoadMode
+{
+    OBJ_LOAD_STREAM,
+    OBJ_LOAD_MAPPED,
+    OBJ_LOAD_PARALLEL
+};
+
 class GeometryData
 {
 public:
-    void loadFromOBJFile(std::string filename);
+    // threadCount is only used by the parallel loader, 0 means one thread per hardware thread
+    void loadFromOBJFile(std::string filename, OBJLoadMode mode=OBJ_LOAD_MAPPED, int threadCount=0);
+
+    // The mesh cache is used by default, turning it off makes loadFromOBJFile always parse the
+    // OBJ file (and never write a cache)
+    void setUseMeshCache(bool useCache);
+
+    // Writes the mesh to the mesh cache for objFilename, as loading the OBJ file would, but with
+    // the quantized vertices too if they have been built. This is how the asset compiler builds
+    // caches ahead of time. Returns false if the cache couldn't be written
+    bool saveMeshCache(const std::string& objFilename);
 
     int vertexCount();
+    int indexCount();
+    bool hasTextureCoords();
+    bool hasNormals();
+    bool hasTangents();
 
     void* vertexData();
+    void* indexData();
     void* textureCoordData();
     void* normalData();
+    // Tangents are 4 floats per vertex, with the handedness of the tangent frame in w (the
+    // bitangent is cross(normal, tangent) * w)
     void* tangentData();
-    void* bitangentData();
+
+    // Computes the per-vertex tangents from the positions, texture coords and normals. Loading an
+    // OBJ file already does this, but it can also be run on its own, eg. on a mesh that came from
+    // an older mesh cache or was otherwise modified. Meshes without texture coords or normals
+    // don't get tangents
+    void generateTangents();
+
+    // Reorders the triangles to make better use of the GPU's post-transform vertex cache (see
+    // meshoptimize.h). Each material's triangles are reordered among themselves, so the
+    // material ranges stay as they are
+    void optimizeVertexCache();
+
+    // Reorders the triangles of each material so that those likely to hide the others are drawn
+    // first, to cut down on overdraw. Run it after optimizeVertexCache and before
+    // optimizeVertexFetch. threshold is how much worse (as a ratio) the vertex cache efficiency is
+    // allowed to get in exchange (see optimizeOverdraw in meshoptimize.h)
+    void optimizeOverdraw(float threshold=1.05f);
+
+    // Renumbers the vertices in the order the triangles first use them, moving every attribute
+    // (and the interleaved and quantized vertices, if they have been built) along with them. Best
+    // run after optimizeVertexCache, since that's what decides the order
+    void optimizeVertexFetch();
+
+    // Builds levels of detail with ratios[i] of the full mesh's triangles each (eg. 0.5, 0.25, ...),
+    // replacing any built before. Each material is simplified separately, keeping the borders
+    // between them (see simplifyMesh), and then optimized for the vertex cache. Every level is
+    // simplified from the full mesh rather than from the level before, so they are built in
+    // parallel, one level per thread. threadCount 0 means one thread per hardware thread
+    void buildLODs(const std::vector<float>& ratios, int threadCount=0);
+    int lodCount();
+    const MeshLOD& lod(int level);
+
+    // Splits the full mesh into meshlets, each material on its own, and works out their bounds
+    // for culling (see meshlets.h). Run it after the passes that reorder triangles, which throw
+    // away any meshlets built before since they no longer match the index buffer
+    void buildMeshlets();
+    const std::vector<Meshlet>& meshlets();
+    const std::vector<MeshletBounds>& meshletBounds();
+
+    // Builds a bounding volume hierarchy over the full mesh's triangles, for casting rays at it
+    // (see bvh.h). Like the meshlets, it's thrown away by the passes that reorder triangles.
+    // threadCount 0 means one thread per hardware thread
+    void buildBVH(int threadCount=0);
+    const BVH& bvh();
+
+    // The separate attribute arrays above are always available. This builds a single interleaved
+    // array of InterleavedVertex from them, with zeroes for any attributes the mesh doesn't have
+    void buildInterleavedVertices();
+    void* interleavedVertexData();
+
+    // Builds an array of QuantizedVertex in the same way. The quantized positions have to be
+    // scaled and offset back into model space (position = offset + quantized * scale) to use them
+    void buildQuantizedVertices();
+    void* quantizedVertexData();
+    glm::vec3 quantizedPositionOffset();
+    glm::vec3 quantizedPositionScale();
+
+    // Materials are in the order the OBJ file first used them (with an unnamed default one at the
+    // end if some faces come before any usemtl). There are no materials at all if the OBJ file
+    // doesn't use any
+    int materialCount();
+    const Material& material(int materialIndex);
+    const std::vector<MaterialRange>& materialRanges();
 
     std::vector<float> getMouseLoc();
     //void* scaleObject();
@@ -32,13 +183,57 @@ public:
     //void applyModifications(glm::mat4 x, glm::mat4 y);
 
 private:
+    static bool parseOBJStream(const std::string& filename, GeometryData& tempGeom);
+    static bool parseOBJMapped(const std::string& filename, GeometryData& tempGeom,
+                               bool parallel, int threadCount);
+    static void parseOBJRange(const char* p, const char* end, GeometryData& tempGeom,
+                              DeferredOBJFaces* deferredFaces, const OBJRecordCounts& counts,
+                              const OBJRecordCounts& base);
+    static bool parseOBJStatement(const char* p, const char* lineEnd, GeometryData& tempGeom);
+    static void useOBJMaterial(const std::string& name, GeometryData& tempGeom);
+    void sortOBJFacesByMaterial(GeometryData& tempGeom);
+    void buildFromOBJData(GeometryData& tempGeom);
+    void loadMaterialLibraries(const std::string& objFilename);
+
+    bool loadFromMeshCache(const std::string& cacheFilename, const MeshCacheKey& key);
+    bool writeMeshCache(const std::string& cacheFilename, const MeshCacheKey& key);
+    void detachMeshCache();
+
+    void clear();
+    void* streamData(std::vector<float>& data, MeshStream stream);
+
     std::vector<float> vertices;
     std::vector<float> textureCoords;
     std::vector<float> normals;
     std::vector<float> tangents;
-    std::vector<float> bitangents;
+
+    // Triangle list indices into the vertex attribute arrays above
+    std::vector<unsigned int> indices;
+
+    std::vector<InterleavedVertex> interleavedVertices;
+    std::vector<QuantizedVertex> quantizedVertices;
+    glm::vec3 positionOffset = glm::vec3(0.0f);
+    glm::vec3 positionScale = glm::vec3(1.0f);
 
     std::vector<FaceData> faces;
+
+    std::vector<Material> materials;
+    std::vector<MaterialRange> ranges;
+    std::vector<std::string> materialLibraries;
+    std::vector<OBJMaterialRun> materialRuns;
+
+    std::vector<MeshLOD> lods;
+    std::vector<Meshlet> clusters;
+    std::vector<MeshletBounds> clusterBounds;
+    BVH triangleBVH;
+
+    // NOTE: When the data was loaded from a mesh cache, the arrays above stay empty and we serve
+    //       everything straight out of the mapped cache file instead
+    bool useMeshCache = true;
+    std::shared_ptr<MappedFile> meshCache;
+    const void* cachedStreams[MESH_STREAM_COUNT] = {};
+    int cachedVertexCount = 0;
+    int cachedIndexCount = 0;
 };
 
 #endif
@@ -10,6 +10,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <math.h>
+#include <stddef.h>
 
 using namespace std;
 GeometryData geometry;
@@ -175,14 +176,16 @@ void OpenGLWindow::initGL()
     glUseProgram(shader);
 
     colorLoc = glGetUniformLocation(shader, "objectColor");
-    glUniform3f(colorLoc, 100.0f, 100.0f, 100.0f);
-
-    // Load the model that we want to use and buffer the vertex attributes
-    geometry.loadFromOBJFile("sample-bunny.obj");
+    glUniform3fv(colorLoc, 1, &objectColor[0]);
 
     vertexLoc = glGetAttribLocation(shader, "position");
+    normalLoc = glGetAttribLocation(shader, "normal");
+    texCoordLoc = glGetAttribLocation(shader, "texCoord");
+    tangentLoc = glGetAttribLocation(shader, "tangent");
 
     matrixLoc = glGetUniformLocation(shader, "mat4Loc");
+    positionOffsetLoc = glGetUniformLocation(shader, "positionOffset");
+    positionScaleLoc = glGetUniformLocation(shader, "positionScale");
 
     //model = glm::perspective()
     //model = glm::
@@ -192,19 +195,201 @@ void OpenGLWindow::initGL()
 
     glUniformMatrix4fv(matrixLoc, 1, GL_FALSE, &finalMat4[0][0]);
 
+    // NOTE: The buffers start out empty, and are filled in by uploadMesh once a mesh has loaded
+    //       (see loadMesh). Until then render() just has nothing to draw. The index buffer
+    //       binding is part of the VAO state, so render() only needs the VAO bound
     glGenBuffers(1, &vertexBuffer);
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    //glBufferData(GL_ARRAY_BUFFER, 9*sizeof(float), vertices, GL_STATIC_DRAW);
-    glBufferData(GL_ARRAY_BUFFER, geometry.vertexCount() * sizeof(geometry.textureCoordData()) * 3, geometry.vertexData(), GL_STATIC_DRAW);
-    glVertexAttribPointer(vertexLoc, 3, GL_FLOAT, false, 0, 0);
-    glEnableVertexAttribArray(vertexLoc);
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
     glEnableVertexAttribArray(matrixLoc);
 
     glPrintError("Setup complete", true);
 }
 
+// Builds the CPU-side copy of the vertex layout that uploadVertexData uploads, the levels of
+// detail, the meshlets and the BVH for picking. This runs on the loader thread, so it must not
+// touch GL (or the window). Anything the mesh cache already had (from the asset compiler) is
+// kept rather than built again
+static void buildVertexLayout(GeometryData& loaded, VertexLayout layout)
+{
+    if(loaded.lodCount() == 0)
+    {
+        loaded.buildLODs(defaultLODRatios());
+    }
+    if(loaded.meshlets().empty())
+    {
+        loaded.buildMeshlets();
+    }
+    if(loaded.bvh().empty())
+    {
+        loaded.buildBVH();
+    }
+
+    if(layout == VERTEX_LAYOUT_QUANTIZED)
+    {
+        loaded.buildQuantizedVertices();
+    }
+    else if(layout == VERTEX_LAYOUT_INTERLEAVED)
+    {
+        loaded.buildInterleavedVertices();
+    }
+}
+
+void OpenGLWindow::loadMesh(const std::string& filename)
+{
+    VertexLayout layout = vertexLayout;
+    if(!meshLoader.requestLoad(filename, OBJ_LOAD_MAPPED,
+                               [layout](GeometryData& loaded) { buildVertexLayout(loaded, layout); }))
+    {
+        cout << "Too many meshes are already loading, not loading " << filename << endl;
+        return;
+    }
+    SDL_SetWindowTitle(sdlWin, "OpenGL Prac 1 (loading...)");
+}
+
+// Picks up any meshes that finished loading since the last frame. Only the last one is kept, since
+// each load replaces the mesh before it
+void OpenGLWindow::pollLoadedMeshes()
+{
+    MeshLoadResult result;
+    bool loaded = false;
+    while(meshLoader.pollLoaded(result))
+    {
+        cout << "Loaded " << result.filename << " in the background in "
+             << result.loadSeconds*1000.0 << " ms" << endl;
+        geometry = std::move(*result.geometry);
+        loaded = true;
+    }
+    if(!loaded)
+    {
+        return;
+    }
+
+    uploadMesh();
+    if(meshLoader.pendingCount() == 0)
+    {
+        SDL_SetWindowTitle(sdlWin, "OpenGL Prac 1");
+    }
+}
+
+void OpenGLWindow::uploadMesh()
+{
+    uploadVertexData();
+
+    // The full mesh and then each level of detail, all in the one index buffer
+    lodFirstIndex.assign(1, 0);
+    int totalIndexCount = geometry.indexCount();
+    for(int level=0; level<geometry.lodCount(); level++)
+    {
+        lodFirstIndex.push_back(totalIndexCount);
+        totalIndexCount += geometry.lod(level).indices.size();
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, totalIndexCount * sizeof(unsigned int), NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, geometry.indexCount() * sizeof(unsigned int), geometry.indexData());
+    for(int level=0; level<geometry.lodCount(); level++)
+    {
+        const std::vector<unsigned int>& lodIndices = geometry.lod(level).indices;
+        if(!lodIndices.empty())
+        {
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, lodFirstIndex[level + 1] * sizeof(unsigned int),
+                            lodIndices.size() * sizeof(unsigned int), &lodIndices[0]);
+        }
+    }
+    glPrintError("Mesh upload");
+
+    lodSelector.setMesh(geometry);
+    currentLOD = 0;
+}
+
+// NOTE: The shader doesn't have to use every attribute, any that it doesn't use will have a
+//       location of -1 and are just skipped
+static void setVertexAttribute(int location, int size, GLsizei stride, size_t offset,
+                               GLenum type=GL_FLOAT, bool normalized=false)
+{
+    if(location < 0)
+    {
+        return;
+    }
+    glVertexAttribPointer(location, size, type, normalized, stride, (void*)offset);
+    glEnableVertexAttribArray(location);
+}
+
+// NOTE: The interleaved/quantized vertices have already been built by the loader thread
+void OpenGLWindow::uploadVertexData()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+
+    int vertexCount = geometry.vertexCount();
+
+    // Only the quantized layout needs its positions transformed back into model space
+    glm::vec3 positionOffset(0.0f);
+    glm::vec3 positionScale(1.0f);
+    if(vertexLayout == VERTEX_LAYOUT_QUANTIZED)
+    {
+        positionOffset = geometry.quantizedPositionOffset();
+        positionScale = geometry.quantizedPositionScale();
+    }
+    glUniform3fv(positionOffsetLoc, 1, &positionOffset[0]);
+    glUniform3fv(positionScaleLoc, 1, &positionScale[0]);
+
+    if(vertexLayout == VERTEX_LAYOUT_QUANTIZED)
+    {
+        // NOTE: The 10:10:10:2 normals and tangents are read as 4 components so that the
+        //       tangent's handedness comes through in w
+        GLsizei stride = sizeof(QuantizedVertex);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * stride, geometry.quantizedVertexData(), GL_STATIC_DRAW);
+        setVertexAttribute(vertexLoc, 3, stride, offsetof(QuantizedVertex, position), GL_UNSIGNED_SHORT, true);
+        setVertexAttribute(normalLoc, 4, stride, offsetof(QuantizedVertex, normal), GL_INT_2_10_10_10_REV, true);
+        setVertexAttribute(texCoordLoc, 2, stride, offsetof(QuantizedVertex, texCoord), GL_HALF_FLOAT);
+        setVertexAttribute(tangentLoc, 4, stride, offsetof(QuantizedVertex, tangent), GL_INT_2_10_10_10_REV, true);
+        return;
+    }
+
+    if(vertexLayout == VERTEX_LAYOUT_INTERLEAVED)
+    {
+        GLsizei stride = sizeof(InterleavedVertex);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * stride, geometry.interleavedVertexData(), GL_STATIC_DRAW);
+        setVertexAttribute(vertexLoc, 3, stride, offsetof(InterleavedVertex, position));
+        setVertexAttribute(normalLoc, 3, stride, offsetof(InterleavedVertex, normal));
+        setVertexAttribute(texCoordLoc, 2, stride, offsetof(InterleavedVertex, texCoord));
+        setVertexAttribute(tangentLoc, 4, stride, offsetof(InterleavedVertex, tangent));
+        return;
+    }
+
+    // The separate arrays all go into the one buffer, one after the other
+    size_t positionSize = vertexCount * 3 * sizeof(float);
+    size_t normalSize = geometry.hasNormals() ? vertexCount * 3 * sizeof(float) : 0;
+    size_t texCoordSize = geometry.hasTextureCoords() ? vertexCount * 2 * sizeof(float) : 0;
+    size_t tangentSize = geometry.hasTangents() ? vertexCount * 4 * sizeof(float) : 0;
+    size_t normalOffset = positionSize;
+    size_t texCoordOffset = normalOffset + normalSize;
+    size_t tangentOffset = texCoordOffset + texCoordSize;
+
+    glBufferData(GL_ARRAY_BUFFER, tangentOffset + tangentSize, NULL, GL_STATIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, positionSize, geometry.vertexData());
+    setVertexAttribute(vertexLoc, 3, 0, 0);
+    if(normalSize)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, normalOffset, normalSize, geometry.normalData());
+        setVertexAttribute(normalLoc, 3, 0, normalOffset);
+    }
+    if(texCoordSize)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, texCoordOffset, texCoordSize, geometry.textureCoordData());
+        setVertexAttribute(texCoordLoc, 2, 0, texCoordOffset);
+    }
+    if(tangentSize)
+    {
+        glBufferSubData(GL_ARRAY_BUFFER, tangentOffset, tangentSize, geometry.tangentData());
+        setVertexAttribute(tangentLoc, 4, 0, tangentOffset);
+    }
+}
+
 void OpenGLWindow::render()
 {
+    pollLoadedMeshes();
+
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glEnable(GL_MULTISAMPLE_ARB);
 
@@ -317,12 +502,107 @@ void OpenGLWindow::render()
     glUniformMatrix4fv(matrixLoc, 1, GL_FALSE, &finalMat4[0][0]);
     glEnableVertexAttribArray(vertexLoc);
     glEnableVertexAttribArray(matrixLoc);
-    glDrawArrays(GL_TRIANGLES, 0, geometry.vertexCount());
+
+    // The coarsest level of detail that still looks right at the size the mesh is on screen
+    currentLOD = lodSelector.selectLevel(finalMat4, windowWidth, windowHeight, currentLOD);
+    const std::vector<MaterialRange>& ranges = (currentLOD == 0) ? geometry.materialRanges()
+                                                                 : geometry.lod(currentLOD - 1).ranges;
+    int levelIndexCount = (currentLOD == 0) ? geometry.indexCount()
+                                            : (int)geometry.lod(currentLOD - 1).indices.size();
+    size_t levelFirstIndex = lodFirstIndex.empty() ? 0 : lodFirstIndex[currentLOD];
+
+    // NOTE: The full mesh is drawn meshlet by meshlet, skipping the ones that are off screen or
+    //       facing away. The levels of detail are small enough (and only used far away) to draw
+    //       whole. Faces were sorted by material when the mesh was loaded, so that's one draw per
+    //       material (and a single draw if we're not using the material colors)
+    if((currentLOD == 0) && !geometry.meshlets().empty())
+    {
+        renderMeshlets(finalMat4);
+    }
+    else if(useMaterialColors && !ranges.empty())
+    {
+        for(size_t i=0; i<ranges.size(); i++)
+        {
+            const MaterialRange& range = ranges[i];
+            glUniform3fv(colorLoc, 1, &geometry.material(range.material).diffuse[0]);
+            glDrawElements(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT,
+                           (void*)((levelFirstIndex + range.firstIndex) * sizeof(unsigned int)));
+        }
+    }
+    else
+    {
+        glUniform3fv(colorLoc, 1, &objectColor[0]);
+        glDrawElements(GL_TRIANGLES, levelIndexCount, GL_UNSIGNED_INT,
+                       (void*)(levelFirstIndex * sizeof(unsigned int)));
+    }
     // Swap the front and back buffers on the window, effectively putting what we just "drew"
     // onto the screen (whereas previously it only existed in memory)
     SDL_GL_SwapWindow(sdlWin);
 }
 
+void OpenGLWindow::renderMeshlets(const glm::mat4& modelViewProjection)
+{
+    const std::vector<Meshlet>& meshlets = geometry.meshlets();
+    const std::vector<MeshletBounds>& bounds = geometry.meshletBounds();
+    MeshletCuller culler(modelViewProjection);
+    visibleMeshlets.resize(meshlets.size());
+    int visibleCount = culler.cull(&bounds[0], meshlets.size(), &visibleMeshlets[0]);
+
+    // NOTE: Meshlets follow each other in the index buffer, so each run of visible ones (of one
+    //       material, if we're using the material colors) is a single draw
+    bool materialColors = useMaterialColors && !geometry.materialRanges().empty();
+    if(!materialColors)
+    {
+        glUniform3fv(colorLoc, 1, &objectColor[0]);
+    }
+    int currentMaterial = -1;
+    int visible = 0;
+    while(visible < visibleCount)
+    {
+        const Meshlet& first = meshlets[visibleMeshlets[visible]];
+        int runIndexCount = first.indexCount;
+        int next = visible + 1;
+        while((next < visibleCount) && (visibleMeshlets[next] == visibleMeshlets[next - 1] + 1) &&
+              (!materialColors || (meshlets[visibleMeshlets[next]].material == first.material)))
+        {
+            runIndexCount += meshlets[visibleMeshlets[next]].indexCount;
+            next++;
+        }
+        if(materialColors && (first.material != currentMaterial))
+        {
+            currentMaterial = first.material;
+            glUniform3fv(colorLoc, 1, &geometry.material(currentMaterial).diffuse[0]);
+        }
+        glDrawElements(GL_TRIANGLES, runIndexCount, GL_UNSIGNED_INT,
+                       (void*)(first.firstIndex * sizeof(unsigned int)));
+        visible = next;
+    }
+}
+
+void OpenGLWindow::pickTriangle(int x, int y)
+{
+    // NOTE: The ray goes from the near plane to the far plane through the middle of the pixel,
+    //       taken back into model space through the inverse of the matrix the mesh is drawn with,
+    //       so distances along it go from 0 at the near plane to 1 at the far plane
+    float ndcX = 2.0f * (x + 0.5f) / windowWidth - 1.0f;
+    float ndcY = 1.0f - 2.0f * (y + 0.5f) / windowHeight;
+    glm::mat4 inverseMat4 = glm::inverse(finalMat4);
+    glm::vec4 nearPoint = inverseMat4 * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseMat4 * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+
+    RayHit hit;
+    if(!geometry.bvh().closestHit(origin, direction, 1.0f, hit))
+    {
+        cout << "Nothing under the mouse" << endl;
+        return;
+    }
+    glm::vec3 position = origin + direction * hit.distance;
+    cout << "Picked triangle " << hit.triangle << " at (" << position.x << ", " << position.y << ", "
+         << position.z << ")" << endl;
+}
+
 // The program will exit if this function returns false
 bool OpenGLWindow::handleEvent(SDL_Event e)
 {
@@ -372,25 +652,33 @@ bool OpenGLWindow::handleEvent(SDL_Event e)
 
         //colour
         if(e.key.keysym.sym == SDLK_1){
-          colorLoc = glGetUniformLocation(shader, "objectColor");
-          glUniform3f(colorLoc, 100.0f, 0.0f, 0.0f);
+          objectColor = glm::vec3(100.0f, 0.0f, 0.0f);
+          useMaterialColors = false;
         }
         if(e.key.keysym.sym == SDLK_2){
-          colorLoc = glGetUniformLocation(shader, "objectColor");
-          glUniform3f(colorLoc, 0.0f, 100.0f, 0.0f);
+          objectColor = glm::vec3(0.0f, 100.0f, 0.0f);
+          useMaterialColors = false;
         }
         if(e.key.keysym.sym == SDLK_3){
-          colorLoc = glGetUniformLocation(shader, "objectColor");
-          glUniform3f(colorLoc, 0.0f, 0.0f, 100.0f);
+          objectColor = glm::vec3(0.0f, 0.0f, 100.0f);
+          useMaterialColors = false;
         }
         if(e.key.keysym.sym == SDLK_4){
-          colorLoc = glGetUniformLocation(shader, "objectColor");
-          glUniform3f(colorLoc, 100.0f, 100.0f, 0.0f);
+          objectColor = glm::vec3(100.0f, 100.0f, 0.0f);
+          useMaterialColors = false;
         }
         if(e.key.keysym.sym == SDLK_5){
-          colorLoc = glGetUniformLocation(shader, "objectColor");
-          glUniform3f(colorLoc, 100.0f, 100.0f, 100.0f);
+          objectColor = glm::vec3(100.0f, 100.0f, 100.0f);
+          useMaterialColors = false;
         }
+        if(e.key.keysym.sym == SDLK_m){
+          useMaterialColors = true;
+        }
+    }
+    //Pick the triangle under the mouse
+    if(e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT)
+    {
+        pickTriangle(e.button.x, e.button.y);
     }
     return true;
 }
@@ -398,6 +686,7 @@ bool OpenGLWindow::handleEvent(SDL_Event e)
 void OpenGLWindow::cleanup()
 {
     glDeleteBuffers(1, &vertexBuffer);
+    glDeleteBuffers(1, &indexBuffer);
     glDeleteVertexArrays(1, &vao);
     SDL_DestroyWindow(sdlWin);
 }
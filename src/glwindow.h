@@ -3,7 +3,20 @@
 
 #include <GL/glew.h>
 
+#include <string>
+#include <vector>
+
 #include "geometry.h"
+#include "meshloader.h"
+#include "lodselector.h"
+
+// How the vertex attributes are laid out in the vertex buffer
+enum VertexLayout
+{
+    VERTEX_LAYOUT_SEPARATE,     // One tightly packed array per attribute, one after another
+    VERTEX_LAYOUT_INTERLEAVED,  // A single array of InterleavedVertex
+    VERTEX_LAYOUT_QUANTIZED     // A single array of QuantizedVertex, dequantized by the shader
+};
 
 class OpenGLWindow
 {
@@ -11,16 +24,27 @@ public:
     OpenGLWindow();
 
     void initGL();
+    // Starts loading a mesh in the background, it replaces the current one once it has loaded
+    void loadMesh(const std::string& filename);
     void render();
     bool handleEvent(SDL_Event e);
     void cleanup();
 
 private:
+    void pollLoadedMeshes();
+    void uploadMesh();
+    void uploadVertexData();
+    // Draws the visible meshlets of the full mesh
+    void renderMeshlets(const glm::mat4& modelViewProjection);
+    // Prints which triangle of the mesh is under the window coordinates x, y
+    void pickTriangle(int x, int y);
+
     SDL_Window* sdlWin;
 
     GLuint vao;
     GLuint shader;
     GLuint vertexBuffer;
+    GLuint indexBuffer;
 
     glm::mat4 identMat4 = glm::mat4(1.0f);
     glm::mat4 modelMat4;
@@ -30,6 +54,26 @@ private:
     glm::mat4 finalMat4;
 
     int vertexLoc,matrixLoc;
+    int normalLoc,texCoordLoc,tangentLoc;
+    int positionOffsetLoc,positionScaleLoc;
+
+    VertexLayout vertexLayout = VERTEX_LAYOUT_INTERLEAVED;
+
+    AsyncMeshLoader meshLoader;
+
+    // The index buffer holds the full mesh's indices followed by those of each of its levels of
+    // detail, lodFirstIndex[level] is where each level starts. render() picks a level every frame
+    LODSelector lodSelector;
+    std::vector<int> lodFirstIndex;
+    int currentLOD = 0;
+
+    // Which meshlets passed culling this frame (kept around so it isn't reallocated every frame)
+    std::vector<int> visibleMeshlets;
+
+    // Meshes with materials are drawn in each material's diffuse color until one of the color
+    // keys picks a single color for everything (m goes back to the material colors)
+    bool useMaterialColors = true;
+    glm::vec3 objectColor = glm::vec3(100.0f, 100.0f, 100.0f);
 
     int windowWidth = 640;
     int windowHeight = 480;
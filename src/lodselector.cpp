@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <math.h>
+
+#include "lodselector.h"
+#include "geometry.h"
+
+using namespace std;
+
+LODSelector::LODSelector(float maxPixelError, float hysteresis)
+    : maxPixelError(maxPixelError), hysteresis(hysteresis), radiusErrors(1, 0.0f)
+{
+}
+
+void LODSelector::setMesh(GeometryData& geometry)
+{
+    center = glm::vec3(0.0f);
+    radius = 0.0f;
+    radiusErrors.assign(1, 0.0f);
+    int count = geometry.vertexCount();
+    if(count == 0)
+    {
+        return;
+    }
+
+    // NOTE: The sphere is centered on the bounding box, which isn't the smallest sphere but is
+    //       close enough to it, and the box is also what the level errors are relative to
+    const float* positionData = (const float*)geometry.vertexData();
+    glm::vec3 minPosition(positionData[0], positionData[1], positionData[2]);
+    glm::vec3 maxPosition = minPosition;
+    for(int vertIndex=1; vertIndex<count; vertIndex++)
+    {
+        glm::vec3 position(positionData[3*vertIndex], positionData[3*vertIndex+1], positionData[3*vertIndex+2]);
+        minPosition = glm::min(minPosition, position);
+        maxPosition = glm::max(maxPosition, position);
+    }
+    center = (minPosition + maxPosition) * 0.5f;
+    float radiusSquared = 0.0f;
+    for(int vertIndex=0; vertIndex<count; vertIndex++)
+    {
+        glm::vec3 position(positionData[3*vertIndex], positionData[3*vertIndex+1], positionData[3*vertIndex+2]);
+        glm::vec3 offset = position - center;
+        radiusSquared = max(radiusSquared, glm::dot(offset, offset));
+    }
+    radius = sqrtf(radiusSquared);
+
+    glm::vec3 extent = maxPosition - minPosition;
+    float meshSize = max(extent.x, max(extent.y, extent.z));
+    for(int level=0; level<geometry.lodCount(); level++)
+    {
+        radiusErrors.push_back((radius > 0.0f) ? geometry.lod(level).error * meshSize / radius : 0.0f);
+    }
+}
+
+int LODSelector::levelCount() const
+{
+    return radiusErrors.size();
+}
+
+glm::vec3 LODSelector::sphereCenter() const
+{
+    return center;
+}
+
+float LODSelector::sphereRadius() const
+{
+    return radius;
+}
+
+float LODSelector::projectedRadius(const glm::mat4& modelViewProjection, int viewportWidth,
+                                   int viewportHeight) const
+{
+    // NOTE: glm matrices are indexed [column][row]. The length of a row of the upper 3x3 is the
+    //       most that moving one unit in model space can change that clip coordinate, so the
+    //       sphere covers at most radius times that in x and y. Dividing by w at the nearest point
+    //       of the sphere (rather than its center) keeps this on the safe side for perspective
+    const glm::mat4& m = modelViewProjection;
+    glm::vec4 clipCenter = m * glm::vec4(center, 1.0f);
+    float xScale = glm::length(glm::vec3(m[0][0], m[1][0], m[2][0]));
+    float yScale = glm::length(glm::vec3(m[0][1], m[1][1], m[2][1]));
+    float wScale = glm::length(glm::vec3(m[0][3], m[1][3], m[2][3]));
+    float nearestW = clipCenter.w - radius * wScale;
+    if(nearestW <= 1e-6f)
+    {
+        return 1e30f;
+    }
+
+    // Clip space x and y go from -1 to 1 across the viewport
+    float ndcRadius = radius / nearestW;
+    return max(ndcRadius * xScale * viewportWidth, ndcRadius * yScale * viewportHeight) * 0.5f;
+}
+
+int LODSelector::selectLevel(float projectedRadius, int previousLevel) const
+{
+    int coarsest = (int)radiusErrors.size() - 1;
+    int level = min(max(previousLevel, 0), coarsest);
+
+    // Go finer while this level looks too coarse, then coarser while the next one would still
+    // look fine. The gap between the two thresholds is what keeps the level from flickering
+    float finerThreshold = maxPixelError * (1.0f + hysteresis);
+    float coarserThreshold = maxPixelError * (1.0f - hysteresis);
+    while((level > 0) && (radiusErrors[level] * projectedRadius > finerThreshold))
+    {
+        level--;
+    }
+    while((level < coarsest) && (radiusErrors[level + 1] * projectedRadius <= coarserThreshold))
+    {
+        level++;
+    }
+    return level;
+}
+
+int LODSelector::selectLevel(const glm::mat4& modelViewProjection, int viewportWidth, int viewportHeight,
+                             int previousLevel) const
+{
+    return selectLevel(projectedRadius(modelViewProjection, viewportWidth, viewportHeight), previousLevel);
+}
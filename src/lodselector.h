@@ -0,0 +1,52 @@
+#ifndef LOD_SELECTOR_H
+#define LOD_SELECTOR_H
+
+#include <vector>
+#include "glm/glm.hpp"
+
+class GeometryData;
+
+// Picks which level of detail to draw a mesh with, from how big its error would look on screen.
+// Level 0 is the full mesh and level i (i > 0) is the mesh's lod(i - 1). This only does the math
+// (nothing here touches GL), and one selector can be shared by every instance of a mesh, each of
+// which just keeps track of the level it was drawn with last.
+//
+// NOTE: A level's error (see MeshLOD) is relative to the size of the mesh, so scaling it by how
+//       many pixels the mesh's bounding sphere covers gives the error in pixels. We draw the
+//       coarsest level whose error stays under maxPixelError, but only switch levels once the
+//       error is hysteresis (as a fraction) past that, so that an instance sitting right at the
+//       edge doesn't pop back and forth every frame.
+class LODSelector
+{
+public:
+    explicit LODSelector(float maxPixelError=1.0f, float hysteresis=0.25f);
+
+    // Takes the bounding sphere and the error of each level from geometry, after its LODs are built
+    void setMesh(GeometryData& geometry);
+
+    int levelCount() const;
+    glm::vec3 sphereCenter() const;
+    float sphereRadius() const;
+
+    // How many pixels the mesh's bounding sphere would cover (its radius) when drawn with
+    // modelViewProjection into a viewportWidth x viewportHeight viewport. Returns a huge value
+    // when the sphere reaches behind the camera, which makes the full mesh win
+    float projectedRadius(const glm::mat4& modelViewProjection, int viewportWidth, int viewportHeight) const;
+
+    // The level to draw this frame, given the one drawn last frame (or 0 for a new instance)
+    int selectLevel(float projectedRadius, int previousLevel) const;
+    int selectLevel(const glm::mat4& modelViewProjection, int viewportWidth, int viewportHeight,
+                    int previousLevel) const;
+
+private:
+    float maxPixelError;
+    float hysteresis;
+
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+
+    // Each level's error as a fraction of the bounding sphere's radius (the first is always 0)
+    std::vector<float> radiusErrors;
+};
+
+#endif
@@ -21,6 +21,10 @@ int SDL_main(int argc, char** argv)
     OpenGLWindow window; 
     window.initGL();
 
+    // The mesh loads in the background, so the loop below keeps handling events and presenting
+    // (empty) frames until it is ready, and render() uploads it as soon as it is
+    window.loadMesh((argc > 1) ? argv[1] : "sample-bunny.obj");
+
     bool running = true;
     while(running)
     {
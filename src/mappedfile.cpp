@@ -0,0 +1,140 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile()
+    : mappedData(NULL), mappedSize(0)
+#ifdef _WIN32
+    , fileHandle(NULL), mappingHandle(NULL)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || (fileSize.QuadPart == 0))
+    {
+        // NOTE: Windows refuses to map empty files, so we just treat them as a failed open
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!view)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    fileHandle = file;
+    mappingHandle = mapping;
+    mappedData = (const char*)view;
+    mappedSize = (size_t)fileSize.QuadPart;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(mappedData)
+    {
+        UnmapViewOfFile(mappedData);
+        CloseHandle((HANDLE)mappingHandle);
+        CloseHandle((HANDLE)fileHandle);
+    }
+    mappedData = NULL;
+    mappedSize = 0;
+    fileHandle = NULL;
+    mappingHandle = NULL;
+}
+#else
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat fileStat;
+    if((fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0))
+    {
+        // NOTE: mmap refuses zero-length mappings, so we just treat empty files as a failed open
+        ::close(fd);
+        return false;
+    }
+
+    void* view = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps its own reference to the file, so we don't need the descriptor anymore
+    ::close(fd);
+    if(view == MAP_FAILED)
+    {
+        return false;
+    }
+
+    // We're going to read the file front to back, so let the kernel read ahead aggressively
+    madvise(view, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+
+    mappedData = (const char*)view;
+    mappedSize = (size_t)fileStat.st_size;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if(mappedData)
+    {
+        munmap((void*)mappedData, mappedSize);
+    }
+    mappedData = NULL;
+    mappedSize = 0;
+}
+#endif
+
+bool MappedFile::isOpen() const
+{
+    return (mappedData != NULL);
+}
+
+const char* MappedFile::data() const
+{
+    return mappedData;
+}
+
+size_t MappedFile::size() const
+{
+    return mappedSize;
+}
@@ -0,0 +1,35 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <stddef.h>
+
+// A read-only view of a whole file mapped into memory. The mapped bytes are NOT null-terminated,
+// so anything that scans them needs to respect size()
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string& filename);
+    void close();
+
+    bool isOpen() const;
+    const char* data() const;
+    size_t size() const;
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* mappedData;
+    size_t mappedSize;
+
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <ctype.h>
+
+#include "material.h"
+
+using namespace std;
+
+static glm::vec3 readColor(istringstream& lineStream)
+{
+    // NOTE: The spec allows just the red component, in which case it is used for all three
+    float red = 0.0f;
+    lineStream >> red;
+    float green = red;
+    float blue = red;
+    if(lineStream >> green)
+    {
+        lineStream >> blue;
+    }
+    return glm::vec3(red, green, blue);
+}
+
+bool loadMTLFile(const string& filename, vector<Material>& materials)
+{
+    ifstream inStream(filename);
+    if(inStream.fail())
+    {
+        cout << "Unable to open mtl file: " << filename << endl;
+        return false;
+    }
+
+    Material* material = NULL;
+    string line;
+    while(getline(inStream, line))
+    {
+        istringstream lineStream(line);
+        string statement;
+        if(!(lineStream >> statement) || (statement[0] == '#'))
+        {
+            continue;
+        }
+
+        if(statement == "newmtl")
+        {
+            materials.push_back(Material());
+            material = &materials.back();
+            lineStream >> ws;
+            getline(lineStream, material->name);
+            while(!material->name.empty() && isspace((unsigned char)material->name.back()))
+            {
+                material->name.pop_back();
+            }
+        }
+        else if(!material)
+        {
+            cout << "MTL parse error: Expected 'newmtl' before '" << statement << "', ignoring" << endl;
+        }
+        else if(statement == "Ka")
+        {
+            material->ambient = readColor(lineStream);
+        }
+        else if(statement == "Kd")
+        {
+            material->diffuse = readColor(lineStream);
+        }
+        else if(statement == "Ks")
+        {
+            material->specular = readColor(lineStream);
+        }
+        else if(statement == "Ns")
+        {
+            lineStream >> material->shininess;
+        }
+        else if(statement == "d")
+        {
+            lineStream >> material->opacity;
+        }
+        else if(statement == "Tr")
+        {
+            float transparency = 0.0f;
+            lineStream >> transparency;
+            material->opacity = 1.0f - transparency;
+        }
+        else if(statement == "map_Kd")
+        {
+            // NOTE: Texture options (-o, -s, etc.) come before the filename, which is always last
+            string token;
+            while(lineStream >> token)
+            {
+                material->diffuseMap = token;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <string>
+#include <vector>
+#include "glm/glm.hpp"
+
+// The parts of a WaveFront MTL material that we use. Anything not given in the material library
+// keeps the defaults here
+struct Material
+{
+    std::string name;
+    glm::vec3 ambient = glm::vec3(0.0f);     // Ka
+    glm::vec3 diffuse = glm::vec3(0.8f);     // Kd
+    glm::vec3 specular = glm::vec3(0.0f);    // Ks
+    float shininess = 0.0f;                  // Ns
+    float opacity = 1.0f;                    // d (or 1 - Tr)
+    std::string diffuseMap;                  // map_Kd, relative to the material library
+};
+
+// Reads every newmtl entry in an MTL file and appends them to materials. Statements we don't use
+// (illumination models, other texture maps, etc.) are skipped
+bool loadMTLFile(const std::string& filename, std::vector<Material>& materials);
+
+#endif
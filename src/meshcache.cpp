@@ -0,0 +1,539 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "geometry.h"
+#include "mappedfile.h"
+#include "meshcache.h"
+
+using namespace std;
+
+static const char meshCacheMagic[8] = {'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E'};
+
+string meshCacheFilename(const string& objFilename)
+{
+    return objFilename + ".meshcache";
+}
+
+bool getMeshCacheKey(const string& objFilename, MeshCacheKey& key)
+{
+    struct stat fileStat;
+    if(stat(objFilename.c_str(), &fileStat) != 0)
+    {
+        return false;
+    }
+    key.sourceSize = (uint64_t)fileStat.st_size;
+    key.sourceModifiedTime = (int64_t)fileStat.st_mtime;
+    return true;
+}
+
+bool readMeshCacheHeader(const string& cacheFilename, MeshCacheHeader& header)
+{
+    FILE* cacheFile = fopen(cacheFilename.c_str(), "rb");
+    if(!cacheFile)
+    {
+        return false;
+    }
+    bool read = (fread(&header, sizeof(header), 1, cacheFile) == 1);
+    fclose(cacheFile);
+    return read &&
+           (memcmp(header.magic, meshCacheMagic, sizeof(meshCacheMagic)) == 0) &&
+           (header.version == MESH_CACHE_VERSION) &&
+           (header.headerSize == sizeof(MeshCacheHeader));
+}
+
+// A temporary filename that no other writer of the same cache will use at the same time, be it
+// another process (eg. meshc while the program loads the same mesh) or another thread
+static string tempCacheFilename(const string& cacheFilename)
+{
+    static atomic<unsigned int> writeCount(0);
+#ifdef _WIN32
+    int processId = _getpid();
+#else
+    int processId = getpid();
+#endif
+    return cacheFilename + "." + to_string(processId) + "." + to_string(writeCount++) + ".tmp";
+}
+
+static uint64_t alignCacheOffset(uint64_t offset)
+{
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// Copies the levels of detail out of the cache, checking that they fit in their streams and only
+// use vertices and materials that the mesh has. Returns false if they don't
+static bool readCachedLODs(const MeshCacheHeader& header, const void* const* streams,
+                           vector<MeshLOD>& lods)
+{
+    const MeshCacheLOD* lodData = (const MeshCacheLOD*)streams[MESH_STREAM_LOD];
+    const unsigned int* indexData = (const unsigned int*)streams[MESH_STREAM_LOD_INDEX];
+    const MeshCacheRange* rangeData = (const MeshCacheRange*)streams[MESH_STREAM_LOD_RANGE];
+    uint64_t indexCount = header.streams[MESH_STREAM_LOD_INDEX].size / sizeof(unsigned int);
+    uint64_t rangeCount = header.streams[MESH_STREAM_LOD_RANGE].size / sizeof(MeshCacheRange);
+    if((header.lodCount > 0) && !lodData)
+    {
+        return false;
+    }
+
+    lods.assign(header.lodCount, MeshLOD());
+    uint64_t firstIndex = 0;
+    uint64_t firstRange = 0;
+    for(uint32_t level=0; level<header.lodCount; level++)
+    {
+        const MeshCacheLOD& cached = lodData[level];
+        if((cached.indexCount > indexCount - firstIndex) ||
+           (cached.rangeCount > rangeCount - firstRange))
+        {
+            return false;
+        }
+
+        MeshLOD& lod = lods[level];
+        lod.indices.assign(indexData + firstIndex, indexData + firstIndex + cached.indexCount);
+        unsigned int maxIndex = 0;
+        for(size_t i=0; i<lod.indices.size(); i++)
+        {
+            maxIndex = max(maxIndex, lod.indices[i]);
+        }
+        if(!lod.indices.empty() && (maxIndex >= header.vertexCount))
+        {
+            return false;
+        }
+        for(uint32_t range=0; range<cached.rangeCount; range++)
+        {
+            const MeshCacheRange& cachedRange = rangeData[firstRange + range];
+            if((cachedRange.material >= header.materialCount) ||
+               (cachedRange.firstIndex > cached.indexCount) ||
+               (cachedRange.indexCount > cached.indexCount - cachedRange.firstIndex))
+            {
+                return false;
+            }
+            MaterialRange lodRange = { (int)cachedRange.material, (int)cachedRange.firstIndex,
+                                       (int)cachedRange.indexCount };
+            lod.ranges.push_back(lodRange);
+        }
+        lod.error = cached.error;
+        lod.buildSeconds = 0.0;
+        firstIndex += cached.indexCount;
+        firstRange += cached.rangeCount;
+    }
+    return (firstIndex == indexCount) && (firstRange == rangeCount);
+}
+
+// Copies the meshlets out of the cache, checking that each one is a run of whole triangles of the
+// index buffer within the limits. Returns false if any isn't
+static bool readCachedMeshlets(const MeshCacheHeader& header, const void* const* streams,
+                               vector<Meshlet>& meshlets, vector<MeshletBounds>& bounds)
+{
+    const Meshlet* meshletData = (const Meshlet*)streams[MESH_STREAM_MESHLET];
+    const MeshletBounds* boundsData = (const MeshletBounds*)streams[MESH_STREAM_MESHLET_BOUNDS];
+    if((header.meshletCount > 0) && (!meshletData || !boundsData))
+    {
+        return false;
+    }
+
+    // NOTE: Meshes without materials put all of their meshlets in material 0
+    uint32_t materialCount = max(header.materialCount, 1u);
+    for(uint32_t meshlet=0; meshlet<header.meshletCount; meshlet++)
+    {
+        const Meshlet& cached = meshletData[meshlet];
+        if((cached.firstIndex < 0) || ((uint32_t)cached.firstIndex > header.indexCount) ||
+           (cached.indexCount < 0) || (cached.indexCount % 3 != 0) ||
+           ((uint32_t)cached.indexCount > header.indexCount - cached.firstIndex) ||
+           (cached.indexCount > 3*MAX_MESHLET_TRIANGLES) ||
+           (cached.vertexCount < 0) || (cached.vertexCount > MAX_MESHLET_VERTICES) ||
+           (cached.material < 0) || ((uint32_t)cached.material >= materialCount))
+        {
+            return false;
+        }
+    }
+    meshlets.assign(meshletData, meshletData + header.meshletCount);
+    bounds.assign(boundsData, boundsData + header.meshletCount);
+    return true;
+}
+
+bool GeometryData::loadFromMeshCache(const string& cacheFilename, const MeshCacheKey& key)
+{
+    shared_ptr<MappedFile> file = make_shared<MappedFile>();
+    if(!file->open(cacheFilename) || (file->size() < sizeof(MeshCacheHeader)))
+    {
+        return false;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if((memcmp(header.magic, meshCacheMagic, sizeof(meshCacheMagic)) != 0) ||
+       (header.version != MESH_CACHE_VERSION) ||
+       (header.headerSize != sizeof(MeshCacheHeader)))
+    {
+        cout << "Ignoring mesh cache " << cacheFilename << " from a different version" << endl;
+        return false;
+    }
+    if((header.sourceSize != key.sourceSize) ||
+       (header.sourceModifiedTime != key.sourceModifiedTime))
+    {
+        cout << "Ignoring out of date mesh cache " << cacheFilename << endl;
+        return false;
+    }
+
+    // NOTE: GeometryData keeps all of these as ints. Checking them first also means the sizes
+    //       below (worked out in 64 bits) can't wrap around to something that looks right
+    if((header.vertexCount > INT_MAX) || (header.indexCount > INT_MAX) ||
+       (header.materialCount > INT_MAX) || (header.lodCount > INT_MAX) ||
+       (header.meshletCount > INT_MAX) || (header.bvhNodeCount > INT_MAX))
+    {
+        cout << "Ignoring corrupt mesh cache " << cacheFilename << endl;
+        return false;
+    }
+
+    // Every stream is either absent or holds exactly as many elements as the header says
+    const uint64_t expectedSizes[MESH_STREAM_COUNT] =
+    {
+        (uint64_t)header.vertexCount * 3 * sizeof(float),
+        (uint64_t)header.vertexCount * 2 * sizeof(float),
+        (uint64_t)header.vertexCount * 3 * sizeof(float),
+        (uint64_t)header.vertexCount * 4 * sizeof(float),
+        (uint64_t)header.indexCount * sizeof(unsigned int),
+        (uint64_t)header.materialCount * sizeof(MeshCacheMaterial),
+        header.streams[MESH_STREAM_MATERIAL_LIBRARY].size, // Any size will do
+        (uint64_t)header.vertexCount * sizeof(QuantizedVertex),
+        (uint64_t)header.lodCount * sizeof(MeshCacheLOD),
+        // Any whole number of these will do, readCachedLODs checks them against the levels
+        header.streams[MESH_STREAM_LOD_INDEX].size / sizeof(unsigned int) * sizeof(unsigned int),
+        header.streams[MESH_STREAM_LOD_RANGE].size / sizeof(MeshCacheRange) * sizeof(MeshCacheRange),
+        (uint64_t)header.meshletCount * sizeof(Meshlet),
+        (uint64_t)header.meshletCount * sizeof(MeshletBounds),
+        (uint64_t)header.bvhNodeCount * sizeof(BVHNode),
+        (uint64_t)(header.indexCount / 3) * sizeof(int)
+    };
+    const void* streams[MESH_STREAM_COUNT];
+    for(int stream=0; stream<MESH_STREAM_COUNT; stream++)
+    {
+        const MeshCacheStreamInfo& info = header.streams[stream];
+        streams[stream] = NULL;
+        if(info.size == 0)
+        {
+            continue;
+        }
+        if((info.size != expectedSizes[stream]) ||
+           (info.offset % MESH_CACHE_ALIGNMENT != 0) ||
+           (info.offset > file->size()) || (info.size > file->size() - info.offset))
+        {
+            cout << "Ignoring corrupt mesh cache " << cacheFilename << endl;
+            return false;
+        }
+        streams[stream] = file->data() + info.offset;
+    }
+    if(!streams[MESH_STREAM_POSITION] || !streams[MESH_STREAM_INDEX] ||
+       ((header.materialCount > 0) && !streams[MESH_STREAM_MATERIAL]))
+    {
+        cout << "Ignoring corrupt mesh cache " << cacheFilename << endl;
+        return false;
+    }
+
+    // NOTE: The CPU passes that run on a loaded mesh (LODs, meshlets, the BVH) read the positions
+    //       through the indices, so an index past the last vertex has to be caught here. Finding
+    //       the largest index first keeps the loop simple enough to vectorize
+    const unsigned int* indexData = (const unsigned int*)streams[MESH_STREAM_INDEX];
+    unsigned int maxIndex = 0;
+    for(uint32_t i=0; i<header.indexCount; i++)
+    {
+        maxIndex = max(maxIndex, indexData[i]);
+    }
+    if((header.indexCount > 0) && (maxIndex >= header.vertexCount))
+    {
+        cout << "Ignoring corrupt mesh cache " << cacheFilename << endl;
+        return false;
+    }
+
+    // The materials are tiny, so unlike the other streams they are copied out of the cache
+    vector<Material> cachedMaterials(header.materialCount);
+    vector<MaterialRange> cachedRanges;
+    const MeshCacheMaterial* materialData = (const MeshCacheMaterial*)streams[MESH_STREAM_MATERIAL];
+    for(uint32_t material=0; material<header.materialCount; material++)
+    {
+        const MeshCacheMaterial& cached = materialData[material];
+        if((cached.firstIndex > header.indexCount) ||
+           (cached.indexCount > header.indexCount - cached.firstIndex))
+        {
+            cout << "Ignoring corrupt mesh cache " << cacheFilename << endl;
+            return false;
+        }
+        cachedMaterials[material].name.assign(cached.name, strnlen(cached.name, MESH_CACHE_NAME_LENGTH));
+        if(cached.indexCount > 0)
+        {
+            MaterialRange range;
+            range.material = material;
+            range.firstIndex = cached.firstIndex;
+            range.indexCount = cached.indexCount;
+            cachedRanges.push_back(range);
+        }
+    }
+    vector<MeshLOD> cachedLODs;
+    if(!readCachedLODs(header, streams, cachedLODs))
+    {
+        cout << "Ignoring corrupt mesh cache " << cacheFilename << endl;
+        return false;
+    }
+    vector<Meshlet> cachedClusters;
+    vector<MeshletBounds> cachedClusterBounds;
+    if(!readCachedMeshlets(header, streams, cachedClusters, cachedClusterBounds))
+    {
+        cout << "Ignoring corrupt mesh cache " << cacheFilename << endl;
+        return false;
+    }
+    // NOTE: Restoring the BVH checks its nodes and triangle order, and copies the triangles out of
+    //       the positions. That's quick enough that starting threads for it doesn't pay off
+    BVH cachedBVH;
+    if((header.bvhNodeCount > 0) &&
+       (!streams[MESH_STREAM_BVH_TRIANGLE] ||
+        !cachedBVH.restore((const BVHNode*)streams[MESH_STREAM_BVH_NODE], header.bvhNodeCount,
+                           (const int*)streams[MESH_STREAM_BVH_TRIANGLE], indexData, header.indexCount,
+                           (const float*)streams[MESH_STREAM_POSITION], 1)))
+    {
+        cout << "Ignoring corrupt mesh cache " << cacheFilename << endl;
+        return false;
+    }
+    vector<string> cachedLibraries;
+    const char* libraryData = (const char*)streams[MESH_STREAM_MATERIAL_LIBRARY];
+    const char* libraryEnd = libraryData + header.streams[MESH_STREAM_MATERIAL_LIBRARY].size;
+    while(libraryData < libraryEnd)
+    {
+        const char* nameEnd = (const char*)memchr(libraryData, '\n', libraryEnd - libraryData);
+        nameEnd = nameEnd ? nameEnd : libraryEnd;
+        cachedLibraries.push_back(string(libraryData, nameEnd));
+        libraryData = nameEnd + 1;
+    }
+
+    clear();
+    meshCache = file;
+    memcpy(cachedStreams, streams, sizeof(cachedStreams));
+    cachedVertexCount = header.vertexCount;
+    cachedIndexCount = header.indexCount;
+    materials.swap(cachedMaterials);
+    ranges.swap(cachedRanges);
+    materialLibraries.swap(cachedLibraries);
+    lods.swap(cachedLODs);
+    clusters.swap(cachedClusters);
+    clusterBounds.swap(cachedClusterBounds);
+    swap(triangleBVH, cachedBVH);
+    if(streams[MESH_STREAM_QUANTIZED])
+    {
+        positionOffset = glm::vec3(header.quantizedPositionOffset[0], header.quantizedPositionOffset[1],
+                                   header.quantizedPositionOffset[2]);
+        positionScale = glm::vec3(header.quantizedPositionScale[0], header.quantizedPositionScale[1],
+                                  header.quantizedPositionScale[2]);
+    }
+    return true;
+}
+
+// Copies every stream out of the mapped cache into our own arrays, so the data can be modified.
+// The quantized vertices are left behind, since they'd be out of date as soon as anything changed
+void GeometryData::detachMeshCache()
+{
+    shared_ptr<MappedFile> file = meshCache;
+    const void* streams[MESH_STREAM_COUNT];
+    memcpy(streams, cachedStreams, sizeof(streams));
+    int vertexCount = cachedVertexCount;
+    int indexCount = cachedIndexCount;
+    vector<Material> keptMaterials;
+    vector<MaterialRange> keptRanges;
+    vector<string> keptLibraries;
+    vector<MeshLOD> keptLODs;
+    vector<Meshlet> keptClusters;
+    vector<MeshletBounds> keptClusterBounds;
+    keptMaterials.swap(materials);
+    keptRanges.swap(ranges);
+    keptLibraries.swap(materialLibraries);
+    keptLODs.swap(lods);
+    keptClusters.swap(clusters);
+    keptClusterBounds.swap(clusterBounds);
+    BVH keptBVH;
+    swap(keptBVH, triangleBVH);
+    clear();
+    materials.swap(keptMaterials);
+    ranges.swap(keptRanges);
+    materialLibraries.swap(keptLibraries);
+    lods.swap(keptLODs);
+    clusters.swap(keptClusters);
+    clusterBounds.swap(keptClusterBounds);
+    swap(triangleBVH, keptBVH);
+
+    vector<float>* floatStreams[] = { &vertices, &textureCoords, &normals, &tangents };
+    const int componentCounts[] = { 3, 2, 3, 4 };
+    for(int stream=0; stream<MESH_STREAM_INDEX; stream++)
+    {
+        if(streams[stream])
+        {
+            const float* data = (const float*)streams[stream];
+            floatStreams[stream]->assign(data, data + componentCounts[stream]*vertexCount);
+        }
+    }
+    const unsigned int* indexData = (const unsigned int*)streams[MESH_STREAM_INDEX];
+    indices.assign(indexData, indexData + indexCount);
+}
+
+bool GeometryData::saveMeshCache(const string& objFilename)
+{
+    MeshCacheKey key;
+    if(!getMeshCacheKey(objFilename, key))
+    {
+        cout << "Unable to open obj file: " << objFilename << endl;
+        return false;
+    }
+
+    // NOTE: Writing the cache needs the data in our own arrays
+    if(meshCache)
+    {
+        bool quantized = (cachedStreams[MESH_STREAM_QUANTIZED] != NULL);
+        detachMeshCache();
+        if(quantized)
+        {
+            buildQuantizedVertices();
+        }
+    }
+    return writeMeshCache(meshCacheFilename(objFilename), key);
+}
+
+bool GeometryData::writeMeshCache(const string& cacheFilename, const MeshCacheKey& key)
+{
+    vector<MeshCacheMaterial> cacheMaterials(materials.size());
+    memset(cacheMaterials.data(), 0, cacheMaterials.size() * sizeof(MeshCacheMaterial));
+    for(size_t material=0; material<materials.size(); material++)
+    {
+        const string& name = materials[material].name;
+        memcpy(cacheMaterials[material].name, name.data(), min(name.size(), (size_t)MESH_CACHE_NAME_LENGTH - 1));
+    }
+    for(size_t range=0; range<ranges.size(); range++)
+    {
+        cacheMaterials[ranges[range].material].firstIndex = ranges[range].firstIndex;
+        cacheMaterials[ranges[range].material].indexCount = ranges[range].indexCount;
+    }
+    string libraries;
+    for(size_t library=0; library<materialLibraries.size(); library++)
+    {
+        libraries += materialLibraries[library] + "\n";
+    }
+    vector<MeshCacheLOD> cacheLODs(lods.size());
+    vector<unsigned int> lodIndices;
+    vector<MeshCacheRange> lodRanges;
+    for(size_t level=0; level<lods.size(); level++)
+    {
+        const MeshLOD& lod = lods[level];
+        cacheLODs[level].indexCount = lod.indices.size();
+        cacheLODs[level].rangeCount = lod.ranges.size();
+        cacheLODs[level].error = lod.error;
+        lodIndices.insert(lodIndices.end(), lod.indices.begin(), lod.indices.end());
+        for(size_t range=0; range<lod.ranges.size(); range++)
+        {
+            const MaterialRange& lodRange = lod.ranges[range];
+            MeshCacheRange cacheRange = { (uint32_t)lodRange.material, (uint32_t)lodRange.firstIndex,
+                                          (uint32_t)lodRange.indexCount };
+            lodRanges.push_back(cacheRange);
+        }
+    }
+
+    const void* streams[MESH_STREAM_COUNT] =
+    {
+        vertexData(), textureCoordData(), normalData(), tangentData(), indexData(),
+        cacheMaterials.data(), libraries.data(), quantizedVertexData(), cacheLODs.data(),
+        lodIndices.data(), lodRanges.data(), clusters.data(), clusterBounds.data(),
+        triangleBVH.nodeArray().data(), triangleBVH.triangleIdArray().data()
+    };
+    const uint64_t sizes[MESH_STREAM_COUNT] =
+    {
+        vertices.size() * sizeof(float),
+        textureCoords.size() * sizeof(float),
+        normals.size() * sizeof(float),
+        tangents.size() * sizeof(float),
+        indices.size() * sizeof(unsigned int),
+        cacheMaterials.size() * sizeof(MeshCacheMaterial),
+        libraries.size(),
+        quantizedVertices.size() * sizeof(QuantizedVertex),
+        cacheLODs.size() * sizeof(MeshCacheLOD),
+        lodIndices.size() * sizeof(unsigned int),
+        lodRanges.size() * sizeof(MeshCacheRange),
+        clusters.size() * sizeof(Meshlet),
+        clusterBounds.size() * sizeof(MeshletBounds),
+        triangleBVH.nodeArray().size() * sizeof(BVHNode),
+        triangleBVH.triangleIdArray().size() * sizeof(int)
+    };
+
+    MeshCacheHeader header = {};
+    memcpy(header.magic, meshCacheMagic, sizeof(meshCacheMagic));
+    header.version = MESH_CACHE_VERSION;
+    header.headerSize = sizeof(MeshCacheHeader);
+    header.sourceSize = key.sourceSize;
+    header.sourceModifiedTime = key.sourceModifiedTime;
+    header.vertexCount = vertexCount();
+    header.indexCount = indexCount();
+    header.materialCount = materials.size();
+    header.lodCount = lods.size();
+    header.meshletCount = clusters.size();
+    header.bvhNodeCount = triangleBVH.nodeCount();
+    for(int axis=0; axis<3; axis++)
+    {
+        header.quantizedPositionOffset[axis] = positionOffset[axis];
+        header.quantizedPositionScale[axis] = positionScale[axis];
+    }
+
+    uint64_t offset = alignCacheOffset(sizeof(MeshCacheHeader));
+    for(int stream=0; stream<MESH_STREAM_COUNT; stream++)
+    {
+        if(sizes[stream] == 0)
+        {
+            continue;
+        }
+        header.streams[stream].offset = offset;
+        header.streams[stream].size = sizes[stream];
+        offset = alignCacheOffset(offset + sizes[stream]);
+    }
+
+    // NOTE: We write to a temporary file of our own and rename it into place once it is
+    //       complete, so a crash (or another process loading or writing the same mesh) never sees
+    //       a half-written cache
+    string tempFilename = tempCacheFilename(cacheFilename);
+    FILE* cacheFile = fopen(tempFilename.c_str(), "wb");
+    if(!cacheFile)
+    {
+        cout << "Unable to write mesh cache: " << cacheFilename << endl;
+        return false;
+    }
+
+    static const char padding[MESH_CACHE_ALIGNMENT] = {};
+    bool written = (fwrite(&header, sizeof(header), 1, cacheFile) == 1);
+    uint64_t position = sizeof(header);
+    for(int stream=0; written && (stream<MESH_STREAM_COUNT); stream++)
+    {
+        if(sizes[stream] == 0)
+        {
+            continue;
+        }
+        uint64_t paddingSize = header.streams[stream].offset - position;
+        written = (fwrite(padding, 1, paddingSize, cacheFile) == paddingSize) &&
+                  (fwrite(streams[stream], 1, sizes[stream], cacheFile) == sizes[stream]);
+        position = header.streams[stream].offset + sizes[stream];
+    }
+    written = (fclose(cacheFile) == 0) && written;
+
+#ifdef _WIN32
+    // Windows won't rename over an existing file
+    remove(cacheFilename.c_str());
+#endif
+    if(!written || (rename(tempFilename.c_str(), cacheFilename.c_str()) != 0))
+    {
+        cout << "Unable to write mesh cache: " << cacheFilename << endl;
+        remove(tempFilename.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include <stdint.h>
+
+// The binary mesh cache is a sidecar file written next to an OBJ file the first time it is
+// loaded. It holds the fully processed vertex/index arrays, so later loads can map it straight
+// into memory instead of parsing text. A cache is only used if it was built from an OBJ file with
+// the same size and modification time as the one being loaded.
+//
+// Layout: a MeshCacheHeader, followed by the raw data for each stream. Every stream starts on a
+// MESH_CACHE_ALIGNMENT boundary, so once the file is mapped each stream can be handed to GL as-is.
+// Streams that the mesh doesn't have are left with a size of 0.
+//
+// Only the names and index ranges of the materials are cached. Their properties are read from the
+// material libraries on every load, so editing an MTL file doesn't need the cache to be rebuilt.
+//
+// Caches written by a load leave out the quantized vertices, the levels of detail, the meshlets
+// and the BVH, since most runs never use the first and the others take longer to build than the
+// load itself. The asset compiler (tools/meshc.cpp) builds them ahead of time, along with the
+// offset and scale that dequantize the quantized positions. Only the BVH's nodes and triangle
+// order are stored, its copy of the triangles is made again from the positions on load.
+
+// NOTE: Bump this whenever the header or the contents of any stream changes
+#define MESH_CACHE_VERSION 7
+#define MESH_CACHE_ALIGNMENT 64
+#define MESH_CACHE_NAME_LENGTH 256
+
+enum MeshStream
+{
+    MESH_STREAM_POSITION,
+    MESH_STREAM_TEXCOORD,
+    MESH_STREAM_NORMAL,
+    MESH_STREAM_TANGENT,
+    MESH_STREAM_INDEX,
+    MESH_STREAM_MATERIAL,           // One MeshCacheMaterial per material
+    MESH_STREAM_MATERIAL_LIBRARY,   // The material library filenames, each ending in a '\n'
+    MESH_STREAM_QUANTIZED,          // One QuantizedVertex per vertex
+    MESH_STREAM_LOD,                // One MeshCacheLOD per level of detail
+    MESH_STREAM_LOD_INDEX,          // Every level's indices, one level after the other
+    MESH_STREAM_LOD_RANGE,          // Every level's MeshCacheRanges, one level after the other
+    MESH_STREAM_MESHLET,            // One Meshlet per meshlet
+    MESH_STREAM_MESHLET_BOUNDS,     // One MeshletBounds per meshlet
+    MESH_STREAM_BVH_NODE,           // One BVHNode per node of the BVH
+    MESH_STREAM_BVH_TRIANGLE,       // The BVH's triangle order, one int per triangle
+    MESH_STREAM_COUNT
+};
+
+struct MeshCacheStreamInfo
+{
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct MeshCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+
+    uint64_t sourceSize;
+    int64_t sourceModifiedTime;
+
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t materialCount;
+    uint32_t lodCount;
+    uint32_t meshletCount;
+    uint32_t bvhNodeCount;
+
+    // Only meaningful when there is a MESH_STREAM_QUANTIZED stream
+    float quantizedPositionOffset[3];
+    float quantizedPositionScale[3];
+
+    MeshCacheStreamInfo streams[MESH_STREAM_COUNT];
+};
+
+// NOTE: Names that don't fit are truncated, which just means they won't match their material in
+//       the material library
+struct MeshCacheMaterial
+{
+    char name[MESH_CACHE_NAME_LENGTH];
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+// The level's indices and ranges follow those of the levels before it in their streams
+struct MeshCacheLOD
+{
+    uint32_t indexCount;
+    uint32_t rangeCount;
+    float error;
+};
+
+// One material's part of a level of detail's indices
+struct MeshCacheRange
+{
+    uint32_t material;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
+// Identifies the exact version of the OBJ file that a cache was built from
+struct MeshCacheKey
+{
+    uint64_t sourceSize;
+    int64_t sourceModifiedTime;
+};
+
+std::string meshCacheFilename(const std::string& objFilename);
+bool getMeshCacheKey(const std::string& objFilename, MeshCacheKey& key);
+
+// Reads just the header of a cache file. Fails if it isn't a cache from this version
+bool readMeshCacheHeader(const std::string& cacheFilename, MeshCacheHeader& header);
+
+#endif
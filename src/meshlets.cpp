@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <math.h>
+
+#include "meshlets.h"
+
+using namespace std;
+
+void buildMeshlets(const unsigned int* indices, int firstIndex, int indexCount, int vertexCount,
+                   int material, vector<Meshlet>& meshlets)
+{
+    // NOTE: Each vertex remembers the last meshlet it was added to, so checking whether a
+    //       triangle brings in new vertices doesn't need clearing anything between meshlets
+    vector<int> lastMeshlet(vertexCount, -1);
+    Meshlet meshlet = { firstIndex, 0, 0, material };
+    for(int i=0; i+2<indexCount; i+=3)
+    {
+        int meshletIndex = meshlets.size();
+        int newVertices = 0;
+        for(int corner=0; corner<3; corner++)
+        {
+            unsigned int vertex = indices[i + corner];
+            bool repeated = ((corner > 0) && (indices[i] == vertex)) ||
+                            ((corner > 1) && (indices[i+1] == vertex));
+            newVertices += ((lastMeshlet[vertex] != meshletIndex) && !repeated) ? 1 : 0;
+        }
+        if((meshlet.vertexCount + newVertices > MAX_MESHLET_VERTICES) ||
+           (meshlet.indexCount == 3 * MAX_MESHLET_TRIANGLES))
+        {
+            meshlets.push_back(meshlet);
+            meshletIndex++;
+            meshlet.firstIndex = firstIndex + i;
+            meshlet.indexCount = 0;
+            meshlet.vertexCount = 0;
+        }
+
+        for(int corner=0; corner<3; corner++)
+        {
+            unsigned int vertex = indices[i + corner];
+            if(lastMeshlet[vertex] != meshletIndex)
+            {
+                lastMeshlet[vertex] = meshletIndex;
+                meshlet.vertexCount++;
+            }
+        }
+        meshlet.indexCount += 3;
+    }
+    if(meshlet.indexCount > 0)
+    {
+        meshlets.push_back(meshlet);
+    }
+}
+
+MeshletBounds computeMeshletBounds(const unsigned int* indices, int indexCount, const float* positions)
+{
+    MeshletBounds bounds = {};
+    bounds.coneCutoff = 1.0f;
+    if(indexCount < 3)
+    {
+        return bounds;
+    }
+
+    // The sphere is centered on the bounding box, and the cone's axis is the average of the
+    // triangles' (unit) normals
+    glm::vec3 minPosition(positions[3*indices[0]], positions[3*indices[0]+1], positions[3*indices[0]+2]);
+    glm::vec3 maxPosition = minPosition;
+    glm::vec3 axis(0.0f);
+    for(int i=0; i+2<indexCount; i+=3)
+    {
+        glm::vec3 corners[3];
+        for(int corner=0; corner<3; corner++)
+        {
+            const float* position = &positions[3*indices[i + corner]];
+            corners[corner] = glm::vec3(position[0], position[1], position[2]);
+            minPosition = glm::min(minPosition, corners[corner]);
+            maxPosition = glm::max(maxPosition, corners[corner]);
+        }
+        glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+        float length = glm::length(normal);
+        if(length > 0.0f)
+        {
+            axis += normal / length;
+        }
+    }
+    glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+    float radiusSquared = 0.0f;
+    for(int i=0; i<indexCount; i++)
+    {
+        const float* position = &positions[3*indices[i]];
+        glm::vec3 offset = glm::vec3(position[0], position[1], position[2]) - center;
+        radiusSquared = max(radiusSquared, glm::dot(offset, offset));
+    }
+    bounds.center[0] = center.x;
+    bounds.center[1] = center.y;
+    bounds.center[2] = center.z;
+    bounds.radius = sqrtf(radiusSquared);
+
+    float axisLength = glm::length(axis);
+    if(axisLength <= 0.0f)
+    {
+        return bounds;
+    }
+    axis /= axisLength;
+    bounds.coneAxis[0] = axis.x;
+    bounds.coneAxis[1] = axis.y;
+    bounds.coneAxis[2] = axis.z;
+
+    // The normal furthest from the axis decides how wide the cone is. Degenerate triangles don't
+    // have a normal, and never get drawn, so they don't count
+    float minDot = 1.0f;
+    for(int i=0; i+2<indexCount; i+=3)
+    {
+        const float* a = &positions[3*indices[i]];
+        const float* b = &positions[3*indices[i+1]];
+        const float* c = &positions[3*indices[i+2]];
+        glm::vec3 normal = glm::cross(glm::vec3(b[0] - a[0], b[1] - a[1], b[2] - a[2]),
+                                      glm::vec3(c[0] - a[0], c[1] - a[1], c[2] - a[2]));
+        float length = glm::length(normal);
+        if(length > 0.0f)
+        {
+            minDot = min(minDot, glm::dot(normal / length, axis));
+        }
+    }
+    // NOTE: A cone 90 degrees or wider has triangles facing every which way
+    bounds.coneCutoff = (minDot <= 0.0f) ? 1.0f : sqrtf(max(0.0f, 1.0f - minDot * minDot));
+    return bounds;
+}
+
+MeshletCuller::MeshletCuller(const glm::mat4& modelViewProjection)
+{
+    // NOTE: glm matrices are indexed [column][row]. The frustum planes are sums and differences of
+    //       the rows (Gribb and Hartmann), normalized so that they give distances
+    const glm::mat4& m = modelViewProjection;
+    glm::vec4 rows[4];
+    for(int row=0; row<4; row++)
+    {
+        rows[row] = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+    }
+    for(int axis=0; axis<3; axis++)
+    {
+        frustumPlanes[2*axis] = rows[3] + rows[axis];
+        frustumPlanes[2*axis + 1] = rows[3] - rows[axis];
+    }
+    for(int plane=0; plane<6; plane++)
+    {
+        float length = glm::length(glm::vec3(frustumPlanes[plane]));
+        frustumPlanes[plane] /= (length > 0.0f) ? length : 1.0f;
+    }
+
+    // A triangle's area on screen is proportional to dot(normal, g), where (with X, Y and W its
+    // clip coords and r0, r1 and r3 the xyz of the rows) g = W (W r0 x r1 - X r3 x r1 - Y r0 x r3).
+    // That's W^2 r0 x r1 for an orthographic projection (r3 = 0), and otherwise works out to
+    // W det(r0, r1, r3) (position - camera) times a positive number
+    glm::vec3 r0(rows[0]);
+    glm::vec3 r1(rows[1]);
+    glm::vec3 r3(rows[3]);
+    orthographic = (glm::dot(r3, r3) <= 1e-12f * glm::dot(r0, r0));
+    cameraPosition = glm::vec3(0.0f);
+    viewSign = 1.0f;
+    if(orthographic)
+    {
+        glm::vec3 facing = glm::cross(r0, r1);
+        float length = glm::length(facing);
+        canCullBackFaces = (length > 0.0f);
+        viewDirection = canCullBackFaces ? -facing / length : glm::vec3(0.0f);
+        return;
+    }
+    glm::mat3 rowMatrix = glm::transpose(glm::mat3(r0, r1, r3));
+    float determinant = glm::determinant(rowMatrix);
+    canCullBackFaces = (fabsf(determinant) > 1e-12f);
+    viewDirection = glm::vec3(0.0f);
+    if(canCullBackFaces)
+    {
+        cameraPosition = glm::inverse(rowMatrix) * -glm::vec3(rows[0].w, rows[1].w, rows[3].w);
+        viewSign = (determinant > 0.0f) ? -1.0f : 1.0f;
+    }
+}
+
+bool MeshletCuller::outsideFrustum(const MeshletBounds& bounds) const
+{
+    glm::vec4 center(bounds.center[0], bounds.center[1], bounds.center[2], 1.0f);
+    for(int plane=0; plane<6; plane++)
+    {
+        if(glm::dot(frustumPlanes[plane], center) < -bounds.radius)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MeshletCuller::backFacing(const MeshletBounds& bounds) const
+{
+    if(!canCullBackFaces || (bounds.coneCutoff >= 1.0f))
+    {
+        return false;
+    }
+    glm::vec3 axis(bounds.coneAxis[0], bounds.coneAxis[1], bounds.coneAxis[2]);
+    if(orthographic)
+    {
+        return glm::dot(axis, viewDirection) >= bounds.coneCutoff;
+    }
+
+    // NOTE: Every normal is within the cone's half angle of the axis, so they all point along
+    //       the view direction if it's less than 90 degrees minus that from the axis. The sphere
+    //       can move the view direction around by up to its radius, so that's allowed for too
+    glm::vec3 center(bounds.center[0], bounds.center[1], bounds.center[2]);
+    glm::vec3 toCenter = (center - cameraPosition) * viewSign;
+    return glm::dot(axis, toCenter) >= bounds.coneCutoff * glm::length(toCenter) +
+                                       bounds.radius * (1.0f + bounds.coneCutoff);
+}
+
+int MeshletCuller::cull(const MeshletBounds* bounds, int count, int* visible) const
+{
+    int visibleCount = 0;
+    for(int meshlet=0; meshlet<count; meshlet++)
+    {
+        if(!outsideFrustum(bounds[meshlet]) && !backFacing(bounds[meshlet]))
+        {
+            visible[visibleCount++] = meshlet;
+        }
+    }
+    return visibleCount;
+}
@@ -0,0 +1,79 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <vector>
+#include "glm/glm.hpp"
+
+// The most vertices and triangles a meshlet can have. These are the usual limits for mesh
+// shaders, and keep clusters small enough for culling them to be worthwhile
+#define MAX_MESHLET_VERTICES 64
+#define MAX_MESHLET_TRIANGLES 124
+
+// A small cluster of triangles, which are a consecutive run of the index buffer, so that the
+// visible ones can be drawn straight out of it. A meshlet only ever has one material
+struct Meshlet
+{
+    int firstIndex;
+    int indexCount;
+    int vertexCount; // How many different vertices its triangles use
+    int material;
+};
+
+// What culling a meshlet needs to know about it, 32 bytes so that two fit in a cache line. All
+// of its triangles are inside the sphere, and all of their normals are within the cone around
+// coneAxis whose half angle has the sine coneCutoff (which is 1 if the normals are too spread out
+// to ever cull the meshlet as back facing)
+struct MeshletBounds
+{
+    float center[3];
+    float radius;
+    float coneAxis[3];
+    float coneCutoff;
+};
+
+// Splits indexCount indices (a triangle list, starting at firstIndex into the whole index buffer)
+// into meshlets, in the order they are in, and appends them to meshlets. Each meshlet takes as
+// many triangles as fit in the limits above, so the meshlets are only as tight as the triangle
+// order is, which after optimizeVertexCache is pretty tight
+void buildMeshlets(const unsigned int* indices, int firstIndex, int indexCount, int vertexCount,
+                   int material, std::vector<Meshlet>& meshlets);
+
+// The bounding sphere and normal cone of one meshlet's triangles (indexCount indices, starting
+// at indices). positions are 3 floats per vertex
+MeshletBounds computeMeshletBounds(const unsigned int* indices, int indexCount, const float* positions);
+
+// Decides which meshlets can be skipped, either because they are outside the view frustum or
+// because every one of their triangles faces away from the camera (and would be back face
+// culled). Set one up per frame, and per instance, since everything is worked out in model space.
+//
+// NOTE: The camera is found from the model-view-projection matrix alone: it's the point that
+//       ends up with x, y and w all 0 in clip space. With an orthographic projection (no such
+//       point) the triangles are seen from the same direction everywhere instead. Either way,
+//       which side counts as the front is worked out the way GL does it, from the winding on
+//       screen, so mirroring transforms are fine
+class MeshletCuller
+{
+public:
+    explicit MeshletCuller(const glm::mat4& modelViewProjection);
+
+    bool outsideFrustum(const MeshletBounds& bounds) const;
+    bool backFacing(const MeshletBounds& bounds) const;
+
+    // Writes the indices of the meshlets that could be visible to visible (which needs room for
+    // count of them) and returns how many there are
+    int cull(const MeshletBounds* bounds, int count, int* visible) const;
+
+private:
+    glm::vec4 frustumPlanes[6];
+
+    // Back facing triangles are the ones whose normals point along the direction they are seen
+    // from, which is either viewDirection everywhere, or from cameraPosition (multiplied by
+    // viewSign, which is -1 if the transform mirrors the mesh)
+    bool orthographic;
+    bool canCullBackFaces;
+    glm::vec3 viewDirection;
+    glm::vec3 cameraPosition;
+    float viewSign;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include <chrono>
+
+#include "meshloader.h"
+
+// NOTE: A request only counts as pending until its result is collected, and there can never be
+//       more than maxPending of those, so neither queue can ever be full when we push to it
+AsyncMeshLoader::AsyncMeshLoader(int maxPending)
+    : requests(maxPending), results(maxPending), maxPending(maxPending), pending(0),
+      shuttingDown(false)
+{
+    worker = std::thread(&AsyncMeshLoader::workerLoop, this);
+}
+
+AsyncMeshLoader::~AsyncMeshLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        shuttingDown = true;
+    }
+    wakeWorker.notify_one();
+    worker.join();
+}
+
+bool AsyncMeshLoader::requestLoad(const std::string& filename, OBJLoadMode mode,
+                                  const MeshProcessor& process, bool useMeshCache)
+{
+    if(pending >= maxPending)
+    {
+        return false;
+    }
+
+    MeshLoadRequest request;
+    request.filename = filename;
+    request.mode = mode;
+    request.useMeshCache = useMeshCache;
+    request.process = process;
+    requests.push(request);
+    pending++;
+
+    // Taking the lock (even though we don't change anything under it) makes sure the loader
+    // thread is either already waiting, and gets woken up, or hasn't yet checked for requests
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    wakeWorker.notify_one();
+    return true;
+}
+
+bool AsyncMeshLoader::pollLoaded(MeshLoadResult& result)
+{
+    if(!results.pop(result))
+    {
+        return false;
+    }
+    pending--;
+    return true;
+}
+
+int AsyncMeshLoader::pendingCount() const
+{
+    return pending;
+}
+
+void AsyncMeshLoader::workerLoop()
+{
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wakeWorker.wait(lock, [this]() { return shuttingDown || !requests.empty(); });
+            if(shuttingDown)
+            {
+                return;
+            }
+        }
+
+        // Requests still queued when the loader is destroyed are dropped rather than loaded
+        MeshLoadRequest request;
+        while(!shuttingDown && requests.pop(request))
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            MeshLoadResult result;
+            result.filename = request.filename;
+            result.geometry.reset(new GeometryData());
+            result.geometry->setUseMeshCache(request.useMeshCache);
+            result.geometry->loadFromOBJFile(request.filename, request.mode);
+            if(request.process)
+            {
+                request.process(*result.geometry);
+            }
+            result.loadSeconds = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count();
+
+            results.push(result);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+#include "geometry.h"
+#include "spscqueue.h"
+
+// Runs on the loader thread after the mesh is loaded, for any other CPU-side work that should stay
+// off the render thread (eg. building the vertex layout that will be uploaded)
+typedef std::function<void(GeometryData&)> MeshProcessor;
+
+struct MeshLoadRequest
+{
+    std::string filename;
+    OBJLoadMode mode;
+    bool useMeshCache;
+    MeshProcessor process;
+};
+
+// A finished load. geometry is empty (no vertices) if the file couldn't be loaded
+struct MeshLoadResult
+{
+    std::string filename;
+    std::unique_ptr<GeometryData> geometry;
+    double loadSeconds;
+};
+
+// Loads meshes on a background thread so that the render thread can keep presenting frames. The
+// render thread requests loads and polls for finished ones, which it then uploads to GL itself
+// (the GL context belongs to the render thread, so the loader thread never touches GL).
+//
+// NOTE: Requests and results both go through lock-free single producer/single consumer queues,
+//       so neither requestLoad nor pollLoaded ever waits on the loader thread. The loader thread
+//       does sleep on a condition variable while it has nothing to do, but only the (cheap)
+//       wake up notification takes the lock, never the hand-off of a mesh.
+class AsyncMeshLoader
+{
+public:
+    // maxPending is how many loads can be requested but not yet collected at once
+    explicit AsyncMeshLoader(int maxPending=8);
+
+    // Waits for the load in progress (if any) to finish, and drops any that haven't started
+    ~AsyncMeshLoader();
+
+    // Render thread only. Returns false if maxPending loads are already in flight
+    bool requestLoad(const std::string& filename, OBJLoadMode mode=OBJ_LOAD_MAPPED,
+                     const MeshProcessor& process=MeshProcessor(), bool useMeshCache=true);
+
+    // Render thread only. Never blocks, returns false if no load has finished since the last call
+    bool pollLoaded(MeshLoadResult& result);
+
+    // The number of loads that have been requested but not collected with pollLoaded
+    int pendingCount() const;
+
+private:
+    AsyncMeshLoader(const AsyncMeshLoader&) = delete;
+    AsyncMeshLoader& operator=(const AsyncMeshLoader&) = delete;
+
+    void workerLoop();
+
+    SPSCQueue<MeshLoadRequest> requests;
+    SPSCQueue<MeshLoadResult> results;
+    int maxPending;
+    std::atomic<int> pending;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeWorker;
+    // Set under wakeMutex so the loader thread can't miss the wake up, but atomic since the
+    // loader thread also checks it between loads without taking the lock
+    std::atomic<bool> shuttingDown;
+    std::thread worker;
+};
+
+#endif
@@ -0,0 +1,566 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "glm/glm.hpp"
+#include "meshoptimize.h"
+
+using namespace std;
+
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, int indexCount, int vertexCount,
+                                    int cacheSize)
+{
+    // NOTE: Rather than shifting a FIFO along, each vertex remembers when it was last added to the
+    //       cache. It's still in there if fewer than cacheSize vertices have been added since. The
+    //       clock starts past cacheSize so that every vertex starts out as a miss
+    vector<unsigned int> addedTime(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    int usedVertexCount = 0;
+
+    VertexCacheStats stats;
+    stats.transformedVertexCount = 0;
+    for(int i=0; i<indexCount; i++)
+    {
+        unsigned int vertex = indices[i];
+        if(time - addedTime[vertex] > (unsigned int)cacheSize)
+        {
+            usedVertexCount += (addedTime[vertex] == 0) ? 1 : 0;
+            addedTime[vertex] = time++;
+            stats.transformedVertexCount++;
+        }
+    }
+
+    int triangleCount = indexCount / 3;
+    stats.acmr = (triangleCount > 0) ? (float)stats.transformedVertexCount / triangleCount : 0.0f;
+    stats.atvr = (usedVertexCount > 0) ? (float)stats.transformedVertexCount / usedVertexCount : 0.0f;
+    return stats;
+}
+
+// The size of the LRU cache that the scores are based on, and the highest number of remaining
+// triangles that we bother to tell apart (the valence boost is tiny by then anyway)
+static const int forsythCacheSize = 32;
+static const int forsythMaxValence = 64;
+
+// NOTE: These are the constants from Forsyth's article. The most recent triangle's 3 vertices all
+//       get the same fixed score, so that we don't favour a particular one of its edges
+static void buildForsythScoreTables(float* cacheScores, float* valenceScores)
+{
+    const float cacheDecayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+
+    for(int position=0; position<forsythCacheSize; position++)
+    {
+        if(position < 3)
+        {
+            cacheScores[position] = lastTriangleScore;
+        }
+        else
+        {
+            float scale = 1.0f / (forsythCacheSize - 3);
+            cacheScores[position] = powf(1.0f - (position - 3) * scale, cacheDecayPower);
+        }
+    }
+    valenceScores[0] = 0.0f;
+    for(int valence=1; valence<forsythMaxValence; valence++)
+    {
+        valenceScores[valence] = valenceBoostScale * powf((float)valence, -valenceBoostPower);
+    }
+}
+
+static float forsythVertexScore(int cachePosition, int remainingTriangles,
+                                const float* cacheScores, const float* valenceScores)
+{
+    if(remainingTriangles == 0)
+    {
+        return -1.0f;
+    }
+    float score = (cachePosition >= 0) ? cacheScores[cachePosition] : 0.0f;
+    int valence = (remainingTriangles < forsythMaxValence) ? remainingTriangles : forsythMaxValence - 1;
+    return score + valenceScores[valence];
+}
+
+void optimizeVertexCache(unsigned int* indices, int indexCount, int vertexCount)
+{
+    int triangleCount = indexCount / 3;
+    if(triangleCount < 2)
+    {
+        return;
+    }
+
+    float cacheScores[forsythCacheSize];
+    float valenceScores[forsythMaxValence];
+    buildForsythScoreTables(cacheScores, valenceScores);
+
+    // Every vertex's triangles, packed into one array. remaining[v] of them are still to be drawn,
+    // and those are always kept at the front of the vertex's part of the array
+    vector<int> remaining(vertexCount, 0);
+    for(int i=0; i<3*triangleCount; i++)
+    {
+        remaining[indices[i]]++;
+    }
+    vector<int> adjacencyOffsets(vertexCount + 1, 0);
+    for(int vertex=0; vertex<vertexCount; vertex++)
+    {
+        adjacencyOffsets[vertex+1] = adjacencyOffsets[vertex] + remaining[vertex];
+    }
+    vector<int> adjacency(3*triangleCount);
+    {
+        vector<int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for(int i=0; i<3*triangleCount; i++)
+        {
+            adjacency[fill[indices[i]]++] = i / 3;
+        }
+    }
+
+    vector<int> cachePositions(vertexCount, -1);
+    vector<float> vertexScores(vertexCount);
+    for(int vertex=0; vertex<vertexCount; vertex++)
+    {
+        vertexScores[vertex] = forsythVertexScore(-1, remaining[vertex], cacheScores, valenceScores);
+    }
+    vector<float> triangleScores(triangleCount);
+    for(int triangle=0; triangle<triangleCount; triangle++)
+    {
+        const unsigned int* corners = &indices[3*triangle];
+        triangleScores[triangle] = vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+    }
+
+    // NOTE: The cache has room for 3 extra entries, since the new triangle's vertices go in before
+    //       the ones that fall off the end are dropped
+    int cache[forsythCacheSize + 3];
+    int cacheCount = 0;
+    vector<char> drawn(triangleCount, 0);
+    vector<unsigned int> output(3*triangleCount);
+
+    int bestTriangle = 0;
+    float bestScore = triangleScores[0];
+    for(int triangle=1; triangle<triangleCount; triangle++)
+    {
+        if(triangleScores[triangle] > bestScore)
+        {
+            bestTriangle = triangle;
+            bestScore = triangleScores[triangle];
+        }
+    }
+
+    int nextUndrawn = 0;
+    for(int outputTriangle=0; outputTriangle<triangleCount; outputTriangle++)
+    {
+        // Nothing in the cache has any triangles left, so start again from the next triangle in
+        // the original order (which exporters usually write in some spatially coherent order)
+        if(bestTriangle < 0)
+        {
+            while(drawn[nextUndrawn])
+            {
+                nextUndrawn++;
+            }
+            bestTriangle = nextUndrawn;
+        }
+
+        const unsigned int* corners = &indices[3*bestTriangle];
+        memcpy(&output[3*outputTriangle], corners, 3*sizeof(unsigned int));
+        drawn[bestTriangle] = 1;
+
+        // Take the triangle out of its vertices' lists of remaining triangles
+        for(int corner=0; corner<3; corner++)
+        {
+            int vertex = corners[corner];
+            int* triangles = &adjacency[adjacencyOffsets[vertex]];
+            int count = remaining[vertex];
+            for(int i=0; i<count; i++)
+            {
+                if(triangles[i] == bestTriangle)
+                {
+                    triangles[i] = triangles[count-1];
+                    triangles[count-1] = bestTriangle;
+                    break;
+                }
+            }
+            remaining[vertex]--;
+        }
+
+        // The triangle's vertices move to the front of the cache, pushing the rest back
+        int newCache[forsythCacheSize + 3];
+        int newCacheCount = 0;
+        for(int corner=0; corner<3; corner++)
+        {
+            int vertex = corners[corner];
+            if((newCacheCount == 0) || ((newCache[0] != vertex) && ((newCacheCount == 1) || (newCache[1] != vertex))))
+            {
+                newCache[newCacheCount++] = vertex;
+            }
+        }
+        for(int i=0; i<cacheCount; i++)
+        {
+            int vertex = cache[i];
+            if((vertex != (int)corners[0]) && (vertex != (int)corners[1]) && (vertex != (int)corners[2]))
+            {
+                newCache[newCacheCount++] = vertex;
+            }
+        }
+
+        // Rescore everything that was or is in the cache, then pick the best triangle touching the
+        // cache for next time
+        bestTriangle = -1;
+        bestScore = -1.0f;
+        for(int i=0; i<newCacheCount; i++)
+        {
+            int vertex = newCache[i];
+            int position = (i < forsythCacheSize) ? i : -1;
+            cachePositions[vertex] = position;
+
+            float score = forsythVertexScore(position, remaining[vertex], cacheScores, valenceScores);
+            float scoreChange = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+
+            const int* triangles = &adjacency[adjacencyOffsets[vertex]];
+            for(int j=0; j<remaining[vertex]; j++)
+            {
+                triangleScores[triangles[j]] += scoreChange;
+            }
+        }
+        for(int i=0; (i<newCacheCount) && (i<forsythCacheSize); i++)
+        {
+            int vertex = newCache[i];
+            const int* triangles = &adjacency[adjacencyOffsets[vertex]];
+            for(int j=0; j<remaining[vertex]; j++)
+            {
+                if(triangleScores[triangles[j]] > bestScore)
+                {
+                    bestTriangle = triangles[j];
+                    bestScore = triangleScores[triangles[j]];
+                }
+            }
+        }
+
+        cacheCount = (newCacheCount < forsythCacheSize) ? newCacheCount : forsythCacheSize;
+        memcpy(cache, newCache, cacheCount*sizeof(int));
+    }
+
+    memcpy(indices, &output[0], 3*triangleCount*sizeof(unsigned int));
+}
+
+VertexFetchStats analyzeVertexFetch(const unsigned int* indices, int indexCount, int vertexCount,
+                                    int vertexSize, int cacheLineSize, int cacheLineCount)
+{
+    // NOTE: The same timestamp trick as analyzeVertexCache, but per cache line
+    int lineCount = (int)(((long long)vertexCount * vertexSize + cacheLineSize - 1) / cacheLineSize);
+    vector<unsigned int> addedTime(lineCount, 0);
+    unsigned int time = cacheLineCount + 1;
+    vector<char> used(vertexCount, 0);
+    int usedVertexCount = 0;
+
+    VertexFetchStats stats;
+    stats.cacheLineMissCount = 0;
+    for(int i=0; i<indexCount; i++)
+    {
+        unsigned int vertex = indices[i];
+        usedVertexCount += used[vertex] ? 0 : 1;
+        used[vertex] = 1;
+
+        // A vertex can straddle cache lines
+        long long start = (long long)vertex * vertexSize;
+        int firstLine = (int)(start / cacheLineSize);
+        int lastLine = (int)((start + vertexSize - 1) / cacheLineSize);
+        for(int line=firstLine; line<=lastLine; line++)
+        {
+            if(time - addedTime[line] > (unsigned int)cacheLineCount)
+            {
+                addedTime[line] = time++;
+                stats.cacheLineMissCount++;
+            }
+        }
+    }
+
+    double usedBytes = (double)usedVertexCount * vertexSize;
+    double fetchedBytes = (double)stats.cacheLineMissCount * cacheLineSize;
+    stats.overfetch = (usedBytes > 0.0) ? (float)(fetchedBytes / usedBytes) : 0.0f;
+    return stats;
+}
+
+int optimizeVertexFetch(unsigned int* indices, int indexCount, int vertexCount, unsigned int* remap)
+{
+    const unsigned int unused = ~0u;
+    for(int vertex=0; vertex<vertexCount; vertex++)
+    {
+        remap[vertex] = unused;
+    }
+
+    unsigned int nextVertex = 0;
+    for(int i=0; i<indexCount; i++)
+    {
+        unsigned int& vertex = remap[indices[i]];
+        if(vertex == unused)
+        {
+            vertex = nextVertex++;
+        }
+        indices[i] = vertex;
+    }
+    int usedVertexCount = nextVertex;
+
+    for(int vertex=0; vertex<vertexCount; vertex++)
+    {
+        if(remap[vertex] == unused)
+        {
+            remap[vertex] = nextVertex++;
+        }
+    }
+    return usedVertexCount;
+}
+
+// Rasterizes one view of the mesh into depth. axis and direction pick which way we look along,
+// and the mesh has already been scaled into [0, 1]. NOTE: Pixel centers are sampled, and both
+// windings are rasterized the same way since back faces were culled in 3D beforehand
+static void rasterizeOverdrawView(const unsigned int* indices, int indexCount,
+                                  const vector<glm::vec3>& points, int axis, float direction,
+                                  int resolution, vector<float>& depth, OverdrawStats& stats)
+{
+    int uAxis = (axis + 1) % 3;
+    int vAxis = (axis + 2) % 3;
+    depth.assign(resolution*resolution, 2.0f);
+
+    for(int i=0; i+2<indexCount; i+=3)
+    {
+        const glm::vec3& a = points[indices[i]];
+        const glm::vec3& b = points[indices[i+1]];
+        const glm::vec3& c = points[indices[i+2]];
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        if(normal[axis] * direction <= 0.0f)
+        {
+            continue;
+        }
+
+        // Screen space, with depth growing away from the viewer
+        glm::vec3 sa(a[uAxis] * resolution, a[vAxis] * resolution, 0.5f - (a[axis] - 0.5f) * direction);
+        glm::vec3 sb(b[uAxis] * resolution, b[vAxis] * resolution, 0.5f - (b[axis] - 0.5f) * direction);
+        glm::vec3 sc(c[uAxis] * resolution, c[vAxis] * resolution, 0.5f - (c[axis] - 0.5f) * direction);
+        float area = (sb.x - sa.x) * (sc.y - sa.y) - (sb.y - sa.y) * (sc.x - sa.x);
+        if(area == 0.0f)
+        {
+            continue;
+        }
+
+        int minX = max(0, (int)floorf(min(sa.x, min(sb.x, sc.x))));
+        int maxX = min(resolution - 1, (int)ceilf(max(sa.x, max(sb.x, sc.x))));
+        int minY = max(0, (int)floorf(min(sa.y, min(sb.y, sc.y))));
+        int maxY = min(resolution - 1, (int)ceilf(max(sa.y, max(sb.y, sc.y))));
+        float invArea = 1.0f / area;
+        for(int y=minY; y<=maxY; y++)
+        {
+            float py = y + 0.5f;
+            for(int x=minX; x<=maxX; x++)
+            {
+                float px = x + 0.5f;
+                // The barycentric weights of a, b and c, all >= 0 inside the triangle whichever
+                // way around it is
+                float wa = ((sb.x - px) * (sc.y - py) - (sb.y - py) * (sc.x - px)) * invArea;
+                float wb = ((sc.x - px) * (sa.y - py) - (sc.y - py) * (sa.x - px)) * invArea;
+                float wc = 1.0f - wa - wb;
+                if((wa < 0.0f) || (wb < 0.0f) || (wc < 0.0f))
+                {
+                    continue;
+                }
+                float z = wa * sa.z + wb * sb.z + wc * sc.z;
+                float& pixelDepth = depth[y*resolution + x];
+                if(z < pixelDepth)
+                {
+                    stats.coveredPixelCount += (pixelDepth > 1.5f) ? 1 : 0;
+                    stats.shadedPixelCount++;
+                    pixelDepth = z;
+                }
+            }
+        }
+    }
+}
+
+OverdrawStats analyzeOverdraw(const unsigned int* indices, int indexCount, const float* positions,
+                              int vertexCount, int resolution)
+{
+    OverdrawStats stats;
+    stats.coveredPixelCount = 0;
+    stats.shadedPixelCount = 0;
+    stats.overdraw = 0.0f;
+    if((indexCount < 3) || (vertexCount == 0))
+    {
+        return stats;
+    }
+
+    // Scale the mesh uniformly into the unit cube, so every view sees all of it
+    glm::vec3 minPosition(positions[0], positions[1], positions[2]);
+    glm::vec3 maxPosition = minPosition;
+    for(int vertex=1; vertex<vertexCount; vertex++)
+    {
+        glm::vec3 position(positions[3*vertex], positions[3*vertex+1], positions[3*vertex+2]);
+        minPosition = glm::min(minPosition, position);
+        maxPosition = glm::max(maxPosition, position);
+    }
+    glm::vec3 extent = maxPosition - minPosition;
+    float size = max(extent.x, max(extent.y, extent.z));
+    float scale = (size > 0.0f) ? 1.0f / size : 1.0f;
+    vector<glm::vec3> points(vertexCount);
+    for(int vertex=0; vertex<vertexCount; vertex++)
+    {
+        glm::vec3 position(positions[3*vertex], positions[3*vertex+1], positions[3*vertex+2]);
+        points[vertex] = (position - minPosition) * scale;
+    }
+
+    vector<float> depth;
+    for(int axis=0; axis<3; axis++)
+    {
+        rasterizeOverdrawView(indices, indexCount, points, axis, 1.0f, resolution, depth, stats);
+        rasterizeOverdrawView(indices, indexCount, points, axis, -1.0f, resolution, depth, stats);
+    }
+    stats.overdraw = (stats.coveredPixelCount > 0) ?
+                     (float)stats.shadedPixelCount / stats.coveredPixelCount : 0.0f;
+    return stats;
+}
+
+// The FIFO cache simulation from analyzeVertexCache, one triangle at a time. Returns how many of
+// its vertices missed
+static int simulateTriangle(const unsigned int* corners, vector<unsigned int>& addedTime,
+                            unsigned int& time, int cacheSize)
+{
+    int misses = 0;
+    for(int corner=0; corner<3; corner++)
+    {
+        unsigned int vertex = corners[corner];
+        if(time - addedTime[vertex] > (unsigned int)cacheSize)
+        {
+            addedTime[vertex] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+// Starts the cache simulation again from empty. Moving the clock on far enough makes every vertex
+// old enough to have dropped out, without touching them all
+static void resetCacheSimulation(unsigned int& time, int cacheSize)
+{
+    time += cacheSize + 1;
+}
+
+void optimizeOverdraw(unsigned int* indices, int indexCount, const float* positions, int vertexCount,
+                      float threshold)
+{
+    const int cacheSize = 16;
+    int triangleCount = indexCount / 3;
+    if(triangleCount < 2)
+    {
+        return;
+    }
+
+    // NOTE: Where all 3 of a triangle's vertices miss, the vertex cache optimizer has moved on to a
+    //       part of the mesh it hadn't touched yet, so these places can be cut apart without losing
+    //       anything
+    vector<unsigned int> addedTime(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    vector<int> hardBoundaries;
+    for(int triangle=0; triangle<triangleCount; triangle++)
+    {
+        if((simulateTriangle(&indices[3*triangle], addedTime, time, cacheSize) == 3) || (triangle == 0))
+        {
+            hardBoundaries.push_back(triangle);
+        }
+    }
+    hardBoundaries.push_back(triangleCount);
+
+    // Then cut each of those up further as soon as the triangles since the last cut reach the ACMR
+    // it has as a whole (times threshold). Clusters get drawn in a different order, so each one
+    // starts with an empty cache
+    vector<int> clusters;
+    for(size_t hard=0; hard+1<hardBoundaries.size(); hard++)
+    {
+        int start = hardBoundaries[hard];
+        int end = hardBoundaries[hard+1];
+        resetCacheSimulation(time, cacheSize);
+        int misses = 0;
+        for(int triangle=start; triangle<end; triangle++)
+        {
+            misses += simulateTriangle(&indices[3*triangle], addedTime, time, cacheSize);
+        }
+        float targetACMR = threshold * misses / (end - start);
+
+        clusters.push_back(start);
+        resetCacheSimulation(time, cacheSize);
+        int runningMisses = 0;
+        int runningTriangles = 0;
+        for(int triangle=start; triangle<end; triangle++)
+        {
+            runningMisses += simulateTriangle(&indices[3*triangle], addedTime, time, cacheSize);
+            runningTriangles++;
+            if(((float)runningMisses / runningTriangles <= targetACMR) && (triangle + 1 < end))
+            {
+                clusters.push_back(triangle + 1);
+                resetCacheSimulation(time, cacheSize);
+                runningMisses = 0;
+                runningTriangles = 0;
+            }
+        }
+
+        // NOTE: The last cluster is whatever was left over, which is often just a few triangles
+        //       with a terrible ACMR, so small ones are better off staying with the one before
+        if((clusters.back() != start) && (runningTriangles < 8))
+        {
+            clusters.pop_back();
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // Each cluster's (area weighted) centroid and normal. How far out along its normal it is from
+    // the middle of the mesh says how likely it is to hide other parts of the mesh
+    int clusterCount = (int)clusters.size() - 1;
+    vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+    vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+    vector<float> areas(clusterCount, 0.0f);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for(int cluster=0; cluster<clusterCount; cluster++)
+    {
+        for(int triangle=clusters[cluster]; triangle<clusters[cluster+1]; triangle++)
+        {
+            const unsigned int* corners = &indices[3*triangle];
+            glm::vec3 a(positions[3*corners[0]], positions[3*corners[0]+1], positions[3*corners[0]+2]);
+            glm::vec3 b(positions[3*corners[1]], positions[3*corners[1]+1], positions[3*corners[1]+2]);
+            glm::vec3 c(positions[3*corners[2]], positions[3*corners[2]+1], positions[3*corners[2]+2]);
+            glm::vec3 normal = glm::cross(b - a, c - a);
+            float area = glm::length(normal);
+            centroids[cluster] += (a + b + c) * (area / 3.0f);
+            normals[cluster] += normal;
+            areas[cluster] += area;
+        }
+        meshCentroid += centroids[cluster];
+        meshArea += areas[cluster];
+    }
+    if(meshArea > 0.0f)
+    {
+        meshCentroid /= meshArea;
+    }
+
+    vector<pair<float, int> > sortKeys(clusterCount);
+    for(int cluster=0; cluster<clusterCount; cluster++)
+    {
+        float key = 0.0f;
+        float normalLength = glm::length(normals[cluster]);
+        if((areas[cluster] > 0.0f) && (normalLength > 0.0f))
+        {
+            glm::vec3 centroid = centroids[cluster] / areas[cluster];
+            key = glm::dot(centroid - meshCentroid, normals[cluster] / normalLength);
+        }
+        // Negated so that sorting puts the outermost first
+        sortKeys[cluster] = make_pair(-key, cluster);
+    }
+    stable_sort(sortKeys.begin(), sortKeys.end());
+
+    vector<unsigned int> output;
+    output.reserve(3*triangleCount);
+    for(int i=0; i<clusterCount; i++)
+    {
+        int cluster = sortKeys[i].second;
+        output.insert(output.end(), &indices[3*clusters[cluster]], &indices[3*clusters[cluster+1]]);
+    }
+    memcpy(indices, &output[0], 3*triangleCount*sizeof(unsigned int));
+}
@@ -0,0 +1,78 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+// Passes that reorder an indexed triangle list to make it cheaper for the GPU to draw, without
+// changing what it draws. They work on plain index arrays, so they can be run on any range of a
+// mesh's indices (eg. one material at a time).
+
+// How well an index buffer uses a FIFO post-transform vertex cache with cacheSize entries
+struct VertexCacheStats
+{
+    int transformedVertexCount; // Cache misses, ie. vertex shader invocations
+    float acmr;                 // Average cache miss ratio: misses per triangle, from 3 down to ~0.5
+    float atvr;                 // Average transform to vertex ratio: misses per vertex used, 1 is ideal
+};
+
+// Simulates drawing indices through a FIFO vertex cache, which is what most GPUs have (or are close
+// to). indices refer to vertexCount vertices
+VertexCacheStats analyzeVertexCache(const unsigned int* indices, int indexCount, int vertexCount,
+                                    int cacheSize=16);
+
+// Reorders the triangles of indices in place so that triangles sharing vertices are drawn close
+// together, which cuts down the vertices transformed more than once. Each triangle keeps its
+// corners in the same order, so its winding doesn't change.
+//
+// NOTE: This is Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": every vertex gets a score
+//       from its position in a simulated LRU cache and how many of its triangles are left to draw
+//       (vertices with few left are worth finishing off), and we greedily draw the triangle with
+//       the highest total score among those touching the cache. It doesn't assume any particular
+//       cache size, so works well for FIFO and LRU caches of any size up to 32.
+void optimizeVertexCache(unsigned int* indices, int indexCount, int vertexCount);
+
+// How well drawing indices uses the memory cache that vertex attributes are fetched through, for
+// vertices of vertexSize bytes each stored one after another
+struct VertexFetchStats
+{
+    int cacheLineMissCount; // Cache lines read from memory
+    float overfetch;        // Bytes read per byte of the vertices used, 1 is ideal
+};
+
+// Simulates fetching the vertices of indices through a FIFO cache of cacheLineCount lines of
+// cacheLineSize bytes (16KB by default, around the size of a GPU's vertex fetch cache or a CPU's L1)
+VertexFetchStats analyzeVertexFetch(const unsigned int* indices, int indexCount, int vertexCount,
+                                    int vertexSize, int cacheLineSize=64, int cacheLineCount=256);
+
+// Renumbers the vertices in the order indices first use them, so that fetching them walks through
+// memory mostly in order. Run it after optimizeVertexCache, which decides that order. indices are
+// rewritten in place, and remap gets the new number of each of the vertexCount old vertices, which
+// the vertex attributes then have to be moved by (vertices that aren't used go at the end, in
+// their old order). Returns the number of vertices that are used
+int optimizeVertexFetch(unsigned int* indices, int indexCount, int vertexCount, unsigned int* remap);
+
+// How many times each pixel gets shaded drawing indices with depth testing and back face culling,
+// averaged over several views
+struct OverdrawStats
+{
+    long long coveredPixelCount; // Pixels the mesh ends up covering
+    long long shadedPixelCount;  // Pixels that passed the depth test, so would have been shaded
+    float overdraw;              // Shaded per covered, 1 is ideal
+};
+
+// Rasterizes the depth of the triangles (counter-clockwise front faces) in order, orthographically
+// from the 6 axis directions at resolution x resolution pixels. positions are 3 floats per vertex
+OverdrawStats analyzeOverdraw(const unsigned int* indices, int indexCount, const float* positions,
+                              int vertexCount, int resolution=256);
+
+// Reorders the triangles so that the ones likely to hide the rest are drawn first, which cuts down
+// on pixels being shaded only to be covered up later. Run it after optimizeVertexCache: it splits
+// that order into clusters, each of which still has an ACMR within threshold times that of the
+// stretch of triangles it came from, and only reorders whole clusters. So 1 keeps almost all of
+// the vertex cache efficiency, and higher values trade more of it for less overdraw.
+//
+// NOTE: This is the approach of AMD's Tootle ("Fast Triangle Reordering for Vertex Locality and
+//       Reduced Overdraw", Sander et al.): clusters facing away from the middle of the mesh are on
+//       its outside, so they are drawn first
+void optimizeOverdraw(unsigned int* indices, int indexCount, const float* positions, int vertexCount,
+                      float threshold=1.05f);
+
+#endif
@@ -0,0 +1,324 @@
+#ifndef OBJ_SCANNER_H
+#define OBJ_SCANNER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Hand-written tokenizing helpers used by the memory-mapped OBJ loader. They work on a
+// [pointer, end) range directly over the file bytes (which are not null-terminated), never touch
+// iostreams and never look at the current locale, so they stay cheap on multi-gigabyte files.
+//
+// NOTE: objScanFloat produces the correctly rounded float for its input (the same value that
+//       operator>> gives us), which is what lets the mapped loader produce bit-identical output
+//       to the stream loader.
+
+inline bool objIsSpace(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f');
+}
+
+inline bool objIsDigit(char c)
+{
+    return (unsigned char)(c - '0') < 10;
+}
+
+inline const char* objSkipSpaces(const char* p, const char* end)
+{
+    while((p < end) && objIsSpace(*p))
+    {
+        p++;
+    }
+    return p;
+}
+
+// Returns a pointer to the '\n' ending the line that starts at p (or end if there isn't one)
+inline const char* objFindLineEnd(const char* p, const char* end)
+{
+    const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+    return lineEnd ? lineEnd : end;
+}
+
+// True if the line [lineStart, lineEnd) ends in a '\', meaning that the statement continues on the
+// next line
+inline bool objLineContinues(const char* lineStart, const char* lineEnd)
+{
+    if((lineEnd > lineStart) && (lineEnd[-1] == '\r'))
+    {
+        lineEnd--;
+    }
+    return (lineEnd > lineStart) && (lineEnd[-1] == '\\');
+}
+
+// Like objFindLineEnd, but for a whole statement, ie. including any continuation lines
+inline const char* objFindStatementEnd(const char* p, const char* end)
+{
+    const char* lineEnd = objFindLineEnd(p, end);
+    while((lineEnd < end) && objLineContinues(p, lineEnd))
+    {
+        p = lineEnd + 1;
+        lineEnd = objFindLineEnd(p, end);
+    }
+    return lineEnd;
+}
+
+// Copies the statement in [p, statementEnd) to joined as a single line, with each '\' and the line
+// break after it replaced by a space
+inline void objJoinContinuedLines(const char* p, const char* statementEnd, std::string& joined)
+{
+    joined.clear();
+    while(p < statementEnd)
+    {
+        const char* lineEnd = objFindLineEnd(p, statementEnd);
+        const char* dataEnd = lineEnd;
+        if(objLineContinues(p, lineEnd))
+        {
+            dataEnd -= (dataEnd[-1] == '\r') ? 2 : 1;
+        }
+        joined.append(p, dataEnd);
+        if(lineEnd < statementEnd)
+        {
+            joined += ' ';
+        }
+        p = lineEnd + 1;
+    }
+}
+
+inline bool objScanInt(const char*& p, const char* end, int& out)
+{
+    const char* c = objSkipSpaces(p, end);
+    bool negative = false;
+    if((c < end) && ((*c == '-') || (*c == '+')))
+    {
+        negative = (*c == '-');
+        c++;
+    }
+    if((c >= end) || !objIsDigit(*c))
+    {
+        return false;
+    }
+
+    int value = 0;
+    while((c < end) && objIsDigit(*c))
+    {
+        value = 10*value + (*c - '0');
+        c++;
+    }
+
+    out = negative ? -value : value;
+    p = c;
+    return true;
+}
+
+// Falls back to the C library for the rare inputs that the fast path can't round exactly
+inline bool objScanFloatSlow(const char* start, const char* tokenEnd, float& out)
+{
+    char buffer[128];
+    size_t length = tokenEnd - start;
+    if(length >= sizeof(buffer))
+    {
+        return false;
+    }
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+    out = strtof(buffer, NULL);
+    return true;
+}
+
+inline bool objScanFloat(const char*& p, const char* end, float& out)
+{
+    // NOTE: Every power of ten up to 10^22 is exactly representable as a double
+    static const double powersOfTen[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char* c = objSkipSpaces(p, end);
+    const char* start = c;
+    bool negative = false;
+    if((c < end) && ((*c == '-') || (*c == '+')))
+    {
+        negative = (*c == '-');
+        c++;
+    }
+
+    uint64_t mantissa = 0;
+    int significantDigits = 0;
+    int exponent = 0;
+    bool anyDigits = false;
+
+    while((c < end) && objIsDigit(*c))
+    {
+        anyDigits = true;
+        if(significantDigits < 19)
+        {
+            mantissa = 10*mantissa + (*c - '0');
+            if(mantissa != 0)
+            {
+                significantDigits++;
+            }
+        }
+        else
+        {
+            exponent++;
+        }
+        c++;
+    }
+    if((c < end) && (*c == '.'))
+    {
+        c++;
+        while((c < end) && objIsDigit(*c))
+        {
+            anyDigits = true;
+            if(significantDigits < 19)
+            {
+                mantissa = 10*mantissa + (*c - '0');
+                if(mantissa != 0)
+                {
+                    significantDigits++;
+                }
+                exponent--;
+            }
+            c++;
+        }
+    }
+    if(!anyDigits)
+    {
+        return false;
+    }
+    bool truncated = (significantDigits >= 19);
+
+    if((c < end) && ((*c == 'e') || (*c == 'E')))
+    {
+        const char* exponentStart = c;
+        c++;
+        bool negativeExponent = false;
+        if((c < end) && ((*c == '-') || (*c == '+')))
+        {
+            negativeExponent = (*c == '-');
+            c++;
+        }
+        if((c < end) && objIsDigit(*c))
+        {
+            int explicitExponent = 0;
+            while((c < end) && objIsDigit(*c))
+            {
+                if(explicitExponent < 10000)
+                {
+                    explicitExponent = 10*explicitExponent + (*c - '0');
+                }
+                c++;
+            }
+            exponent += negativeExponent ? -explicitExponent : explicitExponent;
+        }
+        else
+        {
+            // Not actually an exponent, so leave the 'e' for whoever is next
+            c = exponentStart;
+        }
+    }
+    p = c;
+
+    if(mantissa == 0)
+    {
+        out = negative ? -0.0f : 0.0f;
+        return true;
+    }
+
+    // NOTE: This is Clinger's fast path: with a mantissa that fits in 53 bits and a power of ten
+    //       that is exact as a double, a single multiply/divide gives the correctly rounded
+    //       double. Rounding that double to float is only ambiguous if it landed exactly on the
+    //       halfway point between two floats, in which case we let strtof sort it out.
+    if(!truncated && (mantissa <= (1ull << 53)) && (exponent >= -22) && (exponent <= 22))
+    {
+        double value = (double)mantissa;
+        if(exponent < 0)
+        {
+            value /= powersOfTen[-exponent];
+        }
+        else
+        {
+            value *= powersOfTen[exponent];
+        }
+
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        if((bits & 0x1FFFFFFFull) != 0x10000000ull)
+        {
+            out = (float)(negative ? -value : value);
+            return true;
+        }
+    }
+
+    return objScanFloatSlow(start, c, out);
+}
+
+// The v/vt/vn triple that identifies a unique vertex in the final, indexed, data
+struct VertexKey
+{
+    int vertexIndex;
+    int texCoordIndex;
+    int normalIndex;
+
+    bool operator==(const VertexKey& other) const
+    {
+        return (vertexIndex == other.vertexIndex) &&
+               (texCoordIndex == other.texCoordIndex) &&
+               (normalIndex == other.normalIndex);
+    }
+};
+
+// Converts an OBJ index to a 0-based one. Positive indices are 1-based, and negative ones count
+// back from the end of the records read so far (count of them), so -1 is the latest one. Anything
+// that doesn't end up at one of those records (including 0, which isn't valid either way) comes
+// out as -1, ie. missing.
+inline int objResolveIndex(int index, int count)
+{
+    int resolved = (index >= 0) ? (index - 1) : (count + index);
+    return ((resolved >= 0) && (resolved < count)) ? resolved : -1;
+}
+
+// Reads the corners of a face record (everything after the 'f'), converting the OBJ's indices to
+// 0-based ones. The counts are how many v/vt/vn records come before the face, which every index
+// has to refer to. Like the stream loader, a missing texture coord/normal index carries over
+// from the previous corner, and one that doesn't refer to a record is treated as missing. Returns
+// false if a corner's position doesn't refer to a record, in which case the face should be dropped
+inline bool objScanFaceCorners(const char*& p, const char* lineEnd, std::vector<VertexKey>& corners,
+                               int vertexCount, int texCoordCount, int normalCount)
+{
+    int vertIndex = 0;
+    int texCoordIndex = 0;
+    int normalIndex = 0;
+    bool validPositions = true;
+
+    corners.clear();
+    while(objScanInt(p, lineEnd, vertIndex))
+    {
+        if((p < lineEnd) && (*p == '/'))
+        {
+            p++;
+            if((p < lineEnd) && (*p != '/'))
+            {
+                objScanInt(p, lineEnd, texCoordIndex);
+            }
+            if((p < lineEnd) && (*p == '/'))
+            {
+                p++;
+                objScanInt(p, lineEnd, normalIndex);
+            }
+        }
+
+        VertexKey corner;
+        corner.vertexIndex = objResolveIndex(vertIndex, vertexCount);
+        corner.texCoordIndex = objResolveIndex(texCoordIndex, texCoordCount);
+        corner.normalIndex = objResolveIndex(normalIndex, normalCount);
+        corners.push_back(corner);
+        validPositions = validPositions && (corner.vertexIndex >= 0);
+    }
+    return validPositions;
+}
+
+#endif
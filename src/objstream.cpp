@@ -0,0 +1,353 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#include "objstream.h"
+#include "objscanner.h"
+#include "mappedfile.h"
+#include "triangulate.h"
+
+using namespace std;
+
+// Hands out the lines of a file while only ever holding one block of it in memory
+class OBJBlockReader
+{
+public:
+    explicit OBJBlockReader(size_t blockSize)
+        : file(NULL), buffer(blockSize), dataStart(0), dataEnd(0), endOfFile(false)
+    {
+    }
+
+    ~OBJBlockReader()
+    {
+        if(file)
+        {
+            fclose(file);
+        }
+    }
+
+    bool open(const string& filename)
+    {
+        file = fopen(filename.c_str(), "rb");
+        return (file != NULL);
+    }
+
+    // lineEnd points at the '\n' (or the end of the data for the last line of the file). A line
+    // ending in a '\' is handed out joined up with the line(s) that continue it
+    bool nextLine(const char*& lineStart, const char*& lineEnd)
+    {
+        while(true)
+        {
+            const char* start = &buffer[0] + dataStart;
+            const char* end = &buffer[0] + dataEnd;
+            const char* newline = (const char*)memchr(start, '\n', end - start);
+            bool continued = false;
+            while(newline && objLineContinues(start, newline))
+            {
+                continued = true;
+                newline = (const char*)memchr(newline + 1, '\n', end - (newline + 1));
+            }
+            if(newline || (endOfFile && (start < end)))
+            {
+                lineStart = start;
+                lineEnd = newline ? newline : end;
+                dataStart = (lineEnd - &buffer[0]) + (newline ? 1 : 0);
+                if(continued)
+                {
+                    objJoinContinuedLines(lineStart, lineEnd, joinedLine);
+                    lineStart = joinedLine.data();
+                    lineEnd = lineStart + joinedLine.size();
+                }
+                return true;
+            }
+            if(endOfFile)
+            {
+                return false;
+            }
+
+            // Move the partial line to the front and fill up the rest of the block. A single line
+            // that doesn't fit in a whole block is the only thing that can make the buffer grow
+            size_t remaining = dataEnd - dataStart;
+            memmove(&buffer[0], start, remaining);
+            dataStart = 0;
+            dataEnd = remaining;
+            if(dataEnd == buffer.size())
+            {
+                buffer.resize(2*buffer.size());
+            }
+            size_t readCount = fread(&buffer[dataEnd], 1, buffer.size() - dataEnd, file);
+            dataEnd += readCount;
+            endOfFile = (readCount == 0);
+        }
+    }
+
+private:
+    FILE* file;
+    vector<char> buffer;
+    size_t dataStart;
+    size_t dataEnd;
+    bool endOfFile;
+    string joinedLine;
+};
+
+// A scratch file holding one vertex attribute array, written during the first pass and mapped
+// for random access during the second
+struct OBJSpillFile
+{
+    string filename;
+    FILE* writeFile;
+    MappedFile mapping;
+    size_t count;
+
+    OBJSpillFile() : writeFile(NULL), count(0) {}
+
+    ~OBJSpillFile()
+    {
+        if(writeFile)
+        {
+            fclose(writeFile);
+        }
+        mapping.close();
+        remove(filename.c_str());
+    }
+
+    const float* data() const
+    {
+        return (const float*)mapping.data();
+    }
+};
+
+static bool openSpillFile(OBJSpillFile& spill, const string& filename)
+{
+    spill.filename = filename;
+    spill.writeFile = fopen(filename.c_str(), "wb");
+    if(!spill.writeFile)
+    {
+        cout << "Unable to create OBJ stream scratch file: " << filename << endl;
+        return false;
+    }
+    return true;
+}
+
+// Which of the vertex attribute records (0 for v, 1 for vt and 2 for vn) the line starting at p
+// is, or -1 if it isn't one of them
+static int objVertexRecordType(const char* p, const char* lineEnd)
+{
+    if(((lineEnd - p) < 2) || (p[0] != 'v'))
+    {
+        return -1;
+    }
+    if((p[1] == ' ') || (p[1] == '\t'))
+    {
+        return 0;
+    }
+    if(p[1] == 't')
+    {
+        return 1;
+    }
+    return (p[1] == 'n') ? 2 : -1;
+}
+
+static bool mapSpillFile(OBJSpillFile& spill)
+{
+    bool written = (fclose(spill.writeFile) == 0);
+    spill.writeFile = NULL;
+    // NOTE: Empty files can't be mapped, but then there's nothing to map anyway
+    return written && ((spill.count == 0) || spill.mapping.open(spill.filename));
+}
+
+bool streamOBJFile(const string& filename, const OBJTriangleSink& sink,
+                   size_t blockSize, int batchTriangleCount, const string& scratchPrefix)
+{
+    if(batchTriangleCount < 1)
+    {
+        batchTriangleCount = 1;
+    }
+
+    // First pass: spill the v/vt/vn records out to scratch files
+    OBJSpillFile positions;
+    OBJSpillFile texCoords;
+    OBJSpillFile normals;
+    OBJSpillFile* spills[3] = {&positions, &texCoords, &normals};
+    string prefix = scratchPrefix.empty() ? filename : scratchPrefix;
+    if(!openSpillFile(positions, prefix + ".positions.tmp") ||
+       !openSpillFile(texCoords, prefix + ".texcoords.tmp") ||
+       !openSpillFile(normals, prefix + ".normals.tmp"))
+    {
+        return false;
+    }
+
+    {
+        OBJBlockReader reader(blockSize);
+        if(!reader.open(filename))
+        {
+            cout << "Unable to open obj file: " << filename << endl;
+            return false;
+        }
+
+        const char* p;
+        const char* lineEnd;
+        while(reader.nextLine(p, lineEnd))
+        {
+            p = objSkipSpaces(p, lineEnd);
+            int recordType = objVertexRecordType(p, lineEnd);
+            if(recordType < 0)
+            {
+                continue;
+            }
+            OBJSpillFile* spill = spills[recordType];
+            int componentCount = (recordType == 1) ? 2 : 3;
+
+            p += 2;
+            float values[3] = {0.0f, 0.0f, 0.0f};
+            for(int i=0; i<componentCount; i++)
+            {
+                objScanFloat(p, lineEnd, values[i]);
+            }
+            fwrite(values, sizeof(float), componentCount, spill->writeFile);
+            spill->count++;
+        }
+    }
+
+    if(!mapSpillFile(positions) || !mapSpillFile(texCoords) || !mapSpillFile(normals))
+    {
+        cout << "Unable to write OBJ stream scratch files: " << prefix << ".*.tmp" << endl;
+        return false;
+    }
+
+    // Second pass: triangulate the faces and hand them to the sink a batch at a time
+    OBJBlockReader reader(blockSize);
+    if(!reader.open(filename))
+    {
+        cout << "Unable to open obj file: " << filename << endl;
+        return false;
+    }
+
+    vector<float> batchPositions(9*batchTriangleCount);
+    vector<float> batchTexCoords;
+    vector<float> batchNormals;
+    vector<VertexKey> faceCorners;
+    vector<FaceData> faces;
+    int batchCount = 0;
+
+    // NOTE: As with the regular loaders, whether or not we have texture coords and normals is
+    //       decided by the first face
+    bool firstFace = true;
+    bool hasTextureCoords = false;
+    bool hasNormals = false;
+
+    // NOTE: Negative indices count back from the records before the face, so we keep count of
+    //       those as we go
+    int recordCounts[3] = {0, 0, 0};
+
+    const char* p;
+    const char* lineEnd;
+    while(reader.nextLine(p, lineEnd))
+    {
+        p = objSkipSpaces(p, lineEnd);
+        int recordType = objVertexRecordType(p, lineEnd);
+        if(recordType >= 0)
+        {
+            recordCounts[recordType]++;
+            continue;
+        }
+        if(((lineEnd - p) < 2) || (p[0] != 'f'))
+        {
+            continue;
+        }
+        p++;
+
+        bool validPositions = objScanFaceCorners(p, lineEnd, faceCorners, recordCounts[0], recordCounts[1],
+                                                 recordCounts[2]);
+        if(!validPositions || (faceCorners.size() < 3))
+        {
+            continue;
+        }
+        if(firstFace)
+        {
+            hasTextureCoords = (faceCorners[0].texCoordIndex >= 0) && (texCoords.count > 0);
+            hasNormals = (faceCorners[0].normalIndex >= 0) && (normals.count > 0);
+            if(hasTextureCoords)
+            {
+                batchTexCoords.resize(6*batchTriangleCount);
+            }
+            if(hasNormals)
+            {
+                batchNormals.resize(9*batchTriangleCount);
+            }
+            firstFace = false;
+        }
+
+        faces.resize(faceCorners.size() - 2);
+        triangulateOBJFace(&faceCorners[0], faceCorners.size(), positions.data(), 0, positions.count,
+                           &faces[0]);
+
+        for(size_t faceIndex=0; faceIndex<faces.size(); faceIndex++)
+        {
+            const FaceData& face = faces[faceIndex];
+            for(int vertIndex=0; vertIndex<3; vertIndex++)
+            {
+                int corner = 3*batchCount + vertIndex;
+                size_t vertexIndex = face.vertexIndex[vertIndex];
+                size_t texCoordIndex = face.texCoordIndex[vertIndex];
+                size_t normalIndex = face.normalIndex[vertIndex];
+
+                // NOTE: Out of range indices (negative ones included, thanks to the size_t) get
+                //       zeroes rather than reading past the end of the scratch files
+                for(int i=0; i<3; i++)
+                {
+                    batchPositions[3*corner + i] = (vertexIndex < positions.count) ?
+                            positions.data()[3*vertexIndex + i] : 0.0f;
+                }
+                if(hasTextureCoords)
+                {
+                    for(int i=0; i<2; i++)
+                    {
+                        batchTexCoords[2*corner + i] = (texCoordIndex < texCoords.count) ?
+                                texCoords.data()[2*texCoordIndex + i] : 0.0f;
+                    }
+                }
+                if(hasNormals)
+                {
+                    for(int i=0; i<3; i++)
+                    {
+                        batchNormals[3*corner + i] = (normalIndex < normals.count) ?
+                                normals.data()[3*normalIndex + i] : 0.0f;
+                    }
+                }
+            }
+
+            batchCount++;
+            if(batchCount == batchTriangleCount)
+            {
+                OBJTriangleBatch batch;
+                batch.positions = &batchPositions[0];
+                batch.texCoords = hasTextureCoords ? &batchTexCoords[0] : NULL;
+                batch.normals = hasNormals ? &batchNormals[0] : NULL;
+                batch.triangleCount = batchCount;
+                if(!sink(batch))
+                {
+                    return false;
+                }
+                batchCount = 0;
+            }
+        }
+    }
+
+    if(batchCount > 0)
+    {
+        OBJTriangleBatch batch;
+        batch.positions = &batchPositions[0];
+        batch.texCoords = hasTextureCoords ? &batchTexCoords[0] : NULL;
+        batch.normals = hasNormals ? &batchNormals[0] : NULL;
+        batch.triangleCount = batchCount;
+        if(!sink(batch))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef OBJ_STREAM_H
+#define OBJ_STREAM_H
+
+#include <string>
+#include <functional>
+#include <stddef.h>
+
+// Streaming OBJ loading for meshes that are too big to hold in memory. Rather than building a
+// GeometryData, the file is read a block at a time and its (unindexed) triangles are handed to a
+// sink in fixed-size batches, eg. to sub-upload into a VBO or to write out to disk.
+//
+// NOTE: Faces can refer to any vertex in the file, so the v/vt/vn data does have to be kept
+//       around. A first pass over the file spills it into scratch files which are then mapped,
+//       so it lives in the page cache (which the OS can evict) rather than in our heap. Resident
+//       memory is then bounded by the block and batch sizes, whatever the size of the file.
+
+// Each triangle in a batch has 3 corners, with 3 floats per corner for positions and normals and
+// 2 for texture coords. texCoords and normals are NULL if the mesh doesn't have them.
+struct OBJTriangleBatch
+{
+    const float* positions;
+    const float* texCoords;
+    const float* normals;
+    int triangleCount;
+};
+
+// The batch data is only valid during the call. Returning false stops the stream early
+typedef std::function<bool(const OBJTriangleBatch&)> OBJTriangleSink;
+
+// Scratch files are written to scratchPrefix + ".*.tmp", which defaults to next to the OBJ file.
+// Returns false if the file couldn't be read or the sink stopped the stream
+bool streamOBJFile(const std::string& filename, const OBJTriangleSink& sink,
+                   size_t blockSize=1024*1024, int batchTriangleCount=16384,
+                   const std::string& scratchPrefix="");
+
+#endif
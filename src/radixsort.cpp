@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <string.h>
+
+#include "radixsort.h"
+#include "threadpool.h"
+
+using namespace std;
+
+// NOTE: 11 bit digits take 3 passes for 32 bit keys and 6 for 64 bit ones rather than 4 and 8 with
+//       bytes. The counts still fit in L1, and fewer passes over the keys beat the extra cache
+//       misses from scattering them to 2048 places at once
+static const int digitBits = 11;
+static const int digitCount = 1 << digitBits;
+
+// Each thread gets at least this many keys, since below that counting them isn't worth a task
+static const int minKeysPerThread = 16384;
+
+template<typename Key>
+static void radixSort(ThreadPool& pool, Key* keys, uint32_t* values, int count, int keyBits,
+                      vector<Key>& keyScratch, vector<uint32_t>& valueScratch, vector<int>& digitOffsets)
+{
+    if(count <= 1)
+    {
+        return;
+    }
+    int partCount = max(1, min(pool.threadCount(), count / minKeysPerThread));
+    int partSize = (count + partCount - 1) / partCount;
+    if(keyScratch.size() < (size_t)count)
+    {
+        keyScratch.resize(count);
+    }
+    if(values && (valueScratch.size() < (size_t)count))
+    {
+        valueScratch.resize(count);
+    }
+    digitOffsets.resize(partCount * digitCount);
+
+    // NOTE: Passes go back and forth between the caller's arrays and the scratch ones, and the
+    //       keys only get copied back at the end if they finished in the scratch ones
+    Key* sourceKeys = keys;
+    Key* targetKeys = &keyScratch[0];
+    uint32_t* sourceValues = values;
+    uint32_t* targetValues = values ? &valueScratch[0] : NULL;
+    for(int shift=0; shift<keyBits; shift+=digitBits)
+    {
+        // The last digit only gets the bits up to keyBits, so the ones above don't affect the order
+        int digitMask = (1 << min(digitBits, keyBits - shift)) - 1;
+        pool.parallelFor(partCount, [&](int part)
+        {
+            int* partOffsets = &digitOffsets[part * digitCount];
+            fill(partOffsets, partOffsets + digitCount, 0);
+            int partEnd = min(count, (part + 1) * partSize);
+            for(int i=part*partSize; i<partEnd; i++)
+            {
+                partOffsets[(sourceKeys[i] >> shift) & digitMask]++;
+            }
+        });
+
+        bool allSameDigit = false;
+        int total = 0;
+        for(int digit=0; digit<digitCount; digit++)
+        {
+            int digitStart = total;
+            for(int part=0; part<partCount; part++)
+            {
+                int partDigits = digitOffsets[part * digitCount + digit];
+                digitOffsets[part * digitCount + digit] = total;
+                total += partDigits;
+            }
+            allSameDigit = allSameDigit || (total - digitStart == count);
+        }
+        if(allSameDigit)
+        {
+            continue;
+        }
+
+        pool.parallelFor(partCount, [&](int part)
+        {
+            int* partOffsets = &digitOffsets[part * digitCount];
+            int partEnd = min(count, (part + 1) * partSize);
+            if(!sourceValues)
+            {
+                for(int i=part*partSize; i<partEnd; i++)
+                {
+                    targetKeys[partOffsets[(sourceKeys[i] >> shift) & digitMask]++] = sourceKeys[i];
+                }
+                return;
+            }
+            for(int i=part*partSize; i<partEnd; i++)
+            {
+                int target = partOffsets[(sourceKeys[i] >> shift) & digitMask]++;
+                targetKeys[target] = sourceKeys[i];
+                targetValues[target] = sourceValues[i];
+            }
+        });
+        swap(sourceKeys, targetKeys);
+        swap(sourceValues, targetValues);
+    }
+
+    if(sourceKeys != keys)
+    {
+        memcpy(keys, sourceKeys, count * sizeof(Key));
+        if(values)
+        {
+            memcpy(values, sourceValues, count * sizeof(uint32_t));
+        }
+    }
+}
+
+void RadixSorter::sort(ThreadPool& pool, uint32_t* keys, uint32_t* values, int count, int keyBits)
+{
+    radixSort(pool, keys, values, count, keyBits, keyScratch32, valueScratch, digitOffsets);
+}
+
+void RadixSorter::sort(ThreadPool& pool, uint64_t* keys, uint32_t* values, int count, int keyBits)
+{
+    radixSort(pool, keys, values, count, keyBits, keyScratch64, valueScratch, digitOffsets);
+}
+
+void RadixSorter::clear()
+{
+    vector<uint32_t>().swap(keyScratch32);
+    vector<uint64_t>().swap(keyScratch64);
+    vector<uint32_t>().swap(valueScratch);
+    vector<int>().swap(digitOffsets);
+}
+
+uint32_t floatSortKey(float value)
+{
+    // NOTE: Setting the sign bit of a positive float, and flipping all of the bits of a negative
+    //       one (whose bits sort backwards), makes the bits sort like the floats do. Adding 0
+    //       turns -0 into 0
+    value += 0.0f;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
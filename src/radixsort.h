@@ -0,0 +1,44 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <vector>
+#include <stdint.h>
+
+class ThreadPool;
+
+// A least significant digit first radix sort, for sorting lots of integer keys (eg. Morton codes,
+// or packed draw keys) along with a 32 bit value each (usually an index into what's being
+// sorted). Keep one around for sorts that happen over and over, since it keeps its scratch
+// buffers between calls rather than allocating them each time.
+//
+// NOTE: Each pass sorts by the next 11 bits (or fewer, for the last pass of a key whose keyBits
+//       isn't a multiple of 11). Every thread counts the digits in its own part of
+//       the keys, then moves its keys to where the counts say they go, after the keys with
+//       smaller digits and after those with the same digit in earlier parts. That keeps every
+//       pass stable, so the passes add up to a sort of the whole key. Passes where all of the
+//       keys have the same digit (like the top bits of small keys) are skipped.
+class RadixSorter
+{
+public:
+    // Sorts count keys by their lowest keyBits bits, moving values (if it isn't NULL) along with
+    // them. Any higher bits are left out of the order, but moved along with the rest of the key.
+    // The sort is stable, so keys that are the same keep the order they were in. Small
+    // sorts, or a pool with a single thread, run on the calling thread
+    void sort(ThreadPool& pool, uint32_t* keys, uint32_t* values, int count, int keyBits=32);
+    void sort(ThreadPool& pool, uint64_t* keys, uint32_t* values, int count, int keyBits=64);
+
+    // Frees the scratch buffers
+    void clear();
+
+private:
+    std::vector<uint32_t> keyScratch32;
+    std::vector<uint64_t> keyScratch64;
+    std::vector<uint32_t> valueScratch;
+    std::vector<int> digitOffsets;
+};
+
+// A key that sorts the same way as value does, so that floats can be radix sorted. -0 gets the
+// same key as 0, and NaNs go at either end
+uint32_t floatSortKey(float value);
+
+#endif
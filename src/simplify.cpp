@@ -0,0 +1,466 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "simplify.h"
+#include "radixsort.h"
+#include "threadpool.h"
+
+using namespace std;
+
+// NOTE: Positions are scaled to fit in a unit cube, so these say how much a change in the normal
+//       or texture coords counts for compared to moving all the way across the mesh
+static const float normalWeight = 0.5f;
+static const float texCoordWeight = 1.0f;
+
+// The most components a point can have: position, normal and texture coord
+static const int maxComponents = 8;
+
+// A generalized quadric over n components is the upper triangle of the symmetric n x n matrix A
+// (row by row), then the vector b, the constant c and the total area of the triangles that went
+// into it. The error of a point x is x.A.x + 2 b.x + c, an area weighted sum of squared distances
+static int quadricSize(int n)
+{
+    return n*(n+1)/2 + n + 2;
+}
+
+// Adds the quadric of the triangle (p, q, r) to quadric, weighted by area. The error of a point is
+// its squared distance from the plane through the triangle in n dimensions
+static void addTriangleQuadric(float* quadric, const float* p, const float* q, const float* r, int n,
+                               float area)
+{
+    // An orthonormal basis (e1, e2) of the triangle's plane
+    double e1[maxComponents];
+    double e2[maxComponents];
+    double length = 0.0;
+    for(int i=0; i<n; i++)
+    {
+        e1[i] = q[i] - p[i];
+        length += e1[i] * e1[i];
+    }
+    if(length <= 0.0)
+    {
+        return;
+    }
+    length = sqrt(length);
+    double along = 0.0;
+    for(int i=0; i<n; i++)
+    {
+        e1[i] /= length;
+        along += (r[i] - p[i]) * e1[i];
+    }
+    length = 0.0;
+    for(int i=0; i<n; i++)
+    {
+        e2[i] = (r[i] - p[i]) - along * e1[i];
+        length += e2[i] * e2[i];
+    }
+    if(length <= 1e-24)
+    {
+        return;
+    }
+    length = sqrt(length);
+    double pe1 = 0.0;
+    double pe2 = 0.0;
+    double pp = 0.0;
+    for(int i=0; i<n; i++)
+    {
+        e2[i] /= length;
+        pe1 += p[i] * e1[i];
+        pe2 += p[i] * e2[i];
+        pp += (double)p[i] * p[i];
+    }
+
+    // A = I - e1.e1' - e2.e2', b = (p.e1) e1 + (p.e2) e2 - p, c = p.p - (p.e1)^2 - (p.e2)^2
+    int k = 0;
+    for(int i=0; i<n; i++)
+    {
+        for(int j=i; j<n; j++)
+        {
+            double a = ((i == j) ? 1.0 : 0.0) - e1[i] * e1[j] - e2[i] * e2[j];
+            quadric[k++] += (float)(area * a);
+        }
+    }
+    for(int i=0; i<n; i++)
+    {
+        quadric[k++] += (float)(area * (pe1 * e1[i] + pe2 * e2[i] - p[i]));
+    }
+    quadric[k++] += (float)(area * (pp - pe1 * pe1 - pe2 * pe2));
+    quadric[k] += area;
+}
+
+static double evaluateQuadric(const float* quadric, const float* x, int n)
+{
+    double error = 0.0;
+    int k = 0;
+    for(int i=0; i<n; i++)
+    {
+        error += (double)quadric[k++] * x[i] * x[i];
+        for(int j=i+1; j<n; j++)
+        {
+            error += 2.0 * quadric[k++] * x[i] * x[j];
+        }
+    }
+    for(int i=0; i<n; i++)
+    {
+        error += 2.0 * quadric[k++] * x[i];
+    }
+    return error + quadric[k];
+}
+
+static float triangleArea(const float* p, const float* q, const float* r)
+{
+    float u[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+    float v[3] = { r[0] - p[0], r[1] - p[1], r[2] - p[2] };
+    float x = u[1]*v[2] - u[2]*v[1];
+    float y = u[2]*v[0] - u[0]*v[2];
+    float z = u[0]*v[1] - u[1]*v[0];
+    return 0.5f * sqrtf(x*x + y*y + z*z);
+}
+
+// The (unnormalized) normal of the triangle (p, q, r)
+static void triangleNormal(const float* p, const float* q, const float* r, float* normal)
+{
+    float u[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+    float v[3] = { r[0] - p[0], r[1] - p[1], r[2] - p[2] };
+    normal[0] = u[1]*v[2] - u[2]*v[1];
+    normal[1] = u[2]*v[0] - u[0]*v[2];
+    normal[2] = u[0]*v[1] - u[1]*v[0];
+}
+
+struct EdgeCollapse
+{
+    float error;
+    unsigned int from;
+    unsigned int to;
+};
+
+// Which vertices are welded together (have exactly the same position) and which can't move
+static void findLockedVertices(const unsigned int* indices, int indexCount, const float* positions,
+                               int vertexCount, ThreadPool& pool, RadixSorter& sorter, vector<char>& locked)
+{
+    // NOTE: Sorting by position groups the vertices that only differ in their other attributes.
+    //       They are on a seam, and moving one of them without the others would tear it open.
+    //       Sorting by z, then y, then x sorts by all three, since each sort is stable
+    vector<uint32_t> order(vertexCount);
+    for(int vertex=0; vertex<vertexCount; vertex++)
+    {
+        order[vertex] = vertex;
+    }
+    vector<uint32_t> keys(vertexCount);
+    for(int axis=2; axis>=0; axis--)
+    {
+        for(int i=0; i<vertexCount; i++)
+        {
+            keys[i] = floatSortKey(positions[3*order[i] + axis]);
+        }
+        sorter.sort(pool, keys.data(), order.data(), vertexCount);
+    }
+
+    locked.assign(vertexCount, 0);
+    vector<unsigned int> welded(vertexCount);
+    for(int start=0; start<vertexCount; )
+    {
+        int end = start + 1;
+        while((end < vertexCount) && equal(&positions[3*order[start]], &positions[3*order[start] + 3],
+                                           &positions[3*order[end]]))
+        {
+            end++;
+        }
+        for(int i=start; i<end; i++)
+        {
+            welded[order[i]] = order[start];
+            locked[order[i]] = (end - start > 1) ? 1 : 0;
+        }
+        start = end;
+    }
+
+    // An edge (between welded vertices) that doesn't have exactly 2 triangles is on a border (or
+    // is non-manifold), so both its ends stay where they are
+    vector<uint64_t> edges;
+    edges.reserve(indexCount);
+    for(int i=0; i+2<indexCount; i+=3)
+    {
+        for(int corner=0; corner<3; corner++)
+        {
+            uint64_t a = welded[indices[i + corner]];
+            uint64_t b = welded[indices[i + (corner + 1) % 3]];
+            if(a != b)
+            {
+                edges.push_back((min(a, b) << 32) | max(a, b));
+            }
+        }
+    }
+    sorter.sort(pool, edges.data(), NULL, edges.size());
+    vector<char> weldedLocked(vertexCount, 0);
+    for(size_t start=0; start<edges.size(); )
+    {
+        size_t end = start + 1;
+        while((end < edges.size()) && (edges[end] == edges[start]))
+        {
+            end++;
+        }
+        if(end - start != 2)
+        {
+            weldedLocked[edges[start] >> 32] = 1;
+            weldedLocked[edges[start] & 0xffffffffu] = 1;
+        }
+        start = end;
+    }
+    for(int vertex=0; vertex<vertexCount; vertex++)
+    {
+        locked[vertex] |= weldedLocked[welded[vertex]];
+    }
+}
+
+int simplifyMesh(unsigned int* destination, const unsigned int* indices, int indexCount,
+                 const float* positions, const float* normals, const float* texCoords, int vertexCount,
+                 int targetIndexCount, float* resultError)
+{
+    indexCount -= indexCount % 3;
+    memcpy(destination, indices, indexCount*sizeof(unsigned int));
+    if(resultError)
+    {
+        *resultError = 0.0f;
+    }
+    if((indexCount <= targetIndexCount) || (vertexCount == 0))
+    {
+        return indexCount;
+    }
+
+    // Every vertex as one point in n dimensions, with the position scaled into the unit cube
+    int n = 3 + (normals ? 3 : 0) + (texCoords ? 2 : 0);
+    float minPosition[3] = { positions[0], positions[1], positions[2] };
+    float maxPosition[3] = { positions[0], positions[1], positions[2] };
+    for(int vertex=1; vertex<vertexCount; vertex++)
+    {
+        for(int axis=0; axis<3; axis++)
+        {
+            minPosition[axis] = min(minPosition[axis], positions[3*vertex + axis]);
+            maxPosition[axis] = max(maxPosition[axis], positions[3*vertex + axis]);
+        }
+    }
+    float size = max(maxPosition[0] - minPosition[0],
+                     max(maxPosition[1] - minPosition[1], maxPosition[2] - minPosition[2]));
+    float scale = (size > 0.0f) ? 1.0f / size : 1.0f;
+    vector<float> points(vertexCount*n);
+    for(int vertex=0; vertex<vertexCount; vertex++)
+    {
+        float* point = &points[n*vertex];
+        for(int axis=0; axis<3; axis++)
+        {
+            point[axis] = (positions[3*vertex + axis] - minPosition[axis]) * scale;
+        }
+        int component = 3;
+        if(normals)
+        {
+            for(int axis=0; axis<3; axis++)
+            {
+                point[component++] = normals[3*vertex + axis] * normalWeight;
+            }
+        }
+        if(texCoords)
+        {
+            point[component++] = texCoords[2*vertex] * texCoordWeight;
+            point[component++] = texCoords[2*vertex + 1] * texCoordWeight;
+        }
+    }
+
+    // NOTE: This already runs on one of buildLODs's threads, so it sorts on this thread alone
+    ThreadPool pool(1);
+    RadixSorter sorter;
+    vector<char> locked;
+    findLockedVertices(destination, indexCount, positions, vertexCount, pool, sorter, locked);
+
+    int stride = quadricSize(n);
+    vector<float> quadrics(vertexCount*stride, 0.0f);
+    for(int i=0; i<indexCount; i+=3)
+    {
+        const float* p = &points[n*destination[i]];
+        const float* q = &points[n*destination[i+1]];
+        const float* r = &points[n*destination[i+2]];
+        float area = triangleArea(p, q, r);
+        for(int corner=0; corner<3; corner++)
+        {
+            addTriangleQuadric(&quadrics[stride*destination[i + corner]], p, q, r, n, area);
+        }
+    }
+
+    // NOTE: Each pass works out the cost of every collapse and then makes the cheapest ones that
+    //       don't overlap: a collapse changes the triangles around the vertex that moves, so no
+    //       other collapse in the same pass may touch any of their vertices. Only the cheapest third
+    //       are tried in a pass, the rest are more likely to have become cheaper by the next one
+    vector<int> adjacencyOffsets(vertexCount + 1);
+    vector<int> adjacency;
+    vector<EdgeCollapse> collapses;
+    vector<uint32_t> collapseKeys;
+    vector<uint32_t> collapseOrder;
+    vector<char> touched(vertexCount);
+    vector<unsigned int> collapseTo(vertexCount);
+    for(int vertex=0; vertex<vertexCount; vertex++)
+    {
+        collapseTo[vertex] = vertex;
+    }
+    double largestError = 0.0;
+    while(indexCount > targetIndexCount)
+    {
+        // Every vertex's triangles
+        fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for(int i=0; i<indexCount; i++)
+        {
+            adjacencyOffsets[destination[i] + 1]++;
+        }
+        for(int vertex=0; vertex<vertexCount; vertex++)
+        {
+            adjacencyOffsets[vertex+1] += adjacencyOffsets[vertex];
+        }
+        adjacency.resize(indexCount);
+        {
+            vector<int> fillOffsets(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for(int i=0; i<indexCount; i++)
+            {
+                adjacency[fillOffsets[destination[i]]++] = i / 3;
+            }
+        }
+
+        // Both ways along every edge. Interior edges are in two triangles, one each way around,
+        // so only take them from the one where they go from the lower vertex to the higher
+        collapses.clear();
+        for(int i=0; i<indexCount; i+=3)
+        {
+            for(int corner=0; corner<3; corner++)
+            {
+                unsigned int a = destination[i + corner];
+                unsigned int b = destination[i + (corner + 1) % 3];
+                if(a >= b)
+                {
+                    continue;
+                }
+                for(int direction=0; direction<2; direction++)
+                {
+                    unsigned int from = direction ? b : a;
+                    unsigned int to = direction ? a : b;
+                    if(locked[from])
+                    {
+                        continue;
+                    }
+                    const float* fromQuadric = &quadrics[stride*from];
+                    const float* toQuadric = &quadrics[stride*to];
+                    const float* point = &points[n*to];
+                    double error = evaluateQuadric(fromQuadric, point, n) +
+                                   evaluateQuadric(toQuadric, point, n);
+                    double area = fromQuadric[stride - 1] + toQuadric[stride - 1];
+                    EdgeCollapse collapse;
+                    collapse.error = (float)((area > 0.0) ? max(error, 0.0) / area : 0.0);
+                    collapse.from = from;
+                    collapse.to = to;
+                    collapses.push_back(collapse);
+                }
+            }
+        }
+        if(collapses.empty())
+        {
+            break;
+        }
+        collapseKeys.resize(collapses.size());
+        collapseOrder.resize(collapses.size());
+        for(size_t c=0; c<collapses.size(); c++)
+        {
+            collapseKeys[c] = floatSortKey(collapses[c].error);
+            collapseOrder[c] = c;
+        }
+        sorter.sort(pool, collapseKeys.data(), collapseOrder.data(), collapses.size());
+
+        fill(touched.begin(), touched.end(), 0);
+        int trianglesToRemove = (indexCount - targetIndexCount + 2) / 3;
+        int removedTriangles = 0;
+        int collapseCount = 0;
+        size_t tryCount = collapses.size() / 3 + 1;
+        for(size_t c=0; (c<tryCount) && (removedTriangles < trianglesToRemove); c++)
+        {
+            const EdgeCollapse& collapse = collapses[collapseOrder[c]];
+            if(touched[collapse.from] || touched[collapse.to])
+            {
+                continue;
+            }
+
+            // The triangles that keep their area mustn't flip over
+            const int* triangles = &adjacency[adjacencyOffsets[collapse.from]];
+            int triangleCount = adjacencyOffsets[collapse.from + 1] - adjacencyOffsets[collapse.from];
+            bool flips = false;
+            int removes = 0;
+            for(int t=0; (t<triangleCount) && !flips; t++)
+            {
+                const unsigned int* corners = &destination[3*triangles[t]];
+                if((corners[0] == collapse.to) || (corners[1] == collapse.to) || (corners[2] == collapse.to))
+                {
+                    removes++;
+                    continue;
+                }
+                const float* before[3];
+                const float* after[3];
+                for(int corner=0; corner<3; corner++)
+                {
+                    before[corner] = &points[n*corners[corner]];
+                    after[corner] = (corners[corner] == collapse.from) ? &points[n*collapse.to]
+                                                                        : before[corner];
+                }
+                float normalBefore[3];
+                float normalAfter[3];
+                triangleNormal(before[0], before[1], before[2], normalBefore);
+                triangleNormal(after[0], after[1], after[2], normalAfter);
+                float dot = normalBefore[0]*normalAfter[0] + normalBefore[1]*normalAfter[1] +
+                            normalBefore[2]*normalAfter[2];
+                flips = (dot <= 0.0f);
+            }
+            if(flips)
+            {
+                continue;
+            }
+
+            for(int t=0; t<triangleCount; t++)
+            {
+                const unsigned int* corners = &destination[3*triangles[t]];
+                touched[corners[0]] = touched[corners[1]] = touched[corners[2]] = 1;
+            }
+            touched[collapse.to] = 1;
+            collapseTo[collapse.from] = collapse.to;
+            float* fromQuadric = &quadrics[stride*collapse.from];
+            float* toQuadric = &quadrics[stride*collapse.to];
+            for(int k=0; k<stride; k++)
+            {
+                toQuadric[k] += fromQuadric[k];
+            }
+            largestError = max(largestError, (double)collapse.error);
+            removedTriangles += removes;
+            collapseCount++;
+        }
+        if(collapseCount == 0)
+        {
+            break;
+        }
+
+        // Move the collapsed vertices and drop the triangles that lost their area
+        int writeIndex = 0;
+        for(int i=0; i<indexCount; i+=3)
+        {
+            unsigned int a = collapseTo[destination[i]];
+            unsigned int b = collapseTo[destination[i+1]];
+            unsigned int c = collapseTo[destination[i+2]];
+            if((a != b) && (b != c) && (c != a))
+            {
+                destination[writeIndex++] = a;
+                destination[writeIndex++] = b;
+                destination[writeIndex++] = c;
+            }
+        }
+        indexCount = writeIndex;
+    }
+
+    if(resultError)
+    {
+        *resultError = (float)sqrt(largestError);
+    }
+    return indexCount;
+}
@@ -0,0 +1,27 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+// Reduces indexCount indices (a triangle list) to around targetIndexCount by collapsing edges,
+// writing the result to destination (which needs room for indexCount indices) and returning how
+// many it wrote. The vertices themselves are left as they are, the simplified triangles just use
+// fewer of them, so every level of detail can share the full mesh's vertex data.
+//
+// positions hold 3 floats per vertex, normals 3 and texCoords 2, and either of those can be NULL.
+// Vertices on the open borders of the mesh, and on seams where vertices with the same position
+// have different normals or texture coords, never move, so holes, material boundaries and UV
+// seams keep their shape. It can stop short of targetIndexCount if there's nothing left that can
+// be collapsed.
+//
+// If resultError isn't NULL it gets the largest error of the collapses that were made, as a
+// distance relative to the size of the mesh (so 0.01 is 1% of its largest dimension).
+//
+// NOTE: Each collapse moves one end of an edge onto the other, picking the one that costs the
+//       least by Garland and Heckbert's quadric error metric. The quadrics are their generalized
+//       ones ("Simplifying Surfaces with Color and Texture using Quadric Error Metrics"), in the
+//       space of position, normal and texture coord together, so collapses that would smear the
+//       normals or stretch the texture cost as much as ones that change the shape.
+int simplifyMesh(unsigned int* destination, const unsigned int* indices, int indexCount,
+                 const float* positions, const float* normals, const float* texCoords, int vertexCount,
+                 int targetIndexCount, float* resultError);
+
+#endif
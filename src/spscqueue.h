@@ -0,0 +1,78 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <vector>
+#include <atomic>
+#include <utility>
+#include <stddef.h>
+
+// A fixed-capacity, lock-free queue for handing items from exactly one producer thread to exactly
+// one consumer thread. Neither side ever blocks: push fails when the queue is full and pop fails
+// when it is empty, so the render thread can poll it every frame without ever stalling.
+//
+// NOTE: This is the usual ring buffer with one empty slot to tell full from empty. The producer
+//       only writes tail and the consumer only writes head, and each publishes its slot with a
+//       release store that the other side picks up with an acquire load.
+template <typename T>
+class SPSCQueue
+{
+public:
+    explicit SPSCQueue(size_t capacity)
+        : slots(capacity + 1), head(0), tail(0)
+    {
+    }
+
+    // Producer only. Moves item into the queue, or leaves it alone and returns false if full
+    bool push(T& item)
+    {
+        size_t currentTail = tail.load(std::memory_order_relaxed);
+        size_t nextTail = next(currentTail);
+        if(nextTail == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        slots[currentTail] = std::move(item);
+        tail.store(nextTail, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Moves the oldest item out into item, or returns false if there isn't one
+    bool pop(T& item)
+    {
+        size_t currentHead = head.load(std::memory_order_relaxed);
+        if(currentHead == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = std::move(slots[currentHead]);
+        slots[currentHead] = T();
+        head.store(next(currentHead), std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only (from the producer it can only be a hint)
+    bool empty() const
+    {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+
+private:
+    SPSCQueue(const SPSCQueue&) = delete;
+    SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+    size_t next(size_t index) const
+    {
+        return (index + 1 == slots.size()) ? 0 : index + 1;
+    }
+
+    std::vector<T> slots;
+
+    // NOTE: head and tail are written by different threads, so they're kept on separate cache
+    //       lines to stop each write from invalidating the other thread's copy
+    std::atomic<size_t> head;
+    char headPadding[64];
+    std::atomic<size_t> tail;
+    char tailPadding[64];
+};
+
+#endif
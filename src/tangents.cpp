@@ -0,0 +1,312 @@
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include "glm/glm.hpp"
+#include "tangents.h"
+
+// NOTE: glm/detail/setup.hpp has already worked out which instruction sets the compiler is
+//       targeting (and included the intrinsics headers for them), so we just follow its lead.
+//       The default x86-64 build gets SSE2, building with -mavx (or /arch:AVX) gets AVX
+
+static void faceTangentsScalar(const TriangleBatch& triangles, int start, int end,
+                               const FaceTangentBatch& faceTangents)
+{
+    for(int i=start; i<end; i++)
+    {
+        float edge1X = triangles.x[1][i] - triangles.x[0][i];
+        float edge1Y = triangles.y[1][i] - triangles.y[0][i];
+        float edge1Z = triangles.z[1][i] - triangles.z[0][i];
+        float edge2X = triangles.x[2][i] - triangles.x[0][i];
+        float edge2Y = triangles.y[2][i] - triangles.y[0][i];
+        float edge2Z = triangles.z[2][i] - triangles.z[0][i];
+        float deltaU1 = triangles.u[1][i] - triangles.u[0][i];
+        float deltaV1 = triangles.v[1][i] - triangles.v[0][i];
+        float deltaU2 = triangles.u[2][i] - triangles.u[0][i];
+        float deltaV2 = triangles.v[2][i] - triangles.v[0][i];
+
+        float det = deltaU1*deltaV2 - deltaU2*deltaV1;
+        float crossX = edge1Y*edge2Z - edge1Z*edge2Y;
+        float crossY = edge1Z*edge2X - edge1X*edge2Z;
+        float crossZ = edge1X*edge2Y - edge1Y*edge2X;
+        float area = sqrtf(crossX*crossX + crossY*crossY + crossZ*crossZ);
+
+        // NOTE: These are the tangent and bitangent scaled by det, which we don't need to divide
+        //       out since we rescale them to the area anyway (but we do need its sign)
+        float tangentX = edge1X*deltaV2 - edge2X*deltaV1;
+        float tangentY = edge1Y*deltaV2 - edge2Y*deltaV1;
+        float tangentZ = edge1Z*deltaV2 - edge2Z*deltaV1;
+        float bitangentX = edge2X*deltaU1 - edge1X*deltaU2;
+        float bitangentY = edge2Y*deltaU1 - edge1Y*deltaU2;
+        float bitangentZ = edge2Z*deltaU1 - edge1Z*deltaU2;
+        float tangentLength = sqrtf(tangentX*tangentX + tangentY*tangentY + tangentZ*tangentZ);
+        float bitangentLength = sqrtf(bitangentX*bitangentX + bitangentY*bitangentY + bitangentZ*bitangentZ);
+
+        float tangentScale = 0.0f;
+        float bitangentScale = 0.0f;
+        if((det != 0.0f) && (area != 0.0f) && (tangentLength != 0.0f) && (bitangentLength != 0.0f))
+        {
+            tangentScale = area / tangentLength;
+            bitangentScale = area / bitangentLength;
+            if(det < 0.0f)
+            {
+                tangentScale = -tangentScale;
+                bitangentScale = -bitangentScale;
+            }
+        }
+        faceTangents.tangentX[i] = tangentX * tangentScale;
+        faceTangents.tangentY[i] = tangentY * tangentScale;
+        faceTangents.tangentZ[i] = tangentZ * tangentScale;
+        faceTangents.bitangentX[i] = bitangentX * bitangentScale;
+        faceTangents.bitangentY[i] = bitangentY * bitangentScale;
+        faceTangents.bitangentZ[i] = bitangentZ * bitangentScale;
+    }
+}
+
+// The SIMD versions are the scalar loop above written out with intrinsics, with the degenerate
+// triangle test turned into a mask. Returns how many triangles were done, the caller finishes off
+// the rest with the scalar version
+#if GLM_ARCH & GLM_ARCH_AVX
+static int faceTangentsAVX(const TriangleBatch& triangles, int triangleCount,
+                           const FaceTangentBatch& faceTangents)
+{
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+    int i = 0;
+    for(; i+8<=triangleCount; i+=8)
+    {
+        __m256 x0 = _mm256_loadu_ps(triangles.x[0] + i);
+        __m256 y0 = _mm256_loadu_ps(triangles.y[0] + i);
+        __m256 z0 = _mm256_loadu_ps(triangles.z[0] + i);
+        __m256 u0 = _mm256_loadu_ps(triangles.u[0] + i);
+        __m256 v0 = _mm256_loadu_ps(triangles.v[0] + i);
+        __m256 edge1X = _mm256_sub_ps(_mm256_loadu_ps(triangles.x[1] + i), x0);
+        __m256 edge1Y = _mm256_sub_ps(_mm256_loadu_ps(triangles.y[1] + i), y0);
+        __m256 edge1Z = _mm256_sub_ps(_mm256_loadu_ps(triangles.z[1] + i), z0);
+        __m256 edge2X = _mm256_sub_ps(_mm256_loadu_ps(triangles.x[2] + i), x0);
+        __m256 edge2Y = _mm256_sub_ps(_mm256_loadu_ps(triangles.y[2] + i), y0);
+        __m256 edge2Z = _mm256_sub_ps(_mm256_loadu_ps(triangles.z[2] + i), z0);
+        __m256 deltaU1 = _mm256_sub_ps(_mm256_loadu_ps(triangles.u[1] + i), u0);
+        __m256 deltaV1 = _mm256_sub_ps(_mm256_loadu_ps(triangles.v[1] + i), v0);
+        __m256 deltaU2 = _mm256_sub_ps(_mm256_loadu_ps(triangles.u[2] + i), u0);
+        __m256 deltaV2 = _mm256_sub_ps(_mm256_loadu_ps(triangles.v[2] + i), v0);
+
+        __m256 det = _mm256_sub_ps(_mm256_mul_ps(deltaU1, deltaV2), _mm256_mul_ps(deltaU2, deltaV1));
+        __m256 crossX = _mm256_sub_ps(_mm256_mul_ps(edge1Y, edge2Z), _mm256_mul_ps(edge1Z, edge2Y));
+        __m256 crossY = _mm256_sub_ps(_mm256_mul_ps(edge1Z, edge2X), _mm256_mul_ps(edge1X, edge2Z));
+        __m256 crossZ = _mm256_sub_ps(_mm256_mul_ps(edge1X, edge2Y), _mm256_mul_ps(edge1Y, edge2X));
+        __m256 area = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(crossX, crossX),
+                                                                 _mm256_mul_ps(crossY, crossY)),
+                                                   _mm256_mul_ps(crossZ, crossZ)));
+
+        __m256 tangentX = _mm256_sub_ps(_mm256_mul_ps(edge1X, deltaV2), _mm256_mul_ps(edge2X, deltaV1));
+        __m256 tangentY = _mm256_sub_ps(_mm256_mul_ps(edge1Y, deltaV2), _mm256_mul_ps(edge2Y, deltaV1));
+        __m256 tangentZ = _mm256_sub_ps(_mm256_mul_ps(edge1Z, deltaV2), _mm256_mul_ps(edge2Z, deltaV1));
+        __m256 bitangentX = _mm256_sub_ps(_mm256_mul_ps(edge2X, deltaU1), _mm256_mul_ps(edge1X, deltaU2));
+        __m256 bitangentY = _mm256_sub_ps(_mm256_mul_ps(edge2Y, deltaU1), _mm256_mul_ps(edge1Y, deltaU2));
+        __m256 bitangentZ = _mm256_sub_ps(_mm256_mul_ps(edge2Z, deltaU1), _mm256_mul_ps(edge1Z, deltaU2));
+        __m256 tangentLength = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(tangentX, tangentX),
+                                                                          _mm256_mul_ps(tangentY, tangentY)),
+                                                            _mm256_mul_ps(tangentZ, tangentZ)));
+        __m256 bitangentLength = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(bitangentX, bitangentX),
+                                                                            _mm256_mul_ps(bitangentY, bitangentY)),
+                                                              _mm256_mul_ps(bitangentZ, bitangentZ)));
+
+        __m256 valid = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(det, zero, _CMP_NEQ_UQ),
+                                                   _mm256_cmp_ps(area, zero, _CMP_NEQ_UQ)),
+                                     _mm256_and_ps(_mm256_cmp_ps(tangentLength, zero, _CMP_NEQ_UQ),
+                                                   _mm256_cmp_ps(bitangentLength, zero, _CMP_NEQ_UQ)));
+        __m256 detSign = _mm256_and_ps(det, signMask);
+        __m256 tangentScale = _mm256_and_ps(valid, _mm256_xor_ps(_mm256_div_ps(area, tangentLength), detSign));
+        __m256 bitangentScale = _mm256_and_ps(valid, _mm256_xor_ps(_mm256_div_ps(area, bitangentLength), detSign));
+
+        _mm256_storeu_ps(faceTangents.tangentX + i, _mm256_mul_ps(tangentX, tangentScale));
+        _mm256_storeu_ps(faceTangents.tangentY + i, _mm256_mul_ps(tangentY, tangentScale));
+        _mm256_storeu_ps(faceTangents.tangentZ + i, _mm256_mul_ps(tangentZ, tangentScale));
+        _mm256_storeu_ps(faceTangents.bitangentX + i, _mm256_mul_ps(bitangentX, bitangentScale));
+        _mm256_storeu_ps(faceTangents.bitangentY + i, _mm256_mul_ps(bitangentY, bitangentScale));
+        _mm256_storeu_ps(faceTangents.bitangentZ + i, _mm256_mul_ps(bitangentZ, bitangentScale));
+    }
+    return i;
+}
+#endif
+
+#if GLM_ARCH & GLM_ARCH_SSE2
+static int faceTangentsSSE2(const TriangleBatch& triangles, int triangleCount,
+                            const FaceTangentBatch& faceTangents)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+
+    int i = 0;
+    for(; i+4<=triangleCount; i+=4)
+    {
+        __m128 x0 = _mm_loadu_ps(triangles.x[0] + i);
+        __m128 y0 = _mm_loadu_ps(triangles.y[0] + i);
+        __m128 z0 = _mm_loadu_ps(triangles.z[0] + i);
+        __m128 u0 = _mm_loadu_ps(triangles.u[0] + i);
+        __m128 v0 = _mm_loadu_ps(triangles.v[0] + i);
+        __m128 edge1X = _mm_sub_ps(_mm_loadu_ps(triangles.x[1] + i), x0);
+        __m128 edge1Y = _mm_sub_ps(_mm_loadu_ps(triangles.y[1] + i), y0);
+        __m128 edge1Z = _mm_sub_ps(_mm_loadu_ps(triangles.z[1] + i), z0);
+        __m128 edge2X = _mm_sub_ps(_mm_loadu_ps(triangles.x[2] + i), x0);
+        __m128 edge2Y = _mm_sub_ps(_mm_loadu_ps(triangles.y[2] + i), y0);
+        __m128 edge2Z = _mm_sub_ps(_mm_loadu_ps(triangles.z[2] + i), z0);
+        __m128 deltaU1 = _mm_sub_ps(_mm_loadu_ps(triangles.u[1] + i), u0);
+        __m128 deltaV1 = _mm_sub_ps(_mm_loadu_ps(triangles.v[1] + i), v0);
+        __m128 deltaU2 = _mm_sub_ps(_mm_loadu_ps(triangles.u[2] + i), u0);
+        __m128 deltaV2 = _mm_sub_ps(_mm_loadu_ps(triangles.v[2] + i), v0);
+
+        __m128 det = _mm_sub_ps(_mm_mul_ps(deltaU1, deltaV2), _mm_mul_ps(deltaU2, deltaV1));
+        __m128 crossX = _mm_sub_ps(_mm_mul_ps(edge1Y, edge2Z), _mm_mul_ps(edge1Z, edge2Y));
+        __m128 crossY = _mm_sub_ps(_mm_mul_ps(edge1Z, edge2X), _mm_mul_ps(edge1X, edge2Z));
+        __m128 crossZ = _mm_sub_ps(_mm_mul_ps(edge1X, edge2Y), _mm_mul_ps(edge1Y, edge2X));
+        __m128 area = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(crossX, crossX),
+                                                        _mm_mul_ps(crossY, crossY)),
+                                             _mm_mul_ps(crossZ, crossZ)));
+
+        __m128 tangentX = _mm_sub_ps(_mm_mul_ps(edge1X, deltaV2), _mm_mul_ps(edge2X, deltaV1));
+        __m128 tangentY = _mm_sub_ps(_mm_mul_ps(edge1Y, deltaV2), _mm_mul_ps(edge2Y, deltaV1));
+        __m128 tangentZ = _mm_sub_ps(_mm_mul_ps(edge1Z, deltaV2), _mm_mul_ps(edge2Z, deltaV1));
+        __m128 bitangentX = _mm_sub_ps(_mm_mul_ps(edge2X, deltaU1), _mm_mul_ps(edge1X, deltaU2));
+        __m128 bitangentY = _mm_sub_ps(_mm_mul_ps(edge2Y, deltaU1), _mm_mul_ps(edge1Y, deltaU2));
+        __m128 bitangentZ = _mm_sub_ps(_mm_mul_ps(edge2Z, deltaU1), _mm_mul_ps(edge1Z, deltaU2));
+        __m128 tangentLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tangentX, tangentX),
+                                                                 _mm_mul_ps(tangentY, tangentY)),
+                                                      _mm_mul_ps(tangentZ, tangentZ)));
+        __m128 bitangentLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(bitangentX, bitangentX),
+                                                                   _mm_mul_ps(bitangentY, bitangentY)),
+                                                        _mm_mul_ps(bitangentZ, bitangentZ)));
+
+        __m128 valid = _mm_and_ps(_mm_and_ps(_mm_cmpneq_ps(det, zero), _mm_cmpneq_ps(area, zero)),
+                                  _mm_and_ps(_mm_cmpneq_ps(tangentLength, zero),
+                                             _mm_cmpneq_ps(bitangentLength, zero)));
+        __m128 detSign = _mm_and_ps(det, signMask);
+        __m128 tangentScale = _mm_and_ps(valid, _mm_xor_ps(_mm_div_ps(area, tangentLength), detSign));
+        __m128 bitangentScale = _mm_and_ps(valid, _mm_xor_ps(_mm_div_ps(area, bitangentLength), detSign));
+
+        _mm_storeu_ps(faceTangents.tangentX + i, _mm_mul_ps(tangentX, tangentScale));
+        _mm_storeu_ps(faceTangents.tangentY + i, _mm_mul_ps(tangentY, tangentScale));
+        _mm_storeu_ps(faceTangents.tangentZ + i, _mm_mul_ps(tangentZ, tangentScale));
+        _mm_storeu_ps(faceTangents.bitangentX + i, _mm_mul_ps(bitangentX, bitangentScale));
+        _mm_storeu_ps(faceTangents.bitangentY + i, _mm_mul_ps(bitangentY, bitangentScale));
+        _mm_storeu_ps(faceTangents.bitangentZ + i, _mm_mul_ps(bitangentZ, bitangentScale));
+    }
+    return i;
+}
+#endif
+
+void computeFaceTangents(const TriangleBatch& triangles, int triangleCount,
+                         const FaceTangentBatch& faceTangents)
+{
+    int done = 0;
+#if GLM_ARCH & GLM_ARCH_AVX
+    done = faceTangentsAVX(triangles, triangleCount, faceTangents);
+#elif GLM_ARCH & GLM_ARCH_SSE2
+    done = faceTangentsSSE2(triangles, triangleCount, faceTangents);
+#endif
+    faceTangentsScalar(triangles, done, triangleCount, faceTangents);
+}
+
+void computeFaceTangentsScalar(const TriangleBatch& triangles, int triangleCount,
+                               const FaceTangentBatch& faceTangents)
+{
+    faceTangentsScalar(triangles, 0, triangleCount, faceTangents);
+}
+
+void computeVertexTangents(const float* positions, const float* texCoords, const float* normals,
+                           int vertexCount, const unsigned int* indices, int indexCount,
+                           float* tangents)
+{
+    std::vector<glm::vec3> tangentSums(vertexCount, glm::vec3(0.0f));
+    std::vector<glm::vec3> bitangentSums(vertexCount, glm::vec3(0.0f));
+
+    // NOTE: The triangles are gathered into structure of arrays form a batch at a time, which
+    //       keeps the scratch space in the cache while letting the kernel run at full width
+    const int batchSize = 256;
+    std::vector<float> scratch(21*batchSize);
+    TriangleBatch batch;
+    for(int corner=0; corner<3; corner++)
+    {
+        batch.x[corner] = &scratch[(5*corner + 0)*batchSize];
+        batch.y[corner] = &scratch[(5*corner + 1)*batchSize];
+        batch.z[corner] = &scratch[(5*corner + 2)*batchSize];
+        batch.u[corner] = &scratch[(5*corner + 3)*batchSize];
+        batch.v[corner] = &scratch[(5*corner + 4)*batchSize];
+    }
+    FaceTangentBatch faceTangents;
+    faceTangents.tangentX = &scratch[15*batchSize];
+    faceTangents.tangentY = &scratch[16*batchSize];
+    faceTangents.tangentZ = &scratch[17*batchSize];
+    faceTangents.bitangentX = &scratch[18*batchSize];
+    faceTangents.bitangentY = &scratch[19*batchSize];
+    faceTangents.bitangentZ = &scratch[20*batchSize];
+
+    int triangleCount = indexCount/3;
+    for(int batchStart=0; batchStart<triangleCount; batchStart+=batchSize)
+    {
+        int batchCount = std::min(batchSize, triangleCount - batchStart);
+        const unsigned int* batchIndices = &indices[3*batchStart];
+        for(int i=0; i<batchCount; i++)
+        {
+            for(int corner=0; corner<3; corner++)
+            {
+                unsigned int index = batchIndices[3*i + corner];
+                float* cornerData = &scratch[5*corner*batchSize + i];
+                cornerData[0] = positions[3*index];
+                cornerData[batchSize] = positions[3*index+1];
+                cornerData[2*batchSize] = positions[3*index+2];
+                cornerData[3*batchSize] = texCoords[2*index];
+                cornerData[4*batchSize] = texCoords[2*index+1];
+            }
+        }
+
+        computeFaceTangents(batch, batchCount, faceTangents);
+
+        for(int i=0; i<batchCount; i++)
+        {
+            glm::vec3 tangent(faceTangents.tangentX[i], faceTangents.tangentY[i], faceTangents.tangentZ[i]);
+            glm::vec3 bitangent(faceTangents.bitangentX[i], faceTangents.bitangentY[i], faceTangents.bitangentZ[i]);
+            for(int corner=0; corner<3; corner++)
+            {
+                unsigned int index = batchIndices[3*i + corner];
+                tangentSums[index] += tangent;
+                bitangentSums[index] += bitangent;
+            }
+        }
+    }
+
+    for(int vertIndex=0; vertIndex<vertexCount; vertIndex++)
+    {
+        glm::vec3 normal(normals[3*vertIndex], normals[3*vertIndex+1], normals[3*vertIndex+2]);
+        float normalLength = glm::length(normal);
+        if(normalLength > 0.0f)
+        {
+            normal /= normalLength;
+        }
+
+        glm::vec3 tangent = tangentSums[vertIndex];
+        tangent -= normal * glm::dot(normal, tangent);
+        float tangentLength = glm::length(tangent);
+        if(tangentLength > 0.0f)
+        {
+            tangent /= tangentLength;
+        }
+        else
+        {
+            // NOTE: Vertices that only belong to degenerate faces (or whose tangent was parallel to
+            //       the normal) still get a valid frame, just not one that matches the texture
+            glm::vec3 axis = (fabsf(normal.x) < 0.9f) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            tangent = glm::cross(normal, axis);
+            tangentLength = glm::length(tangent);
+            tangent = (tangentLength > 0.0f) ? tangent / tangentLength : glm::vec3(1.0f, 0.0f, 0.0f);
+        }
+
+        float* out = &tangents[4*vertIndex];
+        out[0] = tangent.x;
+        out[1] = tangent.y;
+        out[2] = tangent.z;
+        out[3] = (glm::dot(glm::cross(normal, tangent), bitangentSums[vertIndex]) < 0.0f) ? -1.0f : 1.0f;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef TANGENTS_H
+#define TANGENTS_H
+
+// Computes a tangent for every vertex of an indexed triangle list, writing 4 floats per vertex to
+// tangents: the xyz of a unit tangent orthogonal to the vertex normal, and the handedness of the
+// tangent frame in w (the bitangent is cross(normal, tangent) * w). positions and normals hold
+// 3 floats per vertex, texCoords 2.
+//
+// Each triangle's tangent and bitangent is weighted by its area before being added to its
+// corners, so large faces dominate slivers, and the sums are then orthogonalized against the
+// normal (Gram-Schmidt).
+void computeVertexTangents(const float* positions, const float* texCoords, const float* normals,
+                           int vertexCount, const unsigned int* indices, int indexCount,
+                           float* tangents);
+
+// Structure of arrays input for computeFaceTangents. Triangle i's corner c has the position
+// (x[c][i], y[c][i], z[c][i]) and the texture coord (u[c][i], v[c][i])
+struct TriangleBatch
+{
+    const float* x[3];
+    const float* y[3];
+    const float* z[3];
+    const float* u[3];
+    const float* v[3];
+};
+
+// Structure of arrays output for computeFaceTangents, triangle i's tangent is
+// (tangentX[i], tangentY[i], tangentZ[i]) and likewise for its bitangent
+struct FaceTangentBatch
+{
+    float* tangentX;
+    float* tangentY;
+    float* tangentZ;
+    float* bitangentX;
+    float* bitangentY;
+    float* bitangentZ;
+};
+
+// Computes the tangent and bitangent of triangleCount triangles, each scaled to the triangle's
+// area (twice its area, to be exact). Triangles with degenerate texture coords or no area get
+// zeroes. This processes 8 (AVX) or 4 (SSE2) triangles at a time when GLM_ARCH says we can.
+void computeFaceTangents(const TriangleBatch& triangles, int triangleCount,
+                         const FaceTangentBatch& faceTangents);
+
+// The plain one-triangle-at-a-time version of computeFaceTangents. It does exactly the same
+// operations in the same order as the SIMD versions, so gives bit-identical results.
+void computeFaceTangentsScalar(const TriangleBatch& triangles, int triangleCount,
+                               const FaceTangentBatch& faceTangents);
+
+#endif
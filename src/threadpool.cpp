@@ -0,0 +1,116 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int threadCount)
+    : shuttingDown(false), generation(0), activeWorkers(0),
+      currentTask(NULL), currentTaskCount(0), nextTaskIndex(0)
+{
+    if(threadCount <= 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+        if(threadCount <= 0)
+        {
+            threadCount = 1;
+        }
+    }
+
+    // NOTE: The calling thread makes up the last member of the pool
+    for(int i=0; i<threadCount-1; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+    }
+    workAvailable.notify_all();
+    for(size_t i=0; i<workers.size(); i++)
+    {
+        workers[i].join();
+    }
+}
+
+int ThreadPool::threadCount() const
+{
+    return workers.size() + 1;
+}
+
+void ThreadPool::parallelFor(int taskCount, const std::function<void(int)>& task)
+{
+    if(taskCount <= 0)
+    {
+        return;
+    }
+    if(workers.empty() || (taskCount == 1))
+    {
+        for(int i=0; i<taskCount; i++)
+        {
+            task(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        currentTask = &task;
+        currentTaskCount = taskCount;
+        nextTaskIndex = 0;
+        activeWorkers = workers.size();
+        generation++;
+    }
+    workAvailable.notify_all();
+
+    runTasks();
+
+    // Wait for the workers to let go of the task before it goes out of scope
+    std::unique_lock<std::mutex> lock(mutex);
+    while(activeWorkers > 0)
+    {
+        workFinished.wait(lock);
+    }
+    currentTask = NULL;
+}
+
+void ThreadPool::runTasks()
+{
+    while(true)
+    {
+        int taskIndex = nextTaskIndex.fetch_add(1);
+        if(taskIndex >= currentTaskCount)
+        {
+            break;
+        }
+        (*currentTask)(taskIndex);
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    unsigned int lastGeneration = 0;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(!shuttingDown && (generation == lastGeneration))
+            {
+                workAvailable.wait(lock);
+            }
+            if(shuttingDown)
+            {
+                return;
+            }
+            lastGeneration = generation;
+        }
+
+        runTasks();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            activeWorkers--;
+        }
+        workFinished.notify_one();
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// A fixed set of worker threads for splitting data-parallel work. The thread that calls
+// parallelFor also works on the tasks, so a pool with a thread count of 1 has no workers at all
+// and simply runs everything inline
+class ThreadPool
+{
+public:
+    // A thread count of 0 means one thread per hardware thread
+    explicit ThreadPool(int threadCount=0);
+    ~ThreadPool();
+
+    int threadCount() const;
+
+    // Runs task(i) for every i in [0, taskCount) and blocks until they have all finished
+    void parallelFor(int taskCount, const std::function<void(int)>& task);
+
+private:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void workerLoop();
+    void runTasks();
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    std::condition_variable workFinished;
+    bool shuttingDown;
+    unsigned int generation;
+    int activeWorkers;
+
+    const std::function<void(int)>* currentTask;
+    int currentTaskCount;
+    std::atomic<int> nextTaskIndex;
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include <vector>
+#include <math.h>
+
+#include "triangulate.h"
+
+static float cross2D(const glm::vec2& a, const glm::vec2& b)
+{
+    return a.x*b.y - a.y*b.x;
+}
+
+static void triangulateFan(int cornerCount, int* triangles)
+{
+    for(int i=1; i<cornerCount-1; i++)
+    {
+        *triangles++ = 0;
+        *triangles++ = i;
+        *triangles++ = i+1;
+    }
+}
+
+static bool pointInTriangle(const glm::vec2& p, const glm::vec2& a, const glm::vec2& b,
+                            const glm::vec2& c)
+{
+    return (cross2D(b - a, p - a) >= 0.0f) &&
+           (cross2D(c - b, p - b) >= 0.0f) &&
+           (cross2D(a - c, p - c) >= 0.0f);
+}
+
+void triangulatePolygon(const glm::vec3* corners, int cornerCount, int* triangles)
+{
+    if(cornerCount <= 3)
+    {
+        triangulateFan(cornerCount, triangles);
+        return;
+    }
+
+    // NOTE: We work in 2D by dropping the axis that the polygon's (Newell) normal is most aligned
+    //       with. The remaining two axes are ordered so that the polygon winds counter-clockwise.
+    glm::vec3 normal(0.0f);
+    for(int i=0; i<cornerCount; i++)
+    {
+        const glm::vec3& current = corners[i];
+        const glm::vec3& next = corners[(i+1) % cornerCount];
+        normal.x += (current.y - next.y) * (current.z + next.z);
+        normal.y += (current.z - next.z) * (current.x + next.x);
+        normal.z += (current.x - next.x) * (current.y + next.y);
+    }
+    glm::vec3 absNormal = glm::abs(normal);
+    int dropAxis = 2;
+    if((absNormal.x >= absNormal.y) && (absNormal.x >= absNormal.z))
+    {
+        dropAxis = 0;
+    }
+    else if(absNormal.y >= absNormal.z)
+    {
+        dropAxis = 1;
+    }
+    if(absNormal[dropAxis] == 0.0f)
+    {
+        // A degenerate polygon has no sensible triangulation, so any will do
+        triangulateFan(cornerCount, triangles);
+        return;
+    }
+    int uAxis = (dropAxis + 1) % 3;
+    int vAxis = (dropAxis + 2) % 3;
+    if(normal[dropAxis] < 0.0f)
+    {
+        int temp = uAxis;
+        uAxis = vAxis;
+        vAxis = temp;
+    }
+
+    // NOTE: Like triangulateOBJFace, we only allocate for unusually large polygons
+    const int maxStackCorners = 32;
+    glm::vec2 stackPoints[maxStackCorners];
+    std::vector<glm::vec2> heapPoints;
+    glm::vec2* points = stackPoints;
+    if(cornerCount > maxStackCorners)
+    {
+        heapPoints.resize(cornerCount);
+        points = &heapPoints[0];
+    }
+    for(int i=0; i<cornerCount; i++)
+    {
+        points[i] = glm::vec2(corners[i][uAxis], corners[i][vAxis]);
+    }
+
+    bool convex = true;
+    for(int i=0; convex && (i<cornerCount); i++)
+    {
+        const glm::vec2& previous = points[(i + cornerCount - 1) % cornerCount];
+        const glm::vec2& next = points[(i+1) % cornerCount];
+        convex = (cross2D(points[i] - previous, next - points[i]) >= 0.0f);
+    }
+    if(convex)
+    {
+        triangulateFan(cornerCount, triangles);
+        return;
+    }
+
+    // NOTE: Ear clipping: repeatedly cut off a convex corner whose triangle contains no other
+    //       corner of the polygon. If floating point trouble means we can't find an ear, we just
+    //       clip the next corner anyway so that we always produce the right number of triangles
+    std::vector<int> remaining(cornerCount);
+    for(int i=0; i<cornerCount; i++)
+    {
+        remaining[i] = i;
+    }
+
+    int current = 0;
+    int attempts = 0;
+    while(remaining.size() > 3)
+    {
+        int count = remaining.size();
+        int previousIndex = remaining[(current + count - 1) % count];
+        int currentIndex = remaining[current];
+        int nextIndex = remaining[(current + 1) % count];
+        const glm::vec2& a = points[previousIndex];
+        const glm::vec2& b = points[currentIndex];
+        const glm::vec2& c = points[nextIndex];
+
+        bool isEar = (cross2D(b - a, c - b) > 0.0f);
+        for(int i=0; isEar && (i<count); i++)
+        {
+            int other = remaining[i];
+            if((other != previousIndex) && (other != currentIndex) && (other != nextIndex))
+            {
+                isEar = !pointInTriangle(points[other], a, b, c);
+            }
+        }
+
+        if(isEar || (attempts >= count))
+        {
+            *triangles++ = previousIndex;
+            *triangles++ = currentIndex;
+            *triangles++ = nextIndex;
+            remaining.erase(remaining.begin() + current);
+            current = current % (count - 1);
+            attempts = 0;
+        }
+        else
+        {
+            current = (current + 1) % count;
+            attempts++;
+        }
+    }
+
+    *triangles++ = remaining[0];
+    *triangles++ = remaining[1];
+    *triangles++ = remaining[2];
+}
+
+// Writes the (cornerCount - 2) triangles for one face of the OBJ file to faces. Larger polygons
+// are triangulated using their positions (the first of which has index firstPosition), and if
+// some of those positions haven't been parsed yet we can't do any better than a fan
+void triangulateOBJFace(const VertexKey* corners, int cornerCount, const float* positions,
+                        size_t firstPosition, size_t positionCount, FaceData* faces)
+{
+    // NOTE: Faces almost always have a handful of corners, so we avoid allocating for them
+    const int maxStackCorners = 32;
+    glm::vec3 stackPoints[maxStackCorners];
+    int stackTriangles[3*maxStackCorners];
+    std::vector<glm::vec3> heapPoints;
+    std::vector<int> heapTriangles;
+    glm::vec3* points = stackPoints;
+    int* triangles = stackTriangles;
+    if(cornerCount > maxStackCorners)
+    {
+        heapPoints.resize(cornerCount);
+        heapTriangles.resize(3*cornerCount);
+        points = &heapPoints[0];
+        triangles = &heapTriangles[0];
+    }
+
+    bool havePositions = true;
+    for(int i=0; havePositions && (i<cornerCount); i++)
+    {
+        havePositions = (corners[i].vertexIndex >= 0) &&
+                        ((size_t)corners[i].vertexIndex >= firstPosition) &&
+                        ((size_t)corners[i].vertexIndex - firstPosition < positionCount);
+    }
+
+    if(havePositions && (cornerCount > 3))
+    {
+        for(int i=0; i<cornerCount; i++)
+        {
+            const float* position = &positions[3*(corners[i].vertexIndex - firstPosition)];
+            points[i] = glm::vec3(position[0], position[1], position[2]);
+        }
+        triangulatePolygon(points, cornerCount, triangles);
+    }
+    else
+    {
+        for(int i=1; i<cornerCount-1; i++)
+        {
+            triangles[3*(i-1)] = 0;
+            triangles[3*(i-1)+1] = i;
+            triangles[3*(i-1)+2] = i+1;
+        }
+    }
+
+    for(int triangle=0; triangle<cornerCount-2; triangle++)
+    {
+        for(int index=0; index<3; index++)
+        {
+            const VertexKey& corner = corners[triangles[3*triangle + index]];
+            faces[triangle].vertexIndex[index] = corner.vertexIndex;
+            faces[triangle].texCoordIndex[index] = corner.texCoordIndex;
+            faces[triangle].normalIndex[index] = corner.normalIndex;
+        }
+    }
+}
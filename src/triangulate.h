@@ -0,0 +1,20 @@
+#ifndef TRIANGULATE_H
+#define TRIANGULATE_H
+
+#include <stddef.h>
+#include "glm/glm.hpp"
+#include "geometry.h"
+#include "objscanner.h"
+
+// Splits a simple polygon into (cornerCount - 2) triangles, writing 3 indices into the corners
+// array for each triangle to triangles. Convex polygons (which is nearly all of them) are split
+// into a fan around the first corner, and concave ones are split by ear clipping. Triangles keep
+// the winding order of the polygon.
+void triangulatePolygon(const glm::vec3* corners, int cornerCount, int* triangles);
+
+// Writes the (cornerCount - 2) triangles for one face of an OBJ file to faces, using positions
+// (positionCount xyz triples, the first of which has index firstPosition) to triangulate polygons
+void triangulateOBJFace(const VertexKey* corners, int cornerCount, const float* positions,
+                        size_t firstPosition, size_t positionCount, FaceData* faces);
+
+#endif
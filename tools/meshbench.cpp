@@ -0,0 +1,2314 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <atomic>
+#include <stdint.h>
+#include <new>
+#include <math.h>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#include "glm/gtc/packing.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtx/intersect.hpp"
+
+#include "bvh.h"
+#include "geometry.h"
+#include "meshloader.h"
+#include "meshoptimize.h"
+#include "lodselector.h"
+#include "objstream.h"
+#include "radixsort.h"
+#include "tangents.h"
+#include "threadpool.h"
+
+// Headless benchmarks for the geometry pipeline. Run from the build directory, eg.
+//     ./meshbench parse sample-bunny.obj 20
+
+using namespace std;
+
+// Every heap allocation in the process goes through these, which lets the alloc benchmark count
+// them. Each block is prefixed with its size so we can also track how much is live at once
+static atomic<size_t> allocationCount(0);
+static atomic<size_t> allocatedBytes(0);
+static atomic<size_t> liveBytes(0);
+static atomic<size_t> peakLiveBytes(0);
+static const size_t allocationHeaderSize = 16;
+
+void* operator new(size_t size)
+{
+    char* block = (char*)malloc(size + allocationHeaderSize);
+    if(!block)
+    {
+        throw bad_alloc();
+    }
+    memcpy(block, &size, sizeof(size));
+    allocationCount++;
+    allocatedBytes += size;
+    size_t live = (liveBytes += size);
+    size_t peak = peakLiveBytes;
+    while((live > peak) && !peakLiveBytes.compare_exchange_weak(peak, live))
+    {
+    }
+    return block + allocationHeaderSize;
+}
+
+void operator delete(void* p) noexcept
+{
+    if(!p)
+    {
+        return;
+    }
+    char* block = (char*)p - allocationHeaderSize;
+    size_t size;
+    memcpy(&size, block, sizeof(size));
+    liveBytes -= size;
+    free(block);
+}
+
+static double secondsSince(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static double fileSizeMB(const string& filename)
+{
+    struct stat fileStat;
+    if(stat(filename.c_str(), &fileStat) != 0)
+    {
+        return 0.0;
+    }
+    return (double)fileStat.st_size / (1024.0*1024.0);
+}
+
+static double peakResidentMB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return (double)counters.PeakWorkingSetSize / (1024.0*1024.0);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)usage.ru_maxrss / 1024.0;
+#endif
+}
+
+static bool sameFloats(void* a, void* b, int count)
+{
+    return (count == 0) || (memcmp(a, b, count*sizeof(float)) == 0);
+}
+
+static bool sameGeometry(GeometryData& a, GeometryData& b)
+{
+    int count = a.vertexCount();
+    if((count != b.vertexCount()) ||
+       (a.indexCount() != b.indexCount()) ||
+       (a.hasTextureCoords() != b.hasTextureCoords()) ||
+       (a.hasNormals() != b.hasNormals()) ||
+       (a.hasTangents() != b.hasTangents()))
+    {
+        return false;
+    }
+    if(count == 0)
+    {
+        return true;
+    }
+
+    bool same = (memcmp(a.indexData(), b.indexData(), a.indexCount()*sizeof(unsigned int)) == 0);
+    same = same && sameFloats(a.vertexData(), b.vertexData(), 3*count);
+    if(a.hasTextureCoords())
+    {
+        same = same && sameFloats(a.textureCoordData(), b.textureCoordData(), 2*count);
+    }
+    if(a.hasNormals())
+    {
+        same = same && sameFloats(a.normalData(), b.normalData(), 3*count);
+    }
+    if(a.hasTangents())
+    {
+        same = same && sameFloats(a.tangentData(), b.tangentData(), 4*count);
+    }
+    return same;
+}
+
+// The loaders report on every load, which we don't want interleaved with the results
+struct QuietOutput
+{
+    QuietOutput() : previous(cout.rdbuf(NULL)) {}
+    ~QuietOutput() { cout.rdbuf(previous); }
+    streambuf* previous;
+};
+
+// Loads straight from the OBJ file, so the mesh cache doesn't skew any of the parsing numbers
+static void loadUncached(GeometryData& geometry, const string& filename, OBJLoadMode mode,
+                         int threadCount=0)
+{
+    QuietOutput quiet;
+    geometry.setUseMeshCache(false);
+    geometry.loadFromOBJFile(filename, mode, threadCount);
+}
+
+static double timeLoad(const string& filename, OBJLoadMode mode, int iterations,
+                       int threadCount=0)
+{
+    double bestTime = 1e30;
+    for(int i=0; i<iterations; i++)
+    {
+        GeometryData geometry;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        loadUncached(geometry, filename, mode, threadCount);
+        double time = secondsSince(start);
+        if(time < bestTime)
+        {
+            bestTime = time;
+        }
+    }
+    return bestTime;
+}
+
+// Compares the throughput of the stream and mapped OBJ loaders, and checks they agree
+static int benchParse(const string& filename, int iterations)
+{
+    GeometryData streamGeometry;
+    GeometryData mappedGeometry;
+    loadUncached(streamGeometry, filename, OBJ_LOAD_STREAM);
+    loadUncached(mappedGeometry, filename, OBJ_LOAD_MAPPED);
+    if(!sameGeometry(streamGeometry, mappedGeometry))
+    {
+        cout << "FAILED: stream and mapped loaders produced different data" << endl;
+        return 1;
+    }
+
+    double size = fileSizeMB(filename);
+    double streamTime = timeLoad(filename, OBJ_LOAD_STREAM, iterations);
+    double mappedTime = timeLoad(filename, OBJ_LOAD_MAPPED, iterations);
+
+    cout << filename << " (" << size << " MB, best of " << iterations << ")" << endl;
+    cout << "\tstream: " << streamTime*1000.0 << " ms, " << size/streamTime << " MB/s" << endl;
+    cout << "\tmapped: " << mappedTime*1000.0 << " ms, " << size/mappedTime << " MB/s" << endl;
+    cout << "\tspeedup: " << streamTime/mappedTime << "x" << endl;
+    return 0;
+}
+
+// Reports how the parallel OBJ loader scales from 1 thread up to the hardware thread count
+static int benchParallel(const string& filename, int iterations)
+{
+    GeometryData serialGeometry;
+    GeometryData parallelGeometry;
+    loadUncached(serialGeometry, filename, OBJ_LOAD_MAPPED);
+    loadUncached(parallelGeometry, filename, OBJ_LOAD_PARALLEL);
+    if(!sameGeometry(serialGeometry, parallelGeometry))
+    {
+        cout << "FAILED: serial and parallel loaders produced different data" << endl;
+        return 1;
+    }
+
+    int maxThreads = thread::hardware_concurrency();
+    if(maxThreads < 1)
+    {
+        maxThreads = 1;
+    }
+
+    double size = fileSizeMB(filename);
+    double serialTime = timeLoad(filename, OBJ_LOAD_MAPPED, iterations);
+    cout << filename << " (" << size << " MB, best of " << iterations << ")" << endl;
+    cout << "\tserial mapped: " << serialTime*1000.0 << " ms, " << size/serialTime << " MB/s" << endl;
+    for(int threadCount=1; ; threadCount*=2)
+    {
+        if(threadCount > maxThreads)
+        {
+            threadCount = maxThreads;
+        }
+        double time = timeLoad(filename, OBJ_LOAD_PARALLEL, iterations, threadCount);
+        cout << "\t" << threadCount << " thread(s): " << time*1000.0 << " ms, "
+             << size/time << " MB/s, " << serialTime/time << "x serial" << endl;
+        if(threadCount == maxThreads)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+// Stands in for the GL upload by copying every stream into a staging buffer, which makes sure we
+// pay for actually reading a mapped cache rather than just mapping it
+static void uploadStreams(GeometryData& geometry, vector<char>& staging)
+{
+    int count = geometry.vertexCount();
+    staging.resize(0);
+    const char* vertexData = (const char*)geometry.vertexData();
+    staging.insert(staging.end(), vertexData, vertexData + 3*count*sizeof(float));
+    const char* indexData = (const char*)geometry.indexData();
+    staging.insert(staging.end(), indexData, indexData + geometry.indexCount()*sizeof(unsigned int));
+    if(geometry.hasTextureCoords())
+    {
+        const char* data = (const char*)geometry.textureCoordData();
+        staging.insert(staging.end(), data, data + 2*count*sizeof(float));
+    }
+    if(geometry.hasNormals())
+    {
+        const char* data = (const char*)geometry.normalData();
+        staging.insert(staging.end(), data, data + 3*count*sizeof(float));
+    }
+    if(geometry.hasTangents())
+    {
+        const char* data = (const char*)geometry.tangentData();
+        staging.insert(staging.end(), data, data + 4*count*sizeof(float));
+    }
+}
+
+// Compares startup (load + upload) with a cold mesh cache, which parses the OBJ and writes the
+// cache, against a warm one which just maps it
+static int benchCache(const string& filename, int iterations)
+{
+    string cacheFilename = meshCacheFilename(filename);
+    vector<char> staging;
+    double coldTime = 1e30;
+    double warmTime = 1e30;
+    for(int i=0; i<iterations; i++)
+    {
+        remove(cacheFilename.c_str());
+        QuietOutput quiet;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        GeometryData coldGeometry;
+        coldGeometry.loadFromOBJFile(filename);
+        uploadStreams(coldGeometry, staging);
+        coldTime = min(coldTime, secondsSince(start));
+
+        start = chrono::steady_clock::now();
+        GeometryData warmGeometry;
+        warmGeometry.loadFromOBJFile(filename);
+        uploadStreams(warmGeometry, staging);
+        warmTime = min(warmTime, secondsSince(start));
+    }
+
+    GeometryData parsedGeometry;
+    GeometryData cachedGeometry;
+    loadUncached(parsedGeometry, filename, OBJ_LOAD_MAPPED);
+    {
+        QuietOutput quiet;
+        cachedGeometry.loadFromOBJFile(filename);
+    }
+    if(!sameGeometry(parsedGeometry, cachedGeometry))
+    {
+        cout << "FAILED: mesh cache doesn't match the parsed OBJ" << endl;
+        return 1;
+    }
+
+    cout << filename << " (" << fileSizeMB(filename) << " MB OBJ, "
+         << fileSizeMB(cacheFilename) << " MB cache, best of " << iterations << ")" << endl;
+    cout << "\tcold cache: " << coldTime*1000.0 << " ms" << endl;
+    cout << "\twarm cache: " << warmTime*1000.0 << " ms" << endl;
+    cout << "\tspeedup: " << coldTime/warmTime << "x" << endl;
+    return 0;
+}
+
+// Streams the OBJ file through a sink that just checksums it, then does a regular load. Peak
+// resident memory only ever grows, so the streaming numbers have to be taken first
+static int benchStream(const string& filename, int iterations)
+{
+    double baseResident = peakResidentMB();
+    long long streamedTriangles = 0;
+    double checksum = 0.0;
+    double streamTime = 1e30;
+    for(int i=0; i<iterations; i++)
+    {
+        streamedTriangles = 0;
+        checksum = 0.0;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        bool streamed = streamOBJFile(filename, [&](const OBJTriangleBatch& batch)
+        {
+            streamedTriangles += batch.triangleCount;
+            for(int corner=0; corner<3*batch.triangleCount; corner++)
+            {
+                checksum += batch.positions[3*corner];
+            }
+            return true;
+        });
+        if(!streamed)
+        {
+            cout << "FAILED: unable to stream " << filename << endl;
+            return 1;
+        }
+        streamTime = min(streamTime, secondsSince(start));
+    }
+    double streamResident = peakResidentMB();
+
+    GeometryData geometry;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+    double loadTime = secondsSince(start);
+    double loadResident = peakResidentMB();
+
+    if(streamedTriangles != geometry.indexCount()/3)
+    {
+        cout << "FAILED: streamed " << streamedTriangles << " triangles, but loaded "
+             << geometry.indexCount()/3 << endl;
+        return 1;
+    }
+
+    double size = fileSizeMB(filename);
+    cout << filename << " (" << size << " MB, " << streamedTriangles << " triangles)" << endl;
+    cout << "\tstreamed: " << streamTime*1000.0 << " ms, " << size/streamTime << " MB/s, peak RSS +"
+         << streamResident - baseResident << " MB (checksum " << checksum << ")" << endl;
+    cout << "\tloaded:   " << loadTime*1000.0 << " ms, " << size/loadTime << " MB/s, peak RSS +"
+         << loadResident - baseResident << " MB" << endl;
+    return 0;
+}
+
+// Rewrites a plain OBJ file using the variants of the format that exporters produce: w components
+// and vertex colors, negative (relative) indices and faces continued over more than one line. The
+// result describes exactly the same mesh as the original.
+static bool writeOBJVariants(const string& filename, const string& variantFilename)
+{
+    ifstream in(filename);
+    ofstream out(variantFilename, ios::binary);
+    if(!in || !out)
+    {
+        return false;
+    }
+
+    int counts[3] = {0, 0, 0};
+    long long faceCount = 0;
+    string line;
+    while(getline(in, line))
+    {
+        if((line.size() > 2) && (line[0] == 'v') && ((line[1] == ' ') || (line[1] == '\t')))
+        {
+            out << line << (((counts[0]++ % 2) == 0) ? " 1.0" : " 0.5 0.25 1.0") << "\n";
+        }
+        else if((line.size() > 2) && (line[0] == 'v') && (line[1] == 't'))
+        {
+            counts[1]++;
+            out << line << " 0.0\n";
+        }
+        else if((line.size() > 2) && (line[0] == 'v') && (line[1] == 'n'))
+        {
+            counts[2]++;
+            out << line << "\n";
+        }
+        else if((line.size() > 2) && (line[0] == 'f'))
+        {
+            // Every corner index becomes relative, and every 8th face is split over two lines
+            istringstream corners(line.substr(1));
+            string corner;
+            out << "f";
+            for(int cornerIndex=0; corners >> corner; cornerIndex++)
+            {
+                out << " ";
+                int component = 0;
+                size_t start = 0;
+                while(start <= corner.size())
+                {
+                    size_t slash = corner.find('/', start);
+                    string index = corner.substr(start, (slash == string::npos) ? string::npos : slash - start);
+                    if(!index.empty())
+                    {
+                        int value = atoi(index.c_str());
+                        out << ((value > 0) ? value - counts[min(component, 2)] - 1 : value);
+                    }
+                    if(slash == string::npos)
+                    {
+                        break;
+                    }
+                    out << "/";
+                    start = slash + 1;
+                    component++;
+                }
+                if((cornerIndex == 0) && ((faceCount % 8) == 0))
+                {
+                    out << " \\\n ";
+                }
+            }
+            out << "\n";
+            faceCount++;
+        }
+        else
+        {
+            out << line << "\n";
+        }
+    }
+    return out.good();
+}
+
+// Streams an OBJ file and returns a checksum of the triangles, or a negative value on failure
+static double streamedChecksum(const string& filename)
+{
+    double checksum = 0.0;
+    bool streamed = streamOBJFile(filename, [&](const OBJTriangleBatch& batch)
+    {
+        for(int i=0; i<9*batch.triangleCount; i++)
+        {
+            checksum += fabs(batch.positions[i]);
+        }
+        return true;
+    });
+    return streamed ? checksum : -1.0;
+}
+
+// Checks that every loader reads the exporter variants of an OBJ file (see writeOBJVariants) the
+// same as the plain file, and compares the loaders' throughput on the plain file with the variants
+static int benchVariants(const string& filename, int iterations)
+{
+    string variantFilename = filename + ".variants.obj";
+    if(!writeOBJVariants(filename, variantFilename))
+    {
+        cout << "FAILED: unable to write " << variantFilename << endl;
+        return 1;
+    }
+
+    const OBJLoadMode modes[] = { OBJ_LOAD_STREAM, OBJ_LOAD_MAPPED, OBJ_LOAD_PARALLEL };
+    const char* modeNames[] = { "stream", "mapped", "parallel" };
+    int result = 0;
+    for(int mode=0; mode<3; mode++)
+    {
+        GeometryData plainGeometry;
+        GeometryData variantGeometry;
+        loadUncached(plainGeometry, filename, modes[mode]);
+        loadUncached(variantGeometry, variantFilename, modes[mode]);
+        if(!sameGeometry(plainGeometry, variantGeometry))
+        {
+            cout << "FAILED: the " << modeNames[mode] << " loader read the variants differently" << endl;
+            result = 1;
+        }
+    }
+    if(streamedChecksum(filename) != streamedChecksum(variantFilename))
+    {
+        cout << "FAILED: the streaming loader read the variants differently" << endl;
+        result = 1;
+    }
+
+    if(result == 0)
+    {
+        double size = fileSizeMB(filename);
+        double variantSize = fileSizeMB(variantFilename);
+        cout << filename << " (" << size << " MB, variants " << variantSize << " MB, best of "
+             << iterations << ")" << endl;
+        for(int mode=0; mode<3; mode++)
+        {
+            double plainTime = timeLoad(filename, modes[mode], iterations);
+            double variantTime = timeLoad(variantFilename, modes[mode], iterations);
+            cout << "\t" << modeNames[mode] << ": plain " << plainTime*1000.0 << " ms, "
+                 << size/plainTime << " MB/s; variants " << variantTime*1000.0 << " ms, "
+                 << variantSize/variantTime << " MB/s" << endl;
+        }
+    }
+
+    remove(variantFilename.c_str());
+    return result;
+}
+
+// Tiny OBJ files with faces that refer to records that don't exist, and how many triangles and
+// vertices should survive loading each one. A face with a bad position is dropped, while a bad
+// texture coord or normal is just treated as missing
+struct BadIndexCase
+{
+    const char* name;
+    const char* contents;
+    int triangleCount;
+    int vertexCount;
+};
+
+static const BadIndexCase badIndexCases[] =
+{
+    { "zero", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 0 1 2\nf 1 2 3\n", 1, 3 },
+    { "before first", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf -1 -2 -5\nf -3 -2 -1\n", 1, 3 },
+    { "past last", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\nf 1 2 3\n", 1, 3 },
+    { "attributes", "v 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvn 0 0 1\nf 1/1/1 2/2/-3 3/-2/9\n", 1, 3 }
+};
+
+// Checks that every loader, and the streaming one, drops (or patches up) the faces in
+// badIndexCases rather than reading past the end of their records
+static int benchBadIndices(const string& filename, int)
+{
+    const OBJLoadMode modes[] = { OBJ_LOAD_STREAM, OBJ_LOAD_MAPPED, OBJ_LOAD_PARALLEL };
+    const char* modeNames[] = { "stream", "mapped", "parallel" };
+    string caseFilename = filename + ".badindex.obj";
+    int result = 0;
+    for(size_t testCase=0; testCase<sizeof(badIndexCases)/sizeof(badIndexCases[0]); testCase++)
+    {
+        const BadIndexCase& badCase = badIndexCases[testCase];
+        {
+            ofstream out(caseFilename, ios::binary);
+            out << badCase.contents;
+            if(!out.good())
+            {
+                cout << "FAILED: unable to write " << caseFilename << endl;
+                return 1;
+            }
+        }
+
+        for(int mode=0; mode<3; mode++)
+        {
+            GeometryData geometry;
+            loadUncached(geometry, caseFilename, modes[mode]);
+            if((geometry.indexCount() != 3*badCase.triangleCount) ||
+               (geometry.vertexCount() != badCase.vertexCount))
+            {
+                cout << "FAILED: the " << modeNames[mode] << " loader got " << geometry.indexCount()/3
+                     << " triangles and " << geometry.vertexCount() << " vertices from \""
+                     << badCase.name << "\"" << endl;
+                result = 1;
+            }
+        }
+        int streamedTriangles = 0;
+        {
+            QuietOutput quiet;
+            streamOBJFile(caseFilename, [&](const OBJTriangleBatch& batch)
+            {
+                streamedTriangles += batch.triangleCount;
+                return true;
+            });
+        }
+        if(streamedTriangles != badCase.triangleCount)
+        {
+            cout << "FAILED: the streaming loader got " << streamedTriangles << " triangles from \""
+                 << badCase.name << "\"" << endl;
+            result = 1;
+        }
+    }
+    remove(caseFilename.c_str());
+
+    if(result == 0)
+    {
+        cout << "Every loader dropped the faces with bad indices" << endl;
+    }
+    return result;
+}
+
+// Compares how long a synchronous load stalls the render loop with a background load, where a
+// stand-in render loop (a few ms of busy work per frame) polls for the result
+static int benchAsync(const string& filename, int iterations)
+{
+    MeshProcessor buildLayout = [](GeometryData& loaded) { loaded.buildInterleavedVertices(); };
+
+    double syncTime = 1e30;
+    for(int i=0; i<iterations; i++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        GeometryData geometry;
+        loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+        buildLayout(geometry);
+        syncTime = min(syncTime, secondsSince(start));
+    }
+
+    const double frameWorkSeconds = 0.004;
+    double asyncTime = 1e30;
+    double longestFrame = 0.0;
+    int frameCount = 0;
+    int vertexCount = 0;
+    for(int i=0; i<iterations; i++)
+    {
+        AsyncMeshLoader loader;
+        QuietOutput quiet;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        loader.requestLoad(filename, OBJ_LOAD_MAPPED, buildLayout, false);
+
+        MeshLoadResult result;
+        int frames = 0;
+        double longest = 0.0;
+        while(true)
+        {
+            chrono::steady_clock::time_point frameStart = chrono::steady_clock::now();
+            bool loaded = loader.pollLoaded(result);
+            while(secondsSince(frameStart) < frameWorkSeconds)
+            {
+            }
+            longest = max(longest, secondsSince(frameStart));
+            frames++;
+            if(loaded)
+            {
+                break;
+            }
+        }
+
+        double time = secondsSince(start);
+        if(time < asyncTime)
+        {
+            asyncTime = time;
+            longestFrame = longest;
+            frameCount = frames;
+        }
+        vertexCount = result.geometry->vertexCount();
+    }
+
+    cout << filename << " (" << fileSizeMB(filename) << " MB, " << vertexCount << " vertices, best of "
+         << iterations << ")" << endl;
+    cout << "\tsync:  " << syncTime*1000.0 << " ms with no frames presented" << endl;
+    cout << "\tasync: " << asyncTime*1000.0 << " ms to collect, " << frameCount
+         << " frames presented meanwhile, longest frame " << longestFrame*1000.0 << " ms" << endl;
+    return 0;
+}
+
+// Reordering passes have to draw exactly the same triangles as before (with the same winding), and
+// each material's triangles have to stay in its range
+struct SortedTriangle
+{
+    unsigned int corners[3];
+
+    bool operator<(const SortedTriangle& other) const
+    {
+        return lexicographical_compare(corners, corners + 3, other.corners, other.corners + 3);
+    }
+    bool operator==(const SortedTriangle& other) const
+    {
+        return equal(corners, corners + 3, other.corners);
+    }
+};
+
+// The triangles of [firstIndex, firstIndex + indexCount) in a canonical order, with each rotated
+// so its smallest index comes first
+static vector<SortedTriangle> sortedTriangles(const unsigned int* indices, int firstIndex, int indexCount)
+{
+    vector<SortedTriangle> triangles(indexCount / 3);
+    for(size_t triangle=0; triangle<triangles.size(); triangle++)
+    {
+        const unsigned int* corners = &indices[firstIndex + 3*triangle];
+        int first = min_element(corners, corners + 3) - corners;
+        for(int corner=0; corner<3; corner++)
+        {
+            triangles[triangle].corners[corner] = corners[(first + corner) % 3];
+        }
+    }
+    sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+static bool sameTriangles(GeometryData& geometry, const vector<unsigned int>& originalIndices)
+{
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    vector<MaterialRange> ranges = geometry.materialRanges();
+    if(ranges.empty())
+    {
+        MaterialRange whole = { 0, 0, geometry.indexCount() };
+        ranges.push_back(whole);
+    }
+    for(size_t range=0; range<ranges.size(); range++)
+    {
+        if(sortedTriangles(indices, ranges[range].firstIndex, ranges[range].indexCount) !=
+           sortedTriangles(&originalIndices[0], ranges[range].firstIndex, ranges[range].indexCount))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void printVertexCacheStats(const char* label, GeometryData& geometry)
+{
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    cout << "\t" << label;
+    const int cacheSizes[] = { 16, 32 };
+    for(int i=0; i<2; i++)
+    {
+        VertexCacheStats stats = analyzeVertexCache(indices, geometry.indexCount(), geometry.vertexCount(),
+                                                    cacheSizes[i]);
+        cout << "  FIFO " << cacheSizes[i] << ": ACMR " << stats.acmr << ", ATVR " << stats.atvr;
+    }
+    cout << endl;
+}
+
+// Reports the post-transform vertex cache efficiency before and after the vertex cache optimizer,
+// and how long the optimizer takes
+static int benchVertexCache(const string& filename, int iterations)
+{
+    GeometryData original;
+    loadUncached(original, filename, OBJ_LOAD_MAPPED);
+    const unsigned int* indices = (const unsigned int*)original.indexData();
+    vector<unsigned int> originalIndices(indices, indices + original.indexCount());
+
+    double optimizeTime = 1e30;
+    GeometryData optimized;
+    for(int i=0; i<iterations; i++)
+    {
+        loadUncached(optimized, filename, OBJ_LOAD_MAPPED);
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        optimized.optimizeVertexCache();
+        optimizeTime = min(optimizeTime, secondsSince(start));
+    }
+    if(!sameTriangles(optimized, originalIndices))
+    {
+        cout << "FAILED: the optimized mesh doesn't have the same triangles" << endl;
+        return 1;
+    }
+
+    int triangleCount = original.indexCount() / 3;
+    cout << filename << " (" << original.vertexCount() << " vertices, " << triangleCount
+         << " triangles, best of " << iterations << ")" << endl;
+    printVertexCacheStats("before:", original);
+    printVertexCacheStats("after: ", optimized);
+    cout << "\toptimize: " << optimizeTime*1000.0 << " ms, "
+         << triangleCount / optimizeTime / 1e6 << " M triangles/s" << endl;
+    return 0;
+}
+
+static void printOverdrawStats(const char* label, GeometryData& geometry)
+{
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    VertexCacheStats cache = analyzeVertexCache(indices, geometry.indexCount(), geometry.vertexCount());
+    OverdrawStats overdraw = analyzeOverdraw(indices, geometry.indexCount(), (const float*)geometry.vertexData(),
+                                             geometry.vertexCount());
+    cout << "\t" << label << "  ACMR " << cache.acmr << ", overdraw " << overdraw.overdraw << " ("
+         << overdraw.shadedPixelCount << " shaded, " << overdraw.coveredPixelCount << " covered)" << endl;
+}
+
+// Reports the overdraw (rasterized from the 6 axis directions) and vertex cache efficiency after
+// the vertex cache optimizer, then after the overdraw optimizer at a few thresholds
+static int benchOverdraw(const string& filename, int iterations)
+{
+    GeometryData original;
+    loadUncached(original, filename, OBJ_LOAD_MAPPED);
+    original.optimizeVertexCache();
+    const unsigned int* indices = (const unsigned int*)original.indexData();
+    vector<unsigned int> originalIndices(indices, indices + original.indexCount());
+
+    cout << filename << " (" << original.vertexCount() << " vertices, " << original.indexCount()/3
+         << " triangles, best of " << iterations << ")" << endl;
+    printOverdrawStats("vertex cache only:", original);
+
+    const float thresholds[] = { 1.0f, 1.05f, 1.25f, 2.0f };
+    for(int i=0; i<4; i++)
+    {
+        double optimizeTime = 1e30;
+        GeometryData optimized;
+        for(int iteration=0; iteration<iterations; iteration++)
+        {
+            optimized = original;
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            optimized.optimizeOverdraw(thresholds[i]);
+            optimizeTime = min(optimizeTime, secondsSince(start));
+        }
+        if(!sameTriangles(optimized, originalIndices))
+        {
+            cout << "FAILED: the optimized mesh doesn't have the same triangles" << endl;
+            return 1;
+        }
+
+        ostringstream label;
+        label << "threshold " << thresholds[i] << " (" << optimizeTime*1000.0 << " ms):";
+        printOverdrawStats(label.str().c_str(), optimized);
+    }
+    return 0;
+}
+
+// Renumbering the vertices has to leave every triangle corner with the same attributes it had
+static bool sameCorners(GeometryData& geometry, GeometryData& original)
+{
+    if((geometry.indexCount() != original.indexCount()) || (geometry.vertexCount() != original.vertexCount()))
+    {
+        return false;
+    }
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    const unsigned int* originalIndices = (const unsigned int*)original.indexData();
+    void* streams[] = { geometry.vertexData(), geometry.textureCoordData(), geometry.normalData(),
+                        geometry.tangentData() };
+    void* originalStreams[] = { original.vertexData(), original.textureCoordData(), original.normalData(),
+                                original.tangentData() };
+    const int componentCounts[] = { 3, 2, 3, 4 };
+    for(int stream=0; stream<4; stream++)
+    {
+        if(!streams[stream] != !originalStreams[stream])
+        {
+            return false;
+        }
+        if(!streams[stream])
+        {
+            continue;
+        }
+        const float* data = (const float*)streams[stream];
+        const float* originalData = (const float*)originalStreams[stream];
+        int components = componentCounts[stream];
+        for(int i=0; i<geometry.indexCount(); i++)
+        {
+            if(memcmp(&data[components*indices[i]], &originalData[components*originalIndices[i]],
+                      components*sizeof(float)) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void printVertexFetchStats(const char* label, GeometryData& geometry)
+{
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    VertexFetchStats interleaved = analyzeVertexFetch(indices, geometry.indexCount(), geometry.vertexCount(),
+                                                      sizeof(InterleavedVertex));
+    VertexFetchStats quantized = analyzeVertexFetch(indices, geometry.indexCount(), geometry.vertexCount(),
+                                                    sizeof(QuantizedVertex));
+    cout << "\t" << label << "  interleaved: " << interleaved.cacheLineMissCount << " line misses, overfetch "
+         << interleaved.overfetch << "  quantized: " << quantized.cacheLineMissCount
+         << " line misses, overfetch " << quantized.overfetch << endl;
+}
+
+// Reports how many cache lines fetching the vertices reads (through a simulated 16KB cache) before
+// and after renumbering them in the order they are used. Both are measured after the vertex cache
+// optimizer, which is what scatters the vertex order in the first place
+static int benchVertexFetch(const string& filename, int iterations)
+{
+    GeometryData original;
+    loadUncached(original, filename, OBJ_LOAD_MAPPED);
+    original.optimizeVertexCache();
+
+    double optimizeTime = 1e30;
+    GeometryData optimized;
+    for(int i=0; i<iterations; i++)
+    {
+        optimized = original;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        optimized.optimizeVertexFetch();
+        optimizeTime = min(optimizeTime, secondsSince(start));
+    }
+    if(!sameCorners(optimized, original))
+    {
+        cout << "FAILED: the renumbered mesh doesn't have the same triangles" << endl;
+        return 1;
+    }
+
+    cout << filename << " (" << original.vertexCount() << " vertices, " << original.indexCount()/3
+         << " triangles, best of " << iterations << ")" << endl;
+    printVertexFetchStats("before:", original);
+    printVertexFetchStats("after: ", optimized);
+    cout << "\toptimize: " << optimizeTime*1000.0 << " ms" << endl;
+    return 0;
+}
+
+// Times fn (best of iterations) and returns the time in milliseconds
+template <typename Function>
+static double timeBest(int iterations, Function fn)
+{
+    double bestTime = 1e30;
+    for(int i=0; i<iterations; i++)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        fn();
+        bestTime = min(bestTime, secondsSince(start));
+    }
+    return bestTime*1000.0;
+}
+
+// A level of detail has to be a valid triangle list over the full mesh's vertices, with its
+// material ranges covering all of it in order
+static bool validLOD(const MeshLOD& lod, int vertexCount)
+{
+    int rangeIndexCount = 0;
+    for(size_t range=0; range<lod.ranges.size(); range++)
+    {
+        if(lod.ranges[range].firstIndex != rangeIndexCount)
+        {
+            return false;
+        }
+        rangeIndexCount += lod.ranges[range].indexCount;
+    }
+    if((lod.indices.size() % 3 != 0) || (!lod.ranges.empty() && (rangeIndexCount != (int)lod.indices.size())))
+    {
+        return false;
+    }
+    for(size_t i=0; i<lod.indices.size(); i+=3)
+    {
+        const unsigned int* corners = &lod.indices[i];
+        if(((int)corners[0] >= vertexCount) || ((int)corners[1] >= vertexCount) ||
+           ((int)corners[2] >= vertexCount) || (corners[0] == corners[1]) || (corners[1] == corners[2]) ||
+           (corners[2] == corners[0]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Builds a chain of levels of detail and reports each level's triangle count, error and build
+// time, and how long building them all took on one thread vs. one per hardware thread
+static int benchLOD(const string& filename, int iterations)
+{
+    GeometryData geometry;
+    loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+    const float ratioArray[] = { 0.5f, 0.25f, 0.125f, 0.0625f, 0.03125f };
+    vector<float> ratios(ratioArray, ratioArray + 5);
+
+    double serialTime = timeBest(iterations, [&]() { geometry.buildLODs(ratios, 1); });
+    double parallelTime = timeBest(iterations, [&]() { geometry.buildLODs(ratios, 0); });
+
+    int triangleCount = geometry.indexCount() / 3;
+    cout << filename << " (" << geometry.vertexCount() << " vertices, " << triangleCount << " triangles)"
+         << endl;
+    double levelTime = 0.0;
+    for(int level=0; level<geometry.lodCount(); level++)
+    {
+        const MeshLOD& lod = geometry.lod(level);
+        if(!validLOD(lod, geometry.vertexCount()))
+        {
+            cout << "FAILED: level " << level + 1 << " isn't a valid triangle list" << endl;
+            return 1;
+        }
+        int lodTriangleCount = lod.indices.size() / 3;
+        cout << "\tlevel " << level + 1 << " (target " << ratios[level] << "): " << lodTriangleCount
+             << " triangles (" << (double)lodTriangleCount / triangleCount << "), error " << lod.error
+             << ", " << lod.buildSeconds*1000.0 << " ms" << endl;
+        levelTime += lod.buildSeconds;
+    }
+    cout << "\tall levels, best of " << iterations << ": " << serialTime << " ms on 1 thread, " << parallelTime
+         << " ms on " << thread::hardware_concurrency() << " threads (levels took " << levelTime*1000.0
+         << " ms in total)" << endl;
+    return 0;
+}
+
+// What drawing every instance of a flythrough with levels of detail came to
+struct InstanceFlythrough
+{
+    long long triangleCount;
+    long long levelSwitchCount;
+    double selectSeconds;
+};
+
+// Flies the camera along a grid of instances of the mesh, selecting each instance's level of
+// detail every frame as the renderer would. levels gets the level each instance ended up at
+static InstanceFlythrough flyThroughInstances(const LODSelector& selector, const vector<int>& levelTriangles,
+                                              int gridSize, int frameCount, vector<int>& levels)
+{
+    const int viewportWidth = 1280;
+    const int viewportHeight = 720;
+    float spacing = 3.0f * selector.sphereRadius();
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), (float)viewportWidth / viewportHeight,
+                                            0.01f * spacing, 1000.0f * gridSize * spacing);
+
+    InstanceFlythrough result = { 0, 0, 0.0 };
+    levels.assign(gridSize * gridSize, 0);
+    for(int frame=0; frame<frameCount; frame++)
+    {
+        // From just off one end of the grid to over its middle, looking along it, bobbing back
+        // and forth a little (as a hand held or animated camera would) on the way
+        float travel = ((float)frame / frameCount * 0.5f * gridSize + 0.5f * sinf(frame * 0.7f)) * spacing;
+        glm::vec3 eye(0.5f * gridSize * spacing, 2.0f * spacing, -4.0f * spacing + travel);
+        glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0.0f, -0.2f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 viewProjection = projection * view;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        for(int z=0; z<gridSize; z++)
+        {
+            for(int x=0; x<gridSize; x++)
+            {
+                glm::vec3 position(x * spacing, 0.0f, z * spacing);
+                glm::mat4 model = glm::translate(glm::mat4(1.0f), position - selector.sphereCenter());
+                int& level = levels[z*gridSize + x];
+                int newLevel = selector.selectLevel(viewProjection * model, viewportWidth, viewportHeight, level);
+                result.levelSwitchCount += (newLevel != level) ? 1 : 0;
+                level = newLevel;
+            }
+        }
+        result.selectSeconds += secondsSince(start);
+
+        for(size_t instance=0; instance<levels.size(); instance++)
+        {
+            result.triangleCount += levelTriangles[levels[instance]];
+        }
+    }
+    return result;
+}
+
+// Draws a scene of thousands of instances of the mesh with and without levels of detail, and
+// reports how many triangles that comes to, how often instances change level (with and without
+// hysteresis) and how long selecting the levels takes
+static int benchInstances(const string& filename, int iterations)
+{
+    GeometryData geometry;
+    loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+    const float ratioArray[] = { 0.5f, 0.25f, 0.125f, 0.0625f };
+    geometry.buildLODs(vector<float>(ratioArray, ratioArray + 4));
+
+    vector<int> levelTriangles(1, geometry.indexCount() / 3);
+    for(int level=0; level<geometry.lodCount(); level++)
+    {
+        levelTriangles.push_back(geometry.lod(level).indices.size() / 3);
+    }
+
+    const int gridSize = 64;
+    const int frameCount = 200;
+    LODSelector selector;
+    selector.setMesh(geometry);
+    LODSelector noHysteresis(1.0f, 0.0f);
+    noHysteresis.setMesh(geometry);
+
+    vector<int> levels;
+    InstanceFlythrough lod;
+    lod.selectSeconds = 1e30;
+    for(int i=0; i<iterations; i++)
+    {
+        InstanceFlythrough run = flyThroughInstances(selector, levelTriangles, gridSize, frameCount, levels);
+        run.selectSeconds = min(run.selectSeconds, lod.selectSeconds);
+        lod = run;
+    }
+    InstanceFlythrough popping = flyThroughInstances(noHysteresis, levelTriangles, gridSize, frameCount,
+                                                     levels);
+
+    long long instanceFrames = (long long)gridSize * gridSize * frameCount;
+    double fullTriangles = (double)levelTriangles[0] * gridSize * gridSize;
+    double lodTriangles = (double)lod.triangleCount / frameCount;
+    cout << filename << " (" << gridSize * gridSize << " instances, " << frameCount << " frames, best of "
+         << iterations << ")" << endl;
+    cout << "\ttriangles per frame: " << fullTriangles << " full, " << lodTriangles << " with LODs ("
+         << fullTriangles / lodTriangles << "x fewer)" << endl;
+    cout << "\tlevel switches per frame: " << (double)lod.levelSwitchCount / frameCount << " ("
+         << (double)popping.levelSwitchCount / frameCount << " without hysteresis)" << endl;
+    cout << "\tselection: " << lod.selectSeconds / frameCount * 1000.0 << " ms per frame, "
+         << lod.selectSeconds / instanceFrames * 1e9 << " ns per instance" << endl;
+    return 0;
+}
+
+// Meshlets have to cover the index buffer in order, within the limits, without crossing materials
+static bool validMeshlets(GeometryData& geometry)
+{
+    const vector<Meshlet>& meshlets = geometry.meshlets();
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    vector<MaterialRange> ranges = geometry.materialRanges();
+    if(ranges.empty())
+    {
+        MaterialRange whole = { 0, 0, geometry.indexCount() };
+        ranges.push_back(whole);
+    }
+    vector<int> lastMeshlet(geometry.vertexCount(), -1);
+    int nextIndex = 0;
+    size_t range = 0;
+    for(size_t i=0; i<meshlets.size(); i++)
+    {
+        const Meshlet& meshlet = meshlets[i];
+        while((range < ranges.size()) && (nextIndex >= ranges[range].firstIndex + ranges[range].indexCount))
+        {
+            range++;
+        }
+        if((meshlet.firstIndex != nextIndex) || (meshlet.indexCount > 3 * MAX_MESHLET_TRIANGLES) ||
+           (meshlet.vertexCount > MAX_MESHLET_VERTICES) || (range == ranges.size()) ||
+           (meshlet.material != ranges[range].material) ||
+           (meshlet.firstIndex + meshlet.indexCount > ranges[range].firstIndex + ranges[range].indexCount))
+        {
+            return false;
+        }
+        int vertexCount = 0;
+        for(int index=meshlet.firstIndex; index<meshlet.firstIndex + meshlet.indexCount; index++)
+        {
+            if(lastMeshlet[indices[index]] != (int)i)
+            {
+                lastMeshlet[indices[index]] = i;
+                vertexCount++;
+            }
+        }
+        if(vertexCount != meshlet.vertexCount)
+        {
+            return false;
+        }
+        nextIndex += meshlet.indexCount;
+    }
+    return nextIndex == geometry.indexCount();
+}
+
+// Checks the culler's decisions for one view the slow way: a meshlet culled as back facing must
+// only have triangles that GL would cull (clockwise on screen, or with no area), and one culled as
+// outside the frustum must have all of its vertices outside the same clip plane
+static bool cullingIsConservative(GeometryData& geometry, const glm::mat4& modelViewProjection,
+                                  const MeshletCuller& culler)
+{
+    const vector<Meshlet>& meshlets = geometry.meshlets();
+    const vector<MeshletBounds>& bounds = geometry.meshletBounds();
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    const float* positions = (const float*)geometry.vertexData();
+    for(size_t i=0; i<meshlets.size(); i++)
+    {
+        const Meshlet& meshlet = meshlets[i];
+        if(culler.backFacing(bounds[i]))
+        {
+            for(int index=meshlet.firstIndex; index<meshlet.firstIndex + meshlet.indexCount; index+=3)
+            {
+                glm::vec2 screen[3];
+                for(int corner=0; corner<3; corner++)
+                {
+                    const float* position = &positions[3*indices[index + corner]];
+                    glm::vec4 clip = modelViewProjection * glm::vec4(position[0], position[1], position[2], 1.0f);
+                    if(clip.w <= 0.0f)
+                    {
+                        return false;
+                    }
+                    screen[corner] = glm::vec2(clip.x, clip.y) / clip.w;
+                }
+                glm::vec2 u = screen[1] - screen[0];
+                glm::vec2 v = screen[2] - screen[0];
+                if(u.x * v.y - u.y * v.x > 1e-6f)
+                {
+                    return false;
+                }
+            }
+        }
+        if(culler.outsideFrustum(bounds[i]))
+        {
+            bool outside = false;
+            for(int plane=0; (plane<6) && !outside; plane++)
+            {
+                outside = true;
+                for(int index=meshlet.firstIndex; (index<meshlet.firstIndex + meshlet.indexCount) && outside; index++)
+                {
+                    const float* position = &positions[3*indices[index]];
+                    glm::vec4 clip = modelViewProjection * glm::vec4(position[0], position[1], position[2], 1.0f);
+                    float coordinate = (plane & 1) ? -clip[plane / 2] : clip[plane / 2];
+                    outside = (clip.w + coordinate < 0.0f);
+                }
+            }
+            if(!outside)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Splits the mesh into meshlets and culls them from a few dozen views around it (some looking
+// past it, so that part of it is off screen), reporting how many clusters get culled and how
+// many clusters per millisecond the culling gets through
+static int benchMeshlets(const string& filename, int iterations)
+{
+    GeometryData geometry;
+    loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+    geometry.optimizeVertexCache();
+    double buildTime = timeBest(iterations, [&]() { geometry.buildMeshlets(); });
+    if(!validMeshlets(geometry))
+    {
+        cout << "FAILED: the meshlets don't match the index buffer" << endl;
+        return 1;
+    }
+    const vector<Meshlet>& meshlets = geometry.meshlets();
+    const vector<MeshletBounds>& bounds = geometry.meshletBounds();
+    int meshletCount = meshlets.size();
+
+    LODSelector sphere;
+    sphere.setMesh(geometry);
+    glm::vec3 center = sphere.sphereCenter();
+    float radius = sphere.sphereRadius();
+
+    // Cameras spread evenly around the mesh (on a golden angle spiral) at a few distances, with
+    // every other one looking somewhat off to the side, and one orthographic view
+    vector<glm::mat4> views;
+    const int viewCount = 48;
+    glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.01f * radius, 100.0f * radius);
+    for(int view=0; view<viewCount; view++)
+    {
+        float y = 1.0f - 2.0f * (view + 0.5f) / viewCount;
+        float ring = sqrtf(1.0f - y * y);
+        float angle = view * 2.39996323f;
+        glm::vec3 direction(ring * cosf(angle), y, ring * sinf(angle));
+        float distance = radius * (1.5f + (view % 3));
+        glm::vec3 target = center + ((view & 1) ? glm::vec3(radius, 0.0f, 0.0f) : glm::vec3(0.0f));
+        glm::vec3 up = (fabsf(y) > 0.9f) ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        views.push_back(projection * glm::lookAt(center + direction * distance, target, up));
+    }
+    views.push_back(glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / radius)) * glm::translate(glm::mat4(1.0f), -center));
+
+    long long frustumCulled = 0;
+    long long backFaceCulled = 0;
+    long long trianglesDrawn = 0;
+    for(size_t view=0; view<views.size(); view++)
+    {
+        MeshletCuller culler(views[view]);
+        if(!cullingIsConservative(geometry, views[view], culler))
+        {
+            cout << "FAILED: view " << view << " culled a meshlet that could be visible" << endl;
+            return 1;
+        }
+        for(int i=0; i<meshletCount; i++)
+        {
+            bool outside = culler.outsideFrustum(bounds[i]);
+            bool backFacing = !outside && culler.backFacing(bounds[i]);
+            frustumCulled += outside ? 1 : 0;
+            backFaceCulled += backFacing ? 1 : 0;
+            trianglesDrawn += (!outside && !backFacing) ? meshlets[i].indexCount / 3 : 0;
+        }
+    }
+
+    vector<int> visible(meshletCount);
+    int visibleCount = 0;
+    double cullTime = timeBest(iterations, [&]()
+    {
+        for(size_t view=0; view<views.size(); view++)
+        {
+            MeshletCuller culler(views[view]);
+            visibleCount += culler.cull(&bounds[0], meshletCount, &visible[0]);
+        }
+    });
+
+    long long meshletViews = (long long)meshletCount * views.size();
+    double triangleViews = (double)geometry.indexCount() / 3 * views.size();
+    int totalVertices = 0;
+    for(int i=0; i<meshletCount; i++)
+    {
+        totalVertices += meshlets[i].vertexCount;
+    }
+    cout << filename << " (" << geometry.indexCount() / 3 << " triangles, " << views.size()
+         << " views, best of " << iterations << ")" << endl;
+    cout << "\t" << meshletCount << " meshlets, " << (double)totalVertices / meshletCount << " vertices and "
+         << geometry.indexCount() / 3.0 / meshletCount << " triangles each on average, built in "
+         << buildTime << " ms" << endl;
+    cout << "\tculled: " << 100.0 * frustumCulled / meshletViews << "% outside the frustum, "
+         << 100.0 * backFaceCulled / meshletViews << "% back facing, "
+         << 100.0 * (1.0 - trianglesDrawn / triangleViews) << "% of triangles skipped" << endl;
+    cout << "\tculling: " << meshletViews / cullTime << " clusters/ms" << endl;
+    return 0;
+}
+
+struct BenchRay
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float maxDistance;
+};
+
+// A xorshift generator, so that every run (and platform) casts the same rays
+struct RayRandom
+{
+    unsigned int state = 2463534242u;
+
+    float next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    glm::vec3 onSphere()
+    {
+        float z = next() * 2.0f - 1.0f;
+        float angle = next() * 6.2831853f;
+        float ring = sqrtf(1.0f - z * z);
+        return glm::vec3(ring * cosf(angle), ring * sinf(angle), z);
+    }
+};
+
+// Tests the ray against every triangle, the way the BVH would if it had no nodes at all
+static bool bruteForceHit(GeometryData& geometry, const BenchRay& ray, bool closest, float& hitDistance)
+{
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    const float* positions = (const float*)geometry.vertexData();
+    hitDistance = ray.maxDistance;
+    bool found = false;
+    for(int index=0; index<geometry.indexCount(); index+=3)
+    {
+        const float* p0 = &positions[3*indices[index]];
+        const float* p1 = &positions[3*indices[index + 1]];
+        const float* p2 = &positions[3*indices[index + 2]];
+        glm::vec3 corner(p0[0], p0[1], p0[2]);
+        glm::vec3 edge1 = glm::vec3(p1[0], p1[1], p1[2]) - corner;
+        glm::vec3 edge2 = glm::vec3(p2[0], p2[1], p2[2]) - corner;
+        float distance, u, v;
+        if(intersectTriangle(ray.origin, ray.direction, corner, edge1, edge2, distance, u, v) &&
+           (distance >= 0.0f) && (distance < hitDistance))
+        {
+            hitDistance = distance;
+            found = true;
+            if(!closest)
+            {
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+// Checks the first few rays against brute force, as many as makes for about 10^8 triangle tests,
+// and returns how many rays per second brute force got through (or 0 if the BVH got one wrong)
+static double checkRays(GeometryData& geometry, const BVH& bvh, const vector<BenchRay>& rays, bool closest)
+{
+    size_t checkCount = min(rays.size(), max((size_t)16, (size_t)(1e8 / max(1, geometry.indexCount() / 3))));
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i=0; i<checkCount; i++)
+    {
+        const BenchRay& ray = rays[i];
+        float expectedDistance;
+        bool expected = bruteForceHit(geometry, ray, closest, expectedDistance);
+        RayHit hit;
+        bool found = closest ? bvh.closestHit(ray.origin, ray.direction, ray.maxDistance, hit)
+                             : bvh.anyHit(ray.origin, ray.direction, ray.maxDistance);
+        if((found != expected) || (closest && found && (hit.distance != expectedDistance)))
+        {
+            cout.precision(9);
+            cout << "FAILED: ray " << i << (closest ? " closest hit " : " any hit ") << found
+                 << " at " << (found ? hit.distance : 0.0f) << ", brute force " << expected
+                 << " at " << expectedDistance << endl;
+            return 0.0;
+        }
+    }
+    return checkCount / secondsSince(start);
+}
+
+// The rays the BVH benchmarks cast, and whether they want the closest hit or any hit
+struct BenchRaySet
+{
+    const char* label;
+    vector<BenchRay> rays;
+    bool closest;
+};
+
+// Camera rays (coherent, in 2x2 pixel quads so that every 4 in a row make a good packet) from a
+// few views around the mesh, rays between random points on a sphere around it (incoherent), and
+// shadow rays from where the camera rays hit towards a light
+static vector<BenchRaySet> makeBenchRays(GeometryData& geometry, const BVH& bvh)
+{
+    LODSelector sphere;
+    sphere.setMesh(geometry);
+    glm::vec3 center = sphere.sphereCenter();
+    float radius = max(sphere.sphereRadius(), 1e-30f);
+
+    const int viewCount = 4;
+    const int viewSize = 256;
+    vector<BenchRay> cameraRays;
+    for(int view=0; view<viewCount; view++)
+    {
+        float y = 1.0f - 2.0f * (view + 0.5f) / viewCount;
+        float ring = sqrtf(1.0f - y * y);
+        float angle = view * 2.39996323f;
+        glm::vec3 eye = center + glm::vec3(ring * cosf(angle), y, ring * sinf(angle)) * (2.5f * radius);
+        glm::vec3 forward = glm::normalize(center - eye);
+        glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+        glm::vec3 up = glm::cross(right, forward);
+        for(int pixel=0; pixel<viewSize*viewSize; pixel++)
+        {
+            int quad = pixel / 4;
+            int pixelX = (quad % (viewSize / 2)) * 2 + (pixel & 1);
+            int pixelY = (quad / (viewSize / 2)) * 2 + ((pixel >> 1) & 1);
+            float x = (pixelX + 0.5f) / viewSize * 2.0f - 1.0f;
+            float z = (pixelY + 0.5f) / viewSize * 2.0f - 1.0f;
+            BenchRay ray = { eye, forward + (right * x + up * z) * 0.5f, 1e30f };
+            cameraRays.push_back(ray);
+        }
+    }
+    RayRandom random;
+    vector<BenchRay> randomRays;
+    for(int i=0; i<viewCount*viewSize*viewSize; i++)
+    {
+        glm::vec3 from = center + random.onSphere() * (2.0f * radius);
+        glm::vec3 to = center + random.onSphere() * (random.next() * radius);
+        BenchRay ray = { from, to - from, 1e30f };
+        randomRays.push_back(ray);
+    }
+    vector<BenchRay> shadowRays;
+    glm::vec3 light = glm::normalize(glm::vec3(0.3f, 1.0f, 0.5f));
+    for(size_t i=0; i<cameraRays.size(); i++)
+    {
+        RayHit hit;
+        if(bvh.closestHit(cameraRays[i].origin, cameraRays[i].direction, cameraRays[i].maxDistance, hit))
+        {
+            glm::vec3 position = cameraRays[i].origin + cameraRays[i].direction * hit.distance;
+            BenchRay ray = { position + light * (1e-4f * radius), light, 1e30f };
+            shadowRays.push_back(ray);
+        }
+    }
+
+    vector<BenchRaySet> raySets(3);
+    raySets[0].label = "camera (closest hit)";
+    raySets[0].rays.swap(cameraRays);
+    raySets[0].closest = true;
+    raySets[1].label = "random (closest hit)";
+    raySets[1].rays.swap(randomRays);
+    raySets[1].closest = true;
+    raySets[2].label = "shadow (any hit)    ";
+    raySets[2].rays.swap(shadowRays);
+    raySets[2].closest = false;
+    return raySets;
+}
+
+// Builds the BVH with one thread and with all of them, then casts the rays from makeBenchRays at
+// it, checking them against brute force
+static int benchBVH(const string& filename, int iterations)
+{
+    GeometryData geometry;
+    loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    const float* positions = (const float*)geometry.vertexData();
+    int triangleCount = geometry.indexCount() / 3;
+    if(triangleCount == 0)
+    {
+        cout << "FAILED: " << filename << " has no triangles" << endl;
+        return 1;
+    }
+
+    BVH bvh;
+    double serialTime = timeBest(iterations, [&]() { bvh.build(indices, geometry.indexCount(), positions, 1); });
+    double parallelTime = timeBest(iterations, [&]() { bvh.build(indices, geometry.indexCount(), positions, 0); });
+
+    vector<BenchRaySet> raySets = makeBenchRays(geometry, bvh);
+
+    cout << filename << " (" << triangleCount << " triangles, best of " << iterations << ")" << endl;
+    cout << "\tbuild: " << serialTime << " ms on 1 thread, " << parallelTime << " ms on "
+         << thread::hardware_concurrency() << ", " << bvh.nodeCount() << " nodes ("
+         << bvh.nodeCount() * sizeof(BVHNode) / (1024.0 * 1024.0) << " MB), " << bvh.depth() << " deep" << endl;
+    for(size_t set=0; set<raySets.size(); set++)
+    {
+        const BenchRaySet& raySet = raySets[set];
+        const vector<BenchRay>& rays = raySet.rays;
+        double bruteForceRate = checkRays(geometry, bvh, rays, raySet.closest);
+        if(bruteForceRate == 0.0)
+        {
+            return 1;
+        }
+        int hitCount = 0;
+        double rayTime = timeBest(iterations, [&]()
+        {
+            hitCount = 0;
+            for(size_t i=0; i<rays.size(); i++)
+            {
+                RayHit hit;
+                bool found = raySet.closest ? bvh.closestHit(rays[i].origin, rays[i].direction, rays[i].maxDistance, hit)
+                                            : bvh.anyHit(rays[i].origin, rays[i].direction, rays[i].maxDistance);
+                hitCount += found ? 1 : 0;
+            }
+        });
+        double rate = rays.size() / (rayTime / 1000.0);
+        cout << "\t" << raySet.label << ": " << rate / 1e6 << " Mrays/s, " << 100.0 * hitCount / max((size_t)1, rays.size())
+             << "% hit (brute force " << bruteForceRate << " rays/s, " << rate / bruteForceRate << "x)" << endl;
+    }
+    return 0;
+}
+
+// Casts the rays from makeBenchRays one at a time through the binary and the 4 wide BVH, and as
+// packets of 4 through the binary one, checking that they all get the same hits. For scale, it
+// also times a plain loop over every triangle with glm::intersectRayTriangle, which is what
+// picking would take without a BVH
+static int benchPackets(const string& filename, int iterations)
+{
+    GeometryData geometry;
+    loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    const float* positions = (const float*)geometry.vertexData();
+    int triangleCount = geometry.indexCount() / 3;
+    if(triangleCount == 0)
+    {
+        cout << "FAILED: " << filename << " has no triangles" << endl;
+        return 1;
+    }
+    BVH bvh;
+    bvh.build(indices, geometry.indexCount(), positions);
+    vector<BenchRaySet> raySets = makeBenchRays(geometry, bvh);
+
+    // NOTE: glm's test only hits triangles from the front, so it finds fewer hits than the BVH,
+    //       but it's the same amount of work per triangle
+    const vector<BenchRay>& baselineRays = raySets[1].rays;
+    size_t baselineCount = min(baselineRays.size(), max((size_t)16, (size_t)(2e7 / triangleCount)));
+    int baselineHits = 0;
+    double baselineTime = timeBest(1, [&]()
+    {
+        for(size_t i=0; i<baselineCount; i++)
+        {
+            float closest = baselineRays[i].maxDistance;
+            for(int index=0; index<geometry.indexCount(); index+=3)
+            {
+                const float* p0 = &positions[3*indices[index]];
+                const float* p1 = &positions[3*indices[index + 1]];
+                const float* p2 = &positions[3*indices[index + 2]];
+                glm::vec3 barycentric;
+                if(glm::intersectRayTriangle(baselineRays[i].origin, baselineRays[i].direction,
+                                             glm::vec3(p0[0], p0[1], p0[2]), glm::vec3(p1[0], p1[1], p1[2]),
+                                             glm::vec3(p2[0], p2[1], p2[2]), barycentric) &&
+                   (barycentric.z < closest))
+                {
+                    closest = barycentric.z;
+                }
+            }
+            baselineHits += (closest < baselineRays[i].maxDistance) ? 1 : 0;
+        }
+    });
+    double baselineRate = baselineCount / (baselineTime / 1000.0);
+
+    cout << filename << " (" << triangleCount << " triangles, " << bvh.nodeCount() << " binary nodes, "
+         << bvh.wideNodeArray().size() << " wide nodes, best of " << iterations << ")" << endl;
+    cout << "\tglm::intersectRayTriangle over every triangle: " << baselineRate << " rays/s ("
+         << baselineHits << " of the first " << baselineCount << " random rays hit)" << endl;
+    vector<RayPacket> packets;
+    vector<float> expected;
+    vector<float> distances;
+    for(size_t set=0; set<raySets.size(); set++)
+    {
+        const BenchRaySet& raySet = raySets[set];
+        const vector<BenchRay>& rays = raySet.rays;
+        int rayCount = rays.size();
+        packets.resize((rayCount + 3) / 4);
+        for(int i=0; i<(int)packets.size()*4; i++)
+        {
+            RayPacket& packet = packets[i / 4];
+            const BenchRay& ray = rays[min(i, rayCount - 1)];
+            int lane = i % 4;
+            packet.originX[lane] = ray.origin.x;
+            packet.originY[lane] = ray.origin.y;
+            packet.originZ[lane] = ray.origin.z;
+            packet.directionX[lane] = ray.direction.x;
+            packet.directionY[lane] = ray.direction.y;
+            packet.directionZ[lane] = ray.direction.z;
+            packet.maxDistance[lane] = (i < rayCount) ? ray.maxDistance : 0.0f;
+        }
+
+        // Every variant writes each ray's hit distance (or -1 for a miss) here
+        expected.resize(rayCount);
+        distances.resize(rayCount);
+        double singleTime = timeBest(iterations, [&]()
+        {
+            for(int i=0; i<rayCount; i++)
+            {
+                RayHit hit;
+                bool found = raySet.closest ? bvh.closestHit(rays[i].origin, rays[i].direction, rays[i].maxDistance, hit)
+                                            : bvh.anyHit(rays[i].origin, rays[i].direction, rays[i].maxDistance);
+                expected[i] = found ? (raySet.closest ? hit.distance : 0.0f) : -1.0f;
+            }
+        });
+        double wideTime = timeBest(iterations, [&]()
+        {
+            for(int i=0; i<rayCount; i++)
+            {
+                RayHit hit;
+                bool found = raySet.closest ? bvh.closestHitWide(rays[i].origin, rays[i].direction, rays[i].maxDistance, hit)
+                                            : bvh.anyHitWide(rays[i].origin, rays[i].direction, rays[i].maxDistance);
+                distances[i] = found ? (raySet.closest ? hit.distance : 0.0f) : -1.0f;
+            }
+        });
+        if(distances != expected)
+        {
+            cout << "FAILED: the wide BVH doesn't get the same " << raySet.label << " hits" << endl;
+            return 1;
+        }
+        double packetTime = timeBest(iterations, [&]()
+        {
+            for(size_t packet=0; packet<packets.size(); packet++)
+            {
+                RayHit hits[4];
+                int found = raySet.closest ? bvh.closestHitPacket(packets[packet], hits)
+                                           : bvh.anyHitPacket(packets[packet]);
+                for(int lane=0; (lane<4) && (4*(int)packet + lane < rayCount); lane++)
+                {
+                    bool laneFound = (found & (1 << lane)) != 0;
+                    distances[4*packet + lane] = laneFound ? (raySet.closest ? hits[lane].distance : 0.0f) : -1.0f;
+                }
+            }
+        });
+        if(distances != expected)
+        {
+            cout << "FAILED: the packets don't get the same " << raySet.label << " hits" << endl;
+            return 1;
+        }
+
+        double singleRate = rayCount / (singleTime / 1000.0);
+        double wideRate = rayCount / (wideTime / 1000.0);
+        double packetRate = rayCount / (packetTime / 1000.0);
+        cout << "\t" << raySet.label << ": single " << singleRate / 1e6 << ", wide " << wideRate / 1e6
+             << " (" << wideRate / singleRate << "x), packets " << packetRate / 1e6 << " ("
+             << packetRate / singleRate << "x) Mrays/s, " << singleRate / baselineRate << "x the brute force rate"
+             << endl;
+    }
+    return 0;
+}
+
+static double nodeSurfaceArea(const BVHNode& node)
+{
+    glm::dvec3 extent = glm::dvec3(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]) -
+                        glm::dvec3(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]);
+    return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+// The tree's surface area heuristic cost, which is how many nodes a random ray through the root's
+// box visits plus how many triangles it tests on average (visiting a node costing as much as
+// testing a triangle, like build assumes). Lower is a better tree
+static double sahCost(const BVH& bvh)
+{
+    const vector<BVHNode>& nodes = bvh.nodeArray();
+    double rootArea = nodes.empty() ? 0.0 : nodeSurfaceArea(nodes[0]);
+    if(!(rootArea > 0.0))
+    {
+        return 0.0;
+    }
+    double cost = 0.0;
+    for(size_t node=0; node<nodes.size(); node++)
+    {
+        cost += nodeSurfaceArea(nodes[node]) * ((nodes[node].triangleCount > 0) ? nodes[node].triangleCount : 1);
+    }
+    return cost / rootArea;
+}
+
+// Builds the tree with the SAH build and the linear one, on one thread and on all of them, and
+// compares how long that takes and how fast the trees are to cast rays at (checking the linear
+// one against brute force)
+static int benchLinearBVH(const string& filename, int iterations)
+{
+    GeometryData geometry;
+    loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    const float* positions = (const float*)geometry.vertexData();
+    int triangleCount = geometry.indexCount() / 3;
+    if(triangleCount == 0)
+    {
+        cout << "FAILED: " << filename << " has no triangles" << endl;
+        return 1;
+    }
+
+    BVH sahBVH;
+    BVH linearBVH;
+    double sahSerialTime = timeBest(iterations, [&]() { sahBVH.build(indices, geometry.indexCount(), positions, 1); });
+    double sahParallelTime = timeBest(iterations, [&]() { sahBVH.build(indices, geometry.indexCount(), positions, 0); });
+    double linearSerialTime = timeBest(iterations, [&]()
+    {
+        linearBVH.buildLinear(indices, geometry.indexCount(), positions, 1);
+    });
+    double linearParallelTime = timeBest(iterations, [&]()
+    {
+        linearBVH.buildLinear(indices, geometry.indexCount(), positions, 0);
+    });
+
+    cout << filename << " (" << triangleCount << " triangles, best of " << iterations << ")" << endl;
+    const char* labels[] = { "SAH   ", "linear" };
+    const BVH* trees[] = { &sahBVH, &linearBVH };
+    double serialTimes[] = { sahSerialTime, linearSerialTime };
+    double parallelTimes[] = { sahParallelTime, linearParallelTime };
+    for(int tree=0; tree<2; tree++)
+    {
+        cout << "\t" << labels[tree] << " build: " << serialTimes[tree] << " ms on 1 thread, " << parallelTimes[tree]
+             << " ms on " << thread::hardware_concurrency() << " (" << triangleCount / parallelTimes[tree] / 1000.0
+             << " Mtriangles/s), " << trees[tree]->nodeCount() << " nodes, " << trees[tree]->depth()
+             << " deep, SAH cost " << sahCost(*trees[tree]) << endl;
+    }
+    cout << "\tlinear build is " << sahParallelTime / linearParallelTime << "x faster" << endl;
+
+    vector<BenchRaySet> raySets = makeBenchRays(geometry, sahBVH);
+    for(size_t set=0; set<raySets.size(); set++)
+    {
+        const BenchRaySet& raySet = raySets[set];
+        const vector<BenchRay>& rays = raySet.rays;
+        if(checkRays(geometry, linearBVH, rays, raySet.closest) == 0.0)
+        {
+            return 1;
+        }
+        double rates[2];
+        for(int tree=0; tree<2; tree++)
+        {
+            const BVH& bvh = *trees[tree];
+            double rayTime = timeBest(iterations, [&]()
+            {
+                for(size_t i=0; i<rays.size(); i++)
+                {
+                    RayHit hit;
+                    if(raySet.closest)
+                    {
+                        bvh.closestHit(rays[i].origin, rays[i].direction, rays[i].maxDistance, hit);
+                    }
+                    else
+                    {
+                        bvh.anyHit(rays[i].origin, rays[i].direction, rays[i].maxDistance);
+                    }
+                }
+            });
+            rates[tree] = rays.size() / (rayTime / 1000.0);
+        }
+        cout << "\t" << raySet.label << ": SAH " << rates[0] / 1e6 << ", linear " << rates[1] / 1e6 << " Mrays/s ("
+             << rates[1] / rates[0] << "x)" << endl;
+    }
+    return 0;
+}
+
+// Sorts keys (with each one's index as its value) with RadixSorter on one thread and on all of
+// them, and with std::sort on pairs, checking that the radix sort gets the same order as a stable
+// sort would
+template<typename Key>
+static bool benchSortKeys(const char* label, const vector<Key>& keys, int iterations,
+                          int keyBits=8*sizeof(Key))
+{
+    int count = keys.size();
+    vector<pair<Key, uint32_t> > pairs(count);
+    Key keyMask = (keyBits < (int)(8*sizeof(Key))) ? (((Key)1 << keyBits) - 1) : ~(Key)0;
+    auto keyLess = [keyMask](const pair<Key, uint32_t>& a, const pair<Key, uint32_t>& b)
+    {
+        return (a.first & keyMask) < (b.first & keyMask);
+    };
+    double stdTime = timeBest(iterations, [&]()
+    {
+        for(int i=0; i<count; i++)
+        {
+            pairs[i] = make_pair(keys[i], (uint32_t)i);
+        }
+        sort(pairs.begin(), pairs.end(), keyLess);
+    });
+    for(int i=0; i<count; i++)
+    {
+        pairs[i] = make_pair(keys[i], (uint32_t)i);
+    }
+    stable_sort(pairs.begin(), pairs.end(), keyLess);
+
+    ThreadPool serialPool(1);
+    ThreadPool pool(0);
+    ThreadPool* pools[] = { &serialPool, &pool };
+    RadixSorter sorter;
+    vector<Key> sortedKeys(count);
+    vector<uint32_t> values(count);
+    double radixTimes[2];
+    for(int run=0; run<2; run++)
+    {
+        radixTimes[run] = timeBest(iterations, [&]()
+        {
+            for(int i=0; i<count; i++)
+            {
+                sortedKeys[i] = keys[i];
+                values[i] = i;
+            }
+            sorter.sort(*pools[run], sortedKeys.data(), values.data(), count, keyBits);
+        });
+        for(int i=0; i<count; i++)
+        {
+            if((sortedKeys[i] != pairs[i].first) || (values[i] != pairs[i].second))
+            {
+                cout << "FAILED: " << label << " aren't sorted the way std::stable_sort sorts them" << endl;
+                return false;
+            }
+        }
+    }
+    cout << "\t" << label << " (" << count << "): std::sort " << stdTime << " ms, radix " << radixTimes[0]
+         << " ms on 1 thread (" << stdTime / radixTimes[0] << "x), " << radixTimes[1] << " ms on "
+         << pool.threadCount() << " (" << stdTime / radixTimes[1] << "x)" << endl;
+    return true;
+}
+
+// Radix sort vs. std::sort on keys like the ones the mesh pipeline sorts: vertex positions (for
+// welding), and random 32 and 64 bit keys, as many as the mesh has triangles (like Morton codes
+// or draw keys). The 32 bit ones are also sorted by only their low bits, which the radix sort
+// has to leave the rest of the key out of
+static int benchSort(const string& filename, int iterations)
+{
+    GeometryData geometry;
+    loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+    const float* positions = (const float*)geometry.vertexData();
+    int vertexCount = geometry.vertexCount();
+    int triangleCount = geometry.indexCount() / 3;
+
+    vector<uint32_t> positionKeys(vertexCount);
+    for(int vertex=0; vertex<vertexCount; vertex++)
+    {
+        positionKeys[vertex] = floatSortKey(positions[3*vertex]);
+    }
+    uint64_t state = 88172645463325252ull;
+    vector<uint32_t> randomKeys32(triangleCount);
+    vector<uint64_t> randomKeys64(triangleCount);
+    for(int i=0; i<triangleCount; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        randomKeys64[i] = state;
+        randomKeys32[i] = (uint32_t)(state >> 32);
+    }
+
+    cout << filename << " (best of " << iterations << ")" << endl;
+    if(!benchSortKeys("vertex x keys", positionKeys, iterations) ||
+       !benchSortKeys("random 32 bit keys", randomKeys32, iterations) ||
+       !benchSortKeys("random 32 bit keys by their low 20 bits", randomKeys32, iterations, 20) ||
+       !benchSortKeys("random 64 bit keys", randomKeys64, iterations))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+// Loads the mesh, and if it has no normals or texture coords (like the sample bunny) swaps it for
+// a copy that has them: area weighted vertex normals, and texture coords projected onto a sphere
+// around the mesh. The copy goes through a temporary OBJ file so that it gets its tangents (and
+// everything else) from the loader just like a mesh that came with them would
+static bool loadWithAllAttributes(GeometryData& geometry, const string& filename)
+{
+    loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+    if(geometry.hasNormals() && geometry.hasTextureCoords())
+    {
+        return true;
+    }
+    int vertexCount = geometry.vertexCount();
+    int indexCount = geometry.indexCount();
+    if(vertexCount == 0)
+    {
+        return false;
+    }
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    const glm::vec3* positions = (const glm::vec3*)geometry.vertexData();
+
+    vector<glm::vec3> normals(vertexCount, glm::vec3(0.0f));
+    for(int i=0; i+2<indexCount; i+=3)
+    {
+        // The cross product's length is twice the triangle's area, which does the weighting
+        glm::vec3 faceNormal = glm::cross(positions[indices[i+1]] - positions[indices[i]],
+                                          positions[indices[i+2]] - positions[indices[i]]);
+        for(int corner=0; corner<3; corner++)
+        {
+            normals[indices[i+corner]] += faceNormal;
+        }
+    }
+    glm::vec3 minPosition = positions[0];
+    glm::vec3 maxPosition = positions[0];
+    for(int i=1; i<vertexCount; i++)
+    {
+        minPosition = glm::min(minPosition, positions[i]);
+        maxPosition = glm::max(maxPosition, positions[i]);
+    }
+    glm::vec3 center = 0.5f * (minPosition + maxPosition);
+
+    string attributeFilename = filename + ".attributes.obj";
+    {
+        ofstream out(attributeFilename, ios::binary);
+        out.precision(9);
+        for(int i=0; i<vertexCount; i++)
+        {
+            glm::vec3 normal = normals[i];
+            float length = glm::length(normal);
+            normal = (length > 0.0f) ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+            glm::vec3 direction = positions[i] - center;
+            float u = 0.5f + atan2f(direction.z, direction.x) / (2.0f * glm::pi<float>());
+            float v = 0.5f + atan2f(direction.y, glm::length(glm::vec2(direction.x, direction.z))) / glm::pi<float>();
+            out << "v " << positions[i].x << " " << positions[i].y << " " << positions[i].z << "\n";
+            out << "vt " << u << " " << v << "\n";
+            out << "vn " << normal.x << " " << normal.y << " " << normal.z << "\n";
+        }
+        for(int i=0; i+2<indexCount; i+=3)
+        {
+            out << "f";
+            for(int corner=0; corner<3; corner++)
+            {
+                unsigned int index = indices[i+corner] + 1;
+                out << " " << index << "/" << index << "/" << index;
+            }
+            out << "\n";
+        }
+        if(!out.good())
+        {
+            remove(attributeFilename.c_str());
+            return false;
+        }
+    }
+
+    geometry = GeometryData();
+    loadUncached(geometry, attributeFilename, OBJ_LOAD_MAPPED);
+    remove(attributeFilename.c_str());
+    return geometry.hasNormals() && geometry.hasTextureCoords();
+}
+
+// Compares the separate (structure of arrays) and interleaved vertex layouts for a pass that
+// only reads positions, a pass that gathers every attribute through the index buffer, and for
+// copying the whole vertex buffer (as an upload would)
+static int benchLayout(const string& filename, int iterations)
+{
+    GeometryData geometry;
+    if(!loadWithAllAttributes(geometry, filename))
+    {
+        cout << "FAILED: unable to load " << filename << " with normals and texture coords" << endl;
+        return 1;
+    }
+
+    int vertexCount = geometry.vertexCount();
+    int indexCount = geometry.indexCount();
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    const float* positions = (const float*)geometry.vertexData();
+    const float* normals = (const float*)geometry.normalData();
+    const float* texCoords = (const float*)geometry.textureCoordData();
+    const float* tangents = (const float*)geometry.tangentData();
+
+    double buildTime = timeBest(iterations, [&]() { geometry.buildInterleavedVertices(); });
+    const InterleavedVertex* vertices = (const InterleavedVertex*)geometry.interleavedVertexData();
+
+    // NOTE: The results are accumulated into a volatile so the passes can't be optimized away
+    volatile float sink = 0.0f;
+    double separateBoundsTime = timeBest(iterations, [&]()
+    {
+        float maxCoord = -1e30f;
+        for(int i=0; i<3*vertexCount; i++)
+        {
+            maxCoord = max(maxCoord, positions[i]);
+        }
+        sink = maxCoord;
+    });
+    double interleavedBoundsTime = timeBest(iterations, [&]()
+    {
+        float maxCoord = -1e30f;
+        for(int i=0; i<vertexCount; i++)
+        {
+            maxCoord = max(maxCoord, max(vertices[i].position[0],
+                                         max(vertices[i].position[1], vertices[i].position[2])));
+        }
+        sink = maxCoord;
+    });
+
+    double separateGatherTime = timeBest(iterations, [&]()
+    {
+        float total = 0.0f;
+        for(int i=0; i<indexCount; i++)
+        {
+            unsigned int v = indices[i];
+            total += positions[3*v] + normals[3*v+1] + texCoords[2*v] + tangents[4*v+2];
+        }
+        sink = total;
+    });
+    double interleavedGatherTime = timeBest(iterations, [&]()
+    {
+        float total = 0.0f;
+        for(int i=0; i<indexCount; i++)
+        {
+            const InterleavedVertex& vertex = vertices[indices[i]];
+            total += vertex.position[0] + vertex.normal[1] + vertex.texCoord[0] + vertex.tangent[2];
+        }
+        sink = total;
+    });
+
+    vector<char> staging;
+    double separateUploadTime = timeBest(iterations, [&]() { uploadStreams(geometry, staging); });
+    double interleavedUploadTime = timeBest(iterations, [&]()
+    {
+        const char* data = (const char*)vertices;
+        staging.assign(data, data + vertexCount*sizeof(InterleavedVertex));
+    });
+
+    cout << filename << " (" << vertexCount << " vertices, " << indexCount/3 << " triangles, best of "
+         << iterations << ")" << endl;
+    cout << "\tbuilding interleaved array: " << buildTime << " ms" << endl;
+    cout << "\tposition-only pass:  separate " << separateBoundsTime << " ms, interleaved "
+         << interleavedBoundsTime << " ms" << endl;
+    cout << "\tindexed gather pass: separate " << separateGatherTime << " ms, interleaved "
+         << interleavedGatherTime << " ms" << endl;
+    cout << "\tupload copy:         separate " << separateUploadTime << " ms, interleaved "
+         << interleavedUploadTime << " ms" << endl;
+    return 0;
+}
+
+static int benchQuantize(const string& filename, int iterations)
+{
+    GeometryData geometry;
+    loadUncached(geometry, filename, OBJ_LOAD_MAPPED);
+
+    int vertexCount = geometry.vertexCount();
+    const float* positions = (const float*)geometry.vertexData();
+    const float* normals = (const float*)geometry.normalData();
+    const float* texCoords = (const float*)geometry.textureCoordData();
+
+    double buildTime = timeBest(iterations, [&]() { geometry.buildQuantizedVertices(); });
+    const QuantizedVertex* vertices = (const QuantizedVertex*)geometry.quantizedVertexData();
+    glm::vec3 offset = geometry.quantizedPositionOffset();
+    glm::vec3 scale = geometry.quantizedPositionScale();
+
+    // Decode everything the same way the GL does and compare with the original floats
+    float maxPositionError = 0.0f;
+    float maxNormalError = 0.0f;
+    float maxTexCoordError = 0.0f;
+    for(int i=0; i<vertexCount; i++)
+    {
+        glm::uint64 packedPosition;
+        memcpy(&packedPosition, vertices[i].position, sizeof(packedPosition));
+        glm::vec3 position = offset + glm::vec3(glm::unpackUnorm4x16(packedPosition)) * scale;
+        maxPositionError = max(maxPositionError, glm::length(position - glm::vec3(positions[3*i],
+                                                                                  positions[3*i+1],
+                                                                                  positions[3*i+2])));
+        if(normals)
+        {
+            glm::vec3 normal = glm::vec3(glm::unpackSnorm3x10_1x2(vertices[i].normal));
+            glm::vec3 original(normals[3*i], normals[3*i+1], normals[3*i+2]);
+            float cosine = glm::dot(glm::normalize(normal), glm::normalize(original));
+            maxNormalError = max(maxNormalError, glm::degrees(acosf(min(1.0f, cosine))));
+        }
+        if(texCoords)
+        {
+            glm::vec2 texCoord = glm::unpackHalf2x16(vertices[i].texCoord);
+            maxTexCoordError = max(maxTexCoordError, glm::length(texCoord - glm::vec2(texCoords[2*i],
+                                                                                      texCoords[2*i+1])));
+        }
+    }
+
+    // What each layout actually puts in the vertex buffer
+    int separateBytes = 3*sizeof(float);
+    separateBytes += geometry.hasNormals() ? 3*sizeof(float) : 0;
+    separateBytes += geometry.hasTextureCoords() ? 2*sizeof(float) : 0;
+    separateBytes += geometry.hasTangents() ? 4*sizeof(float) : 0;
+    double vertexMB = (double)vertexCount / (1024.0*1024.0);
+
+    cout << filename << " (" << vertexCount << " vertices, best of " << iterations << ")" << endl;
+    cout << "\tquantizing: " << buildTime << " ms" << endl;
+    cout << "\tbytes per vertex: separate " << separateBytes << " (" << separateBytes*vertexMB
+         << " MB), interleaved " << sizeof(InterleavedVertex) << " (" << sizeof(InterleavedVertex)*vertexMB
+         << " MB), quantized " << sizeof(QuantizedVertex) << " (" << sizeof(QuantizedVertex)*vertexMB
+         << " MB)" << endl;
+    cout << "\tmax position error: " << maxPositionError << " (bounding box "
+         << scale.x << " x " << scale.y << " x " << scale.z << ")" << endl;
+    if(normals)
+    {
+        cout << "\tmax normal error: " << maxNormalError << " degrees" << endl;
+    }
+    if(texCoords)
+    {
+        cout << "\tmax texture coord error: " << maxTexCoordError << endl;
+    }
+    return 0;
+}
+
+static int benchTangents(const string& filename, int iterations)
+{
+    GeometryData geometry;
+    if(!loadWithAllAttributes(geometry, filename) || !geometry.hasTangents())
+    {
+        cout << "FAILED: unable to load " << filename << " with normals and texture coords" << endl;
+        return 1;
+    }
+
+    double tangentTime = timeBest(iterations, [&]() { geometry.generateTangents(); });
+
+    // Run the face tangent kernels over the whole mesh in structure of arrays form, the SIMD
+    // kernel has to match the scalar one exactly
+    int triangleCount = geometry.indexCount()/3;
+    const unsigned int* indices = (const unsigned int*)geometry.indexData();
+    const float* positions = (const float*)geometry.vertexData();
+    const float* texCoords = (const float*)geometry.textureCoordData();
+    vector<float> triangleData(15*triangleCount);
+    TriangleBatch triangles;
+    for(int corner=0; corner<3; corner++)
+    {
+        float* x = &triangleData[(5*corner + 0)*triangleCount];
+        float* y = &triangleData[(5*corner + 1)*triangleCount];
+        float* z = &triangleData[(5*corner + 2)*triangleCount];
+        float* u = &triangleData[(5*corner + 3)*triangleCount];
+        float* v = &triangleData[(5*corner + 4)*triangleCount];
+        for(int i=0; i<triangleCount; i++)
+        {
+            unsigned int index = indices[3*i + corner];
+            x[i] = positions[3*index];
+            y[i] = positions[3*index+1];
+            z[i] = positions[3*index+2];
+            u[i] = texCoords[2*index];
+            v[i] = texCoords[2*index+1];
+        }
+        triangles.x[corner] = x;
+        triangles.y[corner] = y;
+        triangles.z[corner] = z;
+        triangles.u[corner] = u;
+        triangles.v[corner] = v;
+    }
+    vector<float> scalarData(6*triangleCount);
+    vector<float> simdData(6*triangleCount);
+    FaceTangentBatch scalarTangents = { &scalarData[0], &scalarData[triangleCount], &scalarData[2*triangleCount],
+                                        &scalarData[3*triangleCount], &scalarData[4*triangleCount], &scalarData[5*triangleCount] };
+    FaceTangentBatch simdTangents = { &simdData[0], &simdData[triangleCount], &simdData[2*triangleCount],
+                                      &simdData[3*triangleCount], &simdData[4*triangleCount], &simdData[5*triangleCount] };
+    double scalarTime = timeBest(iterations, [&]() { computeFaceTangentsScalar(triangles, triangleCount, scalarTangents); });
+    double simdTime = timeBest(iterations, [&]() { computeFaceTangents(triangles, triangleCount, simdTangents); });
+    bool kernelsMatch = (memcmp(&scalarData[0], &simdData[0], scalarData.size()*sizeof(float)) == 0);
+
+    // Every frame should be orthonormal, with the handedness exactly +-1
+    int vertexCount = geometry.vertexCount();
+    const float* normals = (const float*)geometry.normalData();
+    const float* tangents = (const float*)geometry.tangentData();
+    float maxLengthError = 0.0f;
+    float maxNormalDot = 0.0f;
+    int badHandedness = 0;
+    for(int i=0; i<vertexCount; i++)
+    {
+        glm::vec3 normal = glm::normalize(glm::vec3(normals[3*i], normals[3*i+1], normals[3*i+2]));
+        glm::vec3 tangent(tangents[4*i], tangents[4*i+1], tangents[4*i+2]);
+        maxLengthError = max(maxLengthError, fabsf(glm::length(tangent) - 1.0f));
+        maxNormalDot = max(maxNormalDot, fabsf(glm::dot(normal, tangent)));
+        badHandedness += (fabsf(tangents[4*i+3]) != 1.0f) ? 1 : 0;
+    }
+
+    cout << filename << " (" << vertexCount << " vertices, " << geometry.indexCount()/3
+         << " triangles, best of " << iterations << ")" << endl;
+    cout << "\tgenerating tangents: " << tangentTime << " ms ("
+         << (geometry.indexCount()/3) / (tangentTime * 1000.0) << " M triangles/s)" << endl;
+#if GLM_ARCH & GLM_ARCH_AVX
+    const char* simdName = "AVX";
+#elif GLM_ARCH & GLM_ARCH_SSE2
+    const char* simdName = "SSE2";
+#else
+    const char* simdName = "none";
+#endif
+    cout << "\tface tangent kernel: scalar " << scalarTime << " ms, SIMD (" << simdName << ") "
+         << simdTime << " ms, " << scalarTime/simdTime << "x" << endl;
+    cout << "\tSIMD kernel matches scalar: " << (kernelsMatch ? "yes" : "NO") << endl;
+    cout << "\tmax |length - 1|: " << maxLengthError << ", max |dot(normal, tangent)|: "
+         << maxNormalDot << ", bad handedness: " << badHandedness << endl;
+    return kernelsMatch ? 0 : 1;
+}
+
+// Counts the heap allocations made by one load with each loader, along with the most memory the
+// heap held at once during the load. Each loader gets the best of iterations loads, which leaves
+// out the one-off allocations (eg. starting threads) that only the first load makes
+static int benchAlloc(const string& filename, int iterations)
+{
+    const OBJLoadMode modes[] = { OBJ_LOAD_STREAM, OBJ_LOAD_MAPPED, OBJ_LOAD_PARALLEL };
+    const char* modeNames[] = { "stream", "mapped", "parallel" };
+
+    cout << filename << " (" << fileSizeMB(filename) << " MB, best of " << iterations << ")" << endl;
+    for(int mode=0; mode<3; mode++)
+    {
+        size_t count = SIZE_MAX;
+        size_t bytes = SIZE_MAX;
+        size_t peak = SIZE_MAX;
+        size_t result = SIZE_MAX;
+        for(int i=0; i<iterations; i++)
+        {
+            size_t startCount = allocationCount;
+            size_t startBytes = allocatedBytes;
+            size_t startLive = liveBytes;
+            peakLiveBytes = startLive;
+
+            GeometryData geometry;
+            loadUncached(geometry, filename, modes[mode]);
+
+            count = min(count, allocationCount - startCount);
+            bytes = min(bytes, allocatedBytes - startBytes);
+            peak = min(peak, peakLiveBytes - startLive);
+            result = min(result, liveBytes - startLive);
+        }
+
+        double bytesMB = (double)bytes / (1024.0*1024.0);
+        double peakMB = (double)peak / (1024.0*1024.0);
+        double resultMB = (double)result / (1024.0*1024.0);
+        cout << "\t" << modeNames[mode] << ": " << count << " allocations, " << bytesMB
+             << " MB allocated, " << peakMB << " MB peak heap, " << resultMB << " MB result" << endl;
+    }
+    cout << "\tpeak resident: " << peakResidentMB() << " MB" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        cout << "Usage: meshbench <benchmark> [obj file] [iterations]" << endl;
+        cout << "Benchmarks:" << endl;
+        cout << "\tparse     stream vs. memory-mapped OBJ loader throughput" << endl;
+        cout << "\tparallel  parallel OBJ loader scaling from 1 to N threads" << endl;
+        cout << "\tcache     startup time with a cold vs. warm mesh cache" << endl;
+        cout << "\tstream    streaming loader throughput and peak memory vs. a full load" << endl;
+        cout << "\tlayout    separate vs. interleaved vertex layout for CPU passes and uploads" << endl;
+        cout << "\tquantize  quantized vertex size, build time and precision" << endl;
+        cout << "\talloc     heap allocations and peak memory of one load with each loader" << endl;
+        cout << "\ttangents  tangent generation time, SIMD vs. scalar kernel and frame quality" << endl;
+        cout << "\tvcache    post-transform vertex cache ACMR/ATVR before and after optimizing" << endl;
+        cout << "\tvfetch    simulated vertex fetch cache misses before and after renumbering vertices" << endl;
+        cout << "\toverdraw  overdraw and ACMR at a few overdraw optimizer thresholds" << endl;
+        cout << "\tlod       simplified levels of detail: triangles, error and build time per level" << endl;
+        cout << "\tinstances triangles drawn and LOD switches for thousands of instances with LOD selection" << endl;
+        cout << "\tmeshlets  meshlet sizes, how many get culled from views around the mesh, clusters/ms" << endl;
+        cout << "\tbvh       BVH build time, and rays/s for closest and any hit queries vs. brute force" << endl;
+        cout << "\tpackets   rays/s one at a time, through the 4 wide BVH and as packets of 4, vs. brute force" << endl;
+        cout << "\tlbvh      linear (Morton code) BVH build time and rays/s vs. the SAH build" << endl;
+        cout << "\tsort      radix sort vs. std::sort on 32 and 64 bit keys, on 1 and N threads" << endl;
+        cout << "\tasync     render loop stalls with a synchronous vs. background load" << endl;
+        cout << "\tvariants  exporter variants (relative indices, w, colors, continuations) vs. plain" << endl;
+        cout << "\tindices   every loader drops faces that refer to vertices that don't exist" << endl;
+        return 1;
+    }
+
+    string benchmark = argv[1];
+    string filename = (argc > 2) ? argv[2] : "sample-bunny.obj";
+    int iterations = (argc > 3) ? atoi(argv[3]) : 10;
+    if(iterations < 1)
+    {
+        iterations = 1;
+    }
+
+    if(benchmark == "parse")
+    {
+        return benchParse(filename, iterations);
+    }
+    if(benchmark == "parallel")
+    {
+        return benchParallel(filename, iterations);
+    }
+    if(benchmark == "cache")
+    {
+        return benchCache(filename, iterations);
+    }
+    if(benchmark == "stream")
+    {
+        return benchStream(filename, iterations);
+    }
+    if(benchmark == "layout")
+    {
+        return benchLayout(filename, iterations);
+    }
+    if(benchmark == "quantize")
+    {
+        return benchQuantize(filename, iterations);
+    }
+    if(benchmark == "alloc")
+    {
+        return benchAlloc(filename, iterations);
+    }
+    if(benchmark == "tangents")
+    {
+        return benchTangents(filename, iterations);
+    }
+    if(benchmark == "vcache")
+    {
+        return benchVertexCache(filename, iterations);
+    }
+    if(benchmark == "vfetch")
+    {
+        return benchVertexFetch(filename, iterations);
+    }
+    if(benchmark == "overdraw")
+    {
+        return benchOverdraw(filename, iterations);
+    }
+    if(benchmark == "lod")
+    {
+        return benchLOD(filename, iterations);
+    }
+    if(benchmark == "instances")
+    {
+        return benchInstances(filename, iterations);
+    }
+    if(benchmark == "meshlets")
+    {
+        return benchMeshlets(filename, iterations);
+    }
+    if(benchmark == "bvh")
+    {
+        return benchBVH(filename, iterations);
+    }
+    if(benchmark == "packets")
+    {
+        return benchPackets(filename, iterations);
+    }
+    if(benchmark == "lbvh")
+    {
+        return benchLinearBVH(filename, iterations);
+    }
+    if(benchmark == "sort")
+    {
+        return benchSort(filename, iterations);
+    }
+    if(benchmark == "async")
+    {
+        return benchAsync(filename, iterations);
+    }
+    if(benchmark == "variants")
+    {
+        return benchVariants(filename, iterations);
+    }
+    if(benchmark == "indices")
+    {
+        return benchBadIndices(filename, iterations);
+    }
+
+    cout << "Unknown benchmark: " << benchmark << endl;
+    return 1;
+}
@@ -0,0 +1,231 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "geometry.h"
+#include "meshcache.h"
+#include "threadpool.h"
+
+// The asset compiler: runs the whole GeometryData pipeline over OBJ files offline (parsing,
+// deduplicating vertices, generating tangents, reordering for the vertex caches and overdraw,
+// quantizing, and building the levels of detail, meshlets and BVH) and writes each result out as
+// the mesh cache next to its OBJ file, which the program then maps instead of parsing anything at
+// startup. Run from the build directory, eg.
+//     ./meshc ../assets
+//
+// Each argument is either an OBJ file or a directory whose .obj files are all compiled. Files are
+// compiled in parallel, one per thread, and any whose cache is already up to date are skipped.
+// Nothing here needs a GL context.
+
+using namespace std;
+
+static bool isDirectory(const string& path)
+{
+    struct stat pathStat;
+    return (stat(path.c_str(), &pathStat) == 0) && ((pathStat.st_mode & S_IFMT) == S_IFDIR);
+}
+
+static bool hasOBJExtension(const string& filename)
+{
+    if(filename.size() < 4)
+    {
+        return false;
+    }
+    string extension = filename.substr(filename.size() - 4);
+    for(size_t i=0; i<extension.size(); i++)
+    {
+        extension[i] = tolower(extension[i]);
+    }
+    return extension == ".obj";
+}
+
+// Appends the OBJ files directly inside directory (not in its subdirectories) to files
+static void findOBJFiles(const string& directory, vector<string>& files)
+{
+    vector<string> found;
+#ifdef _WIN32
+    WIN32_FIND_DATAA findData;
+    HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &findData);
+    if(find == INVALID_HANDLE_VALUE)
+    {
+        cout << "Unable to read directory: " << directory << endl;
+        return;
+    }
+    do
+    {
+        if(!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && hasOBJExtension(findData.cFileName))
+        {
+            found.push_back(directory + "/" + findData.cFileName);
+        }
+    } while(FindNextFileA(find, &findData));
+    FindClose(find);
+#else
+    DIR* dir = opendir(directory.c_str());
+    if(!dir)
+    {
+        cout << "Unable to read directory: " << directory << endl;
+        return;
+    }
+    while(dirent* entry = readdir(dir))
+    {
+        string path = directory + "/" + entry->d_name;
+        if(hasOBJExtension(entry->d_name) && !isDirectory(path))
+        {
+            found.push_back(path);
+        }
+    }
+    closedir(dir);
+#endif
+
+    // NOTE: Directory order is arbitrary, sorting keeps the output the same from run to run
+    sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+
+// A cache is only up to date if it matches the OBJ file and has everything we would have put in it
+static bool isUpToDate(const string& objFilename)
+{
+    MeshCacheKey key;
+    MeshCacheHeader header;
+    if(!getMeshCacheKey(objFilename, key) || !readMeshCacheHeader(meshCacheFilename(objFilename), header))
+    {
+        return false;
+    }
+    return (header.sourceSize == key.sourceSize) &&
+           (header.sourceModifiedTime == key.sourceModifiedTime) &&
+           ((header.vertexCount == 0) ||
+            ((header.streams[MESH_STREAM_QUANTIZED].size > 0) && (header.lodCount > 0) &&
+             (header.meshletCount > 0) && (header.bvhNodeCount > 0)));
+}
+
+// Runs the pipeline on one OBJ file, writing a line about how it went to report
+static bool compileMesh(const string& objFilename, ostringstream& report)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // NOTE: Loading always parses here (rather than trusting an existing cache), and takes care
+    //       of the parsing, deduplication and tangent generation
+    GeometryData geometry;
+    geometry.setUseMeshCache(false);
+    geometry.loadFromOBJFile(objFilename, OBJ_LOAD_MAPPED);
+    if(geometry.vertexCount() == 0)
+    {
+        report << "FAILED " << objFilename << ": no geometry loaded";
+        return false;
+    }
+
+    geometry.optimizeVertexCache();
+    geometry.optimizeOverdraw();
+    geometry.optimizeVertexFetch();
+    geometry.buildQuantizedVertices();
+
+    // NOTE: Files are already compiled one per thread, so the levels of detail and the BVH get
+    //       just the one
+    geometry.buildLODs(defaultLODRatios(), 1);
+    geometry.buildMeshlets();
+    geometry.buildBVH(1);
+    if(!geometry.saveMeshCache(objFilename))
+    {
+        report << "FAILED " << objFilename << ": unable to write " << meshCacheFilename(objFilename);
+        return false;
+    }
+
+    double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    report << "Compiled " << objFilename << ": " << geometry.vertexCount() << " vertices, "
+           << geometry.indexCount()/3 << " triangles, " << geometry.materialCount()
+           << " materials, " << geometry.lodCount() << " levels of detail, "
+           << geometry.meshlets().size() << " meshlets, " << geometry.bvh().nodeCount()
+           << " BVH nodes in " << time*1000.0 << " ms";
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    bool force = false;
+    int threadCount = 0;
+    vector<string> inputs;
+    for(int arg=1; arg<argc; arg++)
+    {
+        if(strcmp(argv[arg], "-f") == 0)
+        {
+            force = true;
+        }
+        else if((strcmp(argv[arg], "-j") == 0) && (arg + 1 < argc))
+        {
+            threadCount = atoi(argv[++arg]);
+        }
+        else
+        {
+            inputs.push_back(argv[arg]);
+        }
+    }
+    if(inputs.empty())
+    {
+        cout << "Usage: meshc [-f] [-j threads] <obj file or directory>..." << endl;
+        cout << "\t-f  compile every file, even if its mesh cache is up to date" << endl;
+        cout << "\t-j  the number of files to compile at once (default: one per hardware thread)" << endl;
+        return 1;
+    }
+
+    vector<string> files;
+    for(size_t input=0; input<inputs.size(); input++)
+    {
+        if(isDirectory(inputs[input]))
+        {
+            findOBJFiles(inputs[input], files);
+        }
+        else
+        {
+            files.push_back(inputs[input]);
+        }
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    mutex outputMutex;
+    atomic<int> compiledCount(0);
+    atomic<int> skippedCount(0);
+    atomic<int> failedCount(0);
+    ThreadPool pool(threadCount);
+    pool.parallelFor(files.size(), [&](int fileIndex)
+    {
+        const string& filename = files[fileIndex];
+        ostringstream report;
+        if(!force && isUpToDate(filename))
+        {
+            report << "Up to date " << filename;
+            skippedCount++;
+        }
+        else if(compileMesh(filename, report))
+        {
+            compiledCount++;
+        }
+        else
+        {
+            failedCount++;
+        }
+
+        lock_guard<mutex> lock(outputMutex);
+        cout << report.str() << endl;
+    });
+
+    double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << compiledCount << " compiled, " << skippedCount << " up to date, " << failedCount
+         << " failed in " << time*1000.0 << " ms" << endl;
+    return (failedCount > 0) ? 1 : 0;
+}